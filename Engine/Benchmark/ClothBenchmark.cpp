@@ -0,0 +1,675 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "ClothMesh.h"
+#include "ClothSnapshot.h"
+#include "ClothStepper.h"
+#include "ClothWorld.h"
+
+// --------------------------------------------------------
+// Headless cloth benchmark
+//
+// Steps the same scene as the app (pinned edge swinging over the
+// colliders) for a fixed number of 60 Hz frames and reports the
+// throughput and a checksum of the final particle positions. Runs
+// are deterministic for any thread count, so the checksum can be
+// compared between builds to catch simulation changes.
+// --------------------------------------------------------
+
+namespace
+{
+	struct ClothSize
+	{
+		uint32_t width;
+		uint32_t height;
+	};
+
+	struct Options
+	{
+		std::vector<ClothSize> sizes;
+		uint32_t iterations;
+		uint32_t frames;
+		uint32_t cloths;
+		uint32_t threads;
+		uint32_t capsules;
+		uint32_t substeps;
+		float damping;
+		float relaxation;
+		float spectralRadius;
+		//adaptive Gauss-Seidel tolerance, < 0 = fixed iteration count
+		float tolerance;
+		uint32_t maxIterations;
+		std::string colliders;
+		//state files of the first cloth, only with a single size
+		std::string loadState;
+		std::string saveState;
+		std::string record;
+		std::string replay;
+		ClothSolver solver;
+		bool simd;
+		bool selfCollision;
+		bool sleeping;
+		bool staticEdge;
+		bool normals;
+		bool async;
+		bool quantize;
+		bool checkThreads;
+		bool fixedSize;
+		bool versusGaussSeidel;
+	};
+
+	//what a run is compared by; 0 for the parts it didn't produce
+	struct RunHashes
+	{
+		uint64_t particles;
+		uint64_t mesh;
+		uint64_t quantized;
+		//simulation time, normals left out
+		double seconds;
+		//largest GetLastMaxError of the first cloth, 0 without --adaptive
+		float worstStretch;
+	};
+
+	const float FRAME_DT = 1.0f / 60.0f;
+	//--versus-gs gives up on Jacobi past this many times the Gauss-Seidel sweeps
+	const uint32_t VERSUS_MAX_MULTIPLE = 8;
+
+	void PrintUsage()
+	{
+		printf(
+			"usage: cloth_benchmark [options]\n"
+			"  --sizes WxH[,WxH...]  cloth sizes to run (default 32x32,64x64,128x128)\n"
+			"  --iterations N        Gauss-Seidel or Jacobi sweeps (default %u)\n"
+			"  --frames N            frames to step per size (default 600)\n"
+			"  --cloths N            cloths of each size in the world (default 1)\n"
+			"  --threads N           worker threads including the caller, 0 = all cores (default 0)\n"
+			"  --colliders SET       none, sphere, capsules or mixed (default sphere)\n"
+			"  --capsules N          capsules in the capsules/mixed sets (default 24)\n"
+			"  --solver NAME         gs, xpbd or jacobi (default gs)\n"
+			"  --relaxation F        Jacobi over-relaxation weight (default %g)\n"
+			"  --chebyshev RHO       Chebyshev acceleration of the Jacobi solver, 0 = off (default %g)\n"
+			"  --substeps N          XPBD substeps per frame (default %u)\n"
+			"  --damping F           fraction of velocity lost per step (default 0)\n"
+			"  --adaptive TOL        stop GS or Jacobi sweeps once every stick is within TOL\n"
+			"                        of its rest length (fraction, e.g. %g)\n"
+			"  --max-iterations N    sweep cap for --adaptive (default twice --iterations)\n"
+			"  --scalar              use the scalar kernels instead of SIMD\n"
+			"  --self-collision      enable cloth self-collision\n"
+			"  --sleep               let still regions of the cloth sleep\n"
+			"  --static-edge         don't swing the pinned edge, so the cloth can settle\n"
+			"  --normals             also build the first cloth's render mesh every frame,\n"
+			"                        write it out like the app does and time that separately\n"
+			"  --async               step on a ClothStepper while this thread writes out\n"
+			"                        the previous frame's mesh, and time the whole frame\n"
+			"  --quantize            write the mesh as 16 bit quantized vertices\n"
+			"  --check-threads       run every size again on the calling thread alone and\n"
+			"                        check the checksums match the pool's (exit code 1 if not)\n"
+			"  --fixed               run the sizes FixedParticleSystem is instantiated for\n"
+			"                        (16x16, 32x32, 64x64) again through it, and compare its\n"
+			"                        speed and positions with the runtime-sized cloth's\n"
+			"                        (exit code 1 if they differ)\n"
+			"  --versus-gs           with --solver jacobi, also run every size with --iterations\n"
+			"                        Gauss-Seidel sweeps, then Jacobi with 1, 2, ... %u times\n"
+			"                        as many until its worst stretch is as small\n"
+			"  --load-state FILE     start the first cloth from a snapshot\n"
+			"  --save-state FILE     snapshot the first cloth after the run\n"
+			"  --record FILE         record the first cloth's steps to a replay stream\n"
+			"  --replay FILE         run a recorded stream instead of the animation and\n"
+			"                        report the first step that differs\n"
+			"  (the state options need a single --sizes entry)\n",
+			ParticleSystem::DEFAULT_ITERATIONS, ParticleSystem::DEFAULT_JACOBI_RELAXATION, ParticleSystem::DEFAULT_SPECTRAL_RADIUS, ParticleSystem::DEFAULT_SUBSTEPS,
+			ParticleSystem::DEFAULT_ITERATION_TOLERANCE, VERSUS_MAX_MULTIPLE);
+	}
+
+	const char* SolverName(ClothSolver solver)
+	{
+		switch (solver)
+		{
+		case ClothSolver::XPBD: return "xpbd";
+		case ClothSolver::Jacobi: return "jacobi";
+		default: return "gs";
+		}
+	}
+
+	bool ParseSizes(const char* text, std::vector<ClothSize>& sizes)
+	{
+		sizes.clear();
+		while (*text)
+		{
+			ClothSize size;
+			char* end;
+			size.width = static_cast<uint32_t>(strtoul(text, &end, 10));
+			if (*end != 'x')
+				return false;
+			size.height = static_cast<uint32_t>(strtoul(end + 1, &end, 10));
+			if (size.width < 2 || size.height < 2)
+				return false;
+			sizes.push_back(size);
+			text = *end == ',' ? end + 1 : end;
+			if (*end != ',' && *end != '\0')
+				return false;
+		}
+		return !sizes.empty();
+	}
+
+	bool ParseOptions(int argc, char** argv, Options& options)
+	{
+		options.sizes.clear();
+		options.sizes.push_back({ 32, 32 });
+		options.sizes.push_back({ 64, 64 });
+		options.sizes.push_back({ 128, 128 });
+		options.iterations = ParticleSystem::DEFAULT_ITERATIONS;
+		options.frames = 600;
+		options.cloths = 1;
+		options.threads = 0;
+		options.capsules = 24;
+		options.substeps = ParticleSystem::DEFAULT_SUBSTEPS;
+		options.damping = 0.0f;
+		options.relaxation = ParticleSystem::DEFAULT_JACOBI_RELAXATION;
+		options.spectralRadius = ParticleSystem::DEFAULT_SPECTRAL_RADIUS;
+		options.tolerance = -1.0f;
+		options.maxIterations = 0;
+		options.colliders = "sphere";
+		options.solver = ClothSolver::GaussSeidel;
+		options.simd = true;
+		options.selfCollision = false;
+		options.sleeping = false;
+		options.staticEdge = false;
+		options.normals = false;
+		options.async = false;
+		options.quantize = false;
+		options.checkThreads = false;
+		options.fixedSize = false;
+		options.versusGaussSeidel = false;
+
+		for (int i = 1; i < argc; i++)
+		{
+			const char* arg = argv[i];
+			const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+			if (!strcmp(arg, "--scalar"))
+				options.simd = false;
+			else if (!strcmp(arg, "--self-collision"))
+				options.selfCollision = true;
+			else if (!strcmp(arg, "--sleep"))
+				options.sleeping = true;
+			else if (!strcmp(arg, "--static-edge"))
+				options.staticEdge = true;
+			else if (!strcmp(arg, "--normals"))
+				options.normals = true;
+			else if (!strcmp(arg, "--async"))
+				options.async = true;
+			else if (!strcmp(arg, "--quantize"))
+				options.quantize = true;
+			else if (!strcmp(arg, "--check-threads"))
+				options.checkThreads = true;
+			else if (!strcmp(arg, "--fixed"))
+				options.fixedSize = true;
+			else if (!strcmp(arg, "--versus-gs"))
+				options.versusGaussSeidel = true;
+			else if (!strcmp(arg, "--help") || !strcmp(arg, "-h"))
+				return false;
+			else if (!value)
+			{
+				fprintf(stderr, "missing value for %s\n", arg);
+				return false;
+			}
+			else
+			{
+				i++;
+				if (!strcmp(arg, "--sizes"))
+				{
+					if (!ParseSizes(value, options.sizes))
+					{
+						fprintf(stderr, "bad --sizes %s\n", value);
+						return false;
+					}
+				}
+				else if (!strcmp(arg, "--iterations"))
+					options.iterations = static_cast<uint32_t>(atoi(value));
+				else if (!strcmp(arg, "--frames"))
+					options.frames = static_cast<uint32_t>(atoi(value));
+				else if (!strcmp(arg, "--cloths"))
+					options.cloths = static_cast<uint32_t>(atoi(value));
+				else if (!strcmp(arg, "--threads"))
+					options.threads = static_cast<uint32_t>(atoi(value));
+				else if (!strcmp(arg, "--capsules"))
+					options.capsules = static_cast<uint32_t>(atoi(value));
+				else if (!strcmp(arg, "--substeps"))
+					options.substeps = static_cast<uint32_t>(atoi(value));
+				else if (!strcmp(arg, "--damping"))
+					options.damping = static_cast<float>(atof(value));
+				else if (!strcmp(arg, "--relaxation"))
+					options.relaxation = static_cast<float>(atof(value));
+				else if (!strcmp(arg, "--chebyshev"))
+					options.spectralRadius = static_cast<float>(atof(value));
+				else if (!strcmp(arg, "--adaptive"))
+					options.tolerance = static_cast<float>(atof(value));
+				else if (!strcmp(arg, "--max-iterations"))
+					options.maxIterations = static_cast<uint32_t>(atoi(value));
+				else if (!strcmp(arg, "--colliders"))
+					options.colliders = value;
+				else if (!strcmp(arg, "--load-state"))
+					options.loadState = value;
+				else if (!strcmp(arg, "--save-state"))
+					options.saveState = value;
+				else if (!strcmp(arg, "--record"))
+					options.record = value;
+				else if (!strcmp(arg, "--replay"))
+					options.replay = value;
+				else if (!strcmp(arg, "--solver"))
+				{
+					if (!strcmp(value, "gs"))
+						options.solver = ClothSolver::GaussSeidel;
+					else if (!strcmp(value, "xpbd"))
+						options.solver = ClothSolver::XPBD;
+					else if (!strcmp(value, "jacobi"))
+						options.solver = ClothSolver::Jacobi;
+					else
+					{
+						fprintf(stderr, "unknown solver %s\n", value);
+						return false;
+					}
+				}
+				else
+				{
+					fprintf(stderr, "unknown option %s\n", arg);
+					return false;
+				}
+			}
+		}
+
+		if (options.colliders != "none" && options.colliders != "sphere" &&
+			options.colliders != "capsules" && options.colliders != "mixed")
+		{
+			fprintf(stderr, "unknown collider set %s\n", options.colliders.c_str());
+			return false;
+		}
+		const bool stateFiles = !options.loadState.empty() || !options.saveState.empty() || !options.record.empty() || !options.replay.empty();
+		if (stateFiles && options.sizes.size() != 1)
+		{
+			fprintf(stderr, "state files need a single --sizes entry\n");
+			return false;
+		}
+		if (options.async && !options.replay.empty())
+		{
+			fprintf(stderr, "--async can't run a replay\n");
+			return false;
+		}
+		if (options.checkThreads && (!options.saveState.empty() || !options.record.empty()))
+		{
+			fprintf(stderr, "--check-threads would write the state files twice\n");
+			return false;
+		}
+		if (options.fixedSize && (options.iterations != ParticleSystem::DEFAULT_ITERATIONS || stateFiles))
+		{
+			fprintf(stderr, "--fixed needs the default --iterations and no state files\n");
+			return false;
+		}
+		if (options.versusGaussSeidel && (options.solver != ClothSolver::Jacobi || options.tolerance >= 0.0f || stateFiles))
+		{
+			fprintf(stderr, "--versus-gs needs --solver jacobi, no --adaptive and no state files\n");
+			return false;
+		}
+		return options.frames > 0 && options.cloths > 0 && options.iterations > 0;
+	}
+
+	// --------------------------------------------------------
+	// sphere   - the app's scene, one sphere under the cloth
+	// capsules - a ring of upright capsules, like limbs of a character
+	// mixed    - sphere, half the capsules, a box and a floor plane
+	// --------------------------------------------------------
+	void AddColliders(const Options& options, ColliderSet& colliders)
+	{
+		const std::string& set = options.colliders;
+		if (set == "sphere" || set == "mixed")
+			colliders.AddSphere(XMFLOAT3(0.f, 0.f, 0.f), 0.20f);
+
+		if (set == "capsules" || set == "mixed")
+		{
+			const uint32_t count = set == "mixed" ? options.capsules / 2 : options.capsules;
+			for (uint32_t i = 0; i < count; i++)
+			{
+				const float angle = 6.2831853f * static_cast<float>(i) / static_cast<float>(count);
+				const float x = 0.3f * cosf(angle);
+				const float z = 0.3f * sinf(angle);
+				colliders.AddCapsule(XMFLOAT3(x, -0.6f, z), XMFLOAT3(x, 0.2f, z), 0.05f);
+			}
+		}
+
+		if (set == "mixed")
+		{
+			colliders.AddBox(XMFLOAT3(0.f, -0.4f, 0.3f), XMFLOAT3(0.15f, 0.1f, 0.1f), XMFLOAT4(0.f, 0.3826834f, 0.f, 0.9238795f));
+			colliders.AddPlane(XMFLOAT3(0.f, 1.f, 0.f), -0.8f);
+		}
+	}
+
+	//FNV-1a over the bit patterns of every final position
+	uint64_t Checksum(const ClothWorld& world, const std::vector<ClothHandle>& handles)
+	{
+		uint64_t hash = 14695981039346656037ull;
+		for (size_t c = 0; c < handles.size(); c++)
+		{
+			const ParticleSystem* cloth = world.GetCloth(handles[c]);
+			for (uint32_t i = 0; i < cloth->GetParticleCount(); i++)
+			{
+				XMFLOAT3 p = cloth->GetParticlesPos(i);
+				uint32_t bits[3];
+				memcpy(bits, &p, sizeof(bits));
+				for (int k = 0; k < 3; k++)
+				{
+					for (int b = 0; b < 4; b++)
+					{
+						hash ^= (bits[k] >> (8 * b)) & 0xff;
+						hash *= 1099511628211ull;
+					}
+				}
+			}
+		}
+		return hash;
+	}
+
+	//FNV-1a over the bit patterns of the render normals
+	uint64_t NormalChecksum(const ClothMesh& mesh)
+	{
+		uint64_t hash = 14695981039346656037ull;
+		const float* streams[3] = { mesh.GetNormalX(), mesh.GetNormalY(), mesh.GetNormalZ() };
+		for (uint32_t i = 0; i < mesh.GetVertexCount(); i++)
+		{
+			for (int k = 0; k < 3; k++)
+			{
+				uint32_t bits;
+				memcpy(&bits, streams[k] + i, sizeof(bits));
+				for (int b = 0; b < 4; b++)
+				{
+					hash ^= (bits >> (8 * b)) & 0xff;
+					hash *= 1099511628211ull;
+				}
+			}
+		}
+		return hash;
+	}
+
+	//FNV-1a over the vertices as written out
+	uint64_t BytesChecksum(const void* data, size_t size)
+	{
+		uint64_t hash = 14695981039346656037ull;
+		const uint8_t* bytes = static_cast<const uint8_t*>(data);
+		for (size_t i = 0; i < size; i++)
+		{
+			hash ^= bytes[i];
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+
+	//sizes with a FixedParticleSystem instantiation for --fixed
+	bool HasFixedCloth(const ClothSize& size)
+	{
+		return size.width == size.height && (size.width == 16 || size.width == 32 || size.width == 64);
+	}
+
+	//one of the HasFixedCloth sizes, an invalid handle for the others
+	ClothHandle CreateFixedCloth(ClothWorld& world, const ClothSize& size)
+	{
+		const uint32_t iterations = ParticleSystem::DEFAULT_ITERATIONS;
+		if (size.width == 16 && size.height == 16)
+			return world.CreateFixedCloth<16, 16, iterations>();
+		if (size.width == 32 && size.height == 32)
+			return world.CreateFixedCloth<32, 32, iterations>();
+		if (size.width == 64 && size.height == 64)
+			return world.CreateFixedCloth<64, 64, iterations>();
+		return ClothHandle();
+	}
+
+	RunHashes RunSize(const Options& options, const ClothSize& size, ThreadPool* pool, bool fixedCloth = false)
+	{
+		ClothWorld world(pool);
+		AddColliders(options, world.GetColliders());
+
+		std::vector<ClothHandle> handles;
+		for (uint32_t c = 0; c < options.cloths; c++)
+		{
+			ClothHandle handle = fixedCloth ? CreateFixedCloth(world, size) : world.CreateCloth(size.width, size.height, options.iterations);
+			ParticleSystem* cloth = world.GetCloth(handle);
+			cloth->SetSimdEnabled(options.simd);
+			cloth->SetSolver(options.solver);
+			cloth->SetSubsteps(options.substeps);
+			cloth->SetJacobiAcceleration(options.relaxation, options.spectralRadius);
+			cloth->SetSelfCollision(options.selfCollision);
+			cloth->SetSleeping(options.sleeping);
+			cloth->SetDamping(options.damping);
+			if (options.tolerance >= 0.0f)
+				cloth->SetAdaptiveIterations(true, options.tolerance, 2, options.maxIterations);
+			handles.push_back(handle);
+		}
+
+		const ParticleSystem* first = world.GetCloth(handles[0]);
+		const double particlesPerFrame = static_cast<double>(world.GetParticleCount());
+		//sweeps actually run, which vary per frame with --adaptive
+		uint64_t sweeps = 0;
+		float worstError = 0.0f;
+
+		ParticleSystem* recorded = world.GetCloth(handles[0]);
+		if (!options.loadState.empty() && !ReadClothSnapshot(options.loadState.c_str(), *recorded))
+			fprintf(stderr, "can't load %s into a %ux%u cloth\n", options.loadState.c_str(), size.width, size.height);
+		ClothRecorder recorder;
+		if (!options.record.empty() && !recorder.Open(options.record.c_str(), *recorded))
+			fprintf(stderr, "can't record to %s\n", options.record.c_str());
+		ClothReplay replay;
+		if (!options.replay.empty() && !replay.Open(options.replay.c_str(), *recorded))
+		{
+			fprintf(stderr, "can't replay %s on a %ux%u cloth\n", options.replay.c_str(), size.width, size.height);
+			RunHashes none = { 0, 0, 0, 0.0, 0.0f };
+			return none;
+		}
+
+		ClothMesh mesh;
+		//stands in for the mapped vertex buffer, which is at least 16 byte aligned
+		const size_t vertexBytes = (options.quantize ? sizeof(QuantizedVertex) : sizeof(DynamicVertex)) * first->GetParticleCount();
+		void* vertices = Simd::AlignedAlloc(vertexBytes);
+		memset(vertices, 0, vertexBytes);
+		QuantizationBounds bounds;
+		double normalSeconds = 0.0;
+		auto WriteOut = [&](const ClothMesh& source) {
+			if (options.quantize)
+				source.WriteQuantizedVertices(static_cast<QuantizedVertex*>(vertices), bounds, pool);
+			else
+				source.WriteVertices(static_cast<DynamicVertex*>(vertices), pool);
+		};
+
+		//same edge swing as Entities::AnimateCloth
+		float animation = 0.0f;
+		auto AnimateEdges = [&](float dt) {
+			for (size_t c = 0; c < handles.size() && !options.staticEdge; c++)
+			{
+				ParticleSystem* cloth = world.GetCloth(handles[c]);
+				XMFLOAT3* edge = cloth->GetEdge();
+				for (uint32_t ii = 0; ii < cloth->GetEdgeCount(); ii++)
+				{
+					edge[ii].z = 1.f * sinf(animation);
+				}
+			}
+			animation += .125f * dt;
+		};
+		auto start = std::chrono::steady_clock::now();
+		uint32_t frames = 0;
+		for (; frames < options.frames && replay.IsOpen(); frames++)
+		{
+			//the stream drives the cloth, the colliders still bake every step like in the world
+			world.GetColliders().Update();
+			if (!replay.Step(*recorded))
+				break;
+			sweeps += first->GetLastIterationCount();
+			worstError = std::max(worstError, first->GetLastMaxError());
+		}
+		if (options.async)
+		{
+			//the world's fixed step is FRAME_DT, so Advance runs exactly the steps Update would
+			ClothStepper stepper(&world);
+			stepper.Track(handles[0]);
+			for (; frames < options.frames; frames++)
+			{
+				stepper.Submit(FRAME_DT, AnimateEdges);
+				//the previous frame goes out while this one steps
+				const ClothFrame* frame = stepper.Acquire();
+				if (frame)
+					WriteOut(frame->meshes[0]);
+				//the app doesn't wait, but here it keeps the run deterministic
+				stepper.Wait();
+				sweeps += first->GetLastIterationCount();
+				worstError = std::max(worstError, first->GetLastMaxError());
+			}
+			const ClothFrame* frame = stepper.Acquire();
+			if (frame)
+				mesh = frame->meshes[0];
+		}
+		for (; frames < options.frames && !replay.IsOpen(); frames++)
+		{
+			AnimateEdges(FRAME_DT);
+			world.Update(FRAME_DT);
+			sweeps += first->GetLastIterationCount();
+			worstError = std::max(worstError, first->GetLastMaxError());
+			if (options.normals)
+			{
+				auto normalStart = std::chrono::steady_clock::now();
+				mesh.Update(*first, world.GetInterpolationAlpha(), pool);
+				WriteOut(mesh);
+				normalSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - normalStart).count();
+			}
+		}
+		auto stop = std::chrono::steady_clock::now();
+		//the async loop wrote the frame before the last one
+		if (options.async && frames > 0)
+			WriteOut(mesh);
+		const uint64_t packedHash = BytesChecksum(vertices, vertexBytes);
+		Simd::AlignedFree(vertices);
+		recorder.Close();
+		if (!options.saveState.empty() && !WriteClothSnapshot(options.saveState.c_str(), *recorded))
+			fprintf(stderr, "can't write %s\n", options.saveState.c_str());
+
+		//the simulation numbers leave the normals out
+		const double seconds = std::chrono::duration<double>(stop - start).count() - normalSeconds;
+		const double particlesPerSecond = particlesPerFrame * frames / seconds;
+		//stick relaxations over all cloths
+		const double constraints = static_cast<double>(first->GetStickCount()) * sweeps * options.cloths;
+		const double nsPerConstraint = seconds * 1e9 / constraints;
+		char label[32];
+		snprintf(label, sizeof(label), "%ux%u", size.width, size.height);
+		printf("%-11s %10u %10u %8u %10.2f %14.4g %14.3f  %016llx",
+			label, world.GetParticleCount(), first->GetStickCount() * options.cloths, frames,
+			seconds * 1000.0, particlesPerSecond, nsPerConstraint,
+			static_cast<unsigned long long>(Checksum(world, handles)));
+		if (options.sleeping)
+			printf("  %u/%u tiles awake", first->GetAwakeTileCount(), first->GetTileCount());
+		if (options.tolerance >= 0.0f && options.solver != ClothSolver::XPBD)
+			printf("  %.2f sweeps/frame, worst stretch %.3g", static_cast<double>(sweeps) / frames, worstError);
+		if (options.async)
+			printf("  mesh (%016llx)", static_cast<unsigned long long>(NormalChecksum(mesh)));
+		else if (options.normals)
+			printf("  mesh %.1f us/frame (%016llx)", normalSeconds * 1e6 / frames, static_cast<unsigned long long>(NormalChecksum(mesh)));
+		if (options.quantize && (options.async || options.normals))
+			printf("  quantized (%016llx)", static_cast<unsigned long long>(packedHash));
+		if (replay.IsOpen() && replay.GetFirstMismatch() == ClothReplay::NO_MISMATCH)
+			printf("  replay matches");
+		else if (replay.IsOpen())
+			printf("  replay differs from step %u", replay.GetFirstMismatch());
+		printf("\n");
+
+		RunHashes hashes;
+		hashes.particles = Checksum(world, handles);
+		hashes.mesh = options.async || options.normals ? NormalChecksum(mesh) : 0;
+		hashes.quantized = options.quantize && (options.async || options.normals) ? packedHash : 0;
+		hashes.seconds = seconds;
+		hashes.worstStretch = worstError;
+		return hashes;
+	}
+
+	// --------------------------------------------------------
+	// Runs the size with --iterations Gauss-Seidel sweeps, then with
+	// Jacobi at growing multiples of that until the worst stretch is
+	// no larger than Gauss-Seidel's. Tolerance 0 never ends a frame
+	// early, it only makes every sweep measure the stretch. The rows
+	// print as they run; the last line sums up what Jacobi needed.
+	// --------------------------------------------------------
+	void CompareWithGaussSeidel(const Options& options, const ClothSize& size, ThreadPool* pool)
+	{
+		Options measured = options;
+		measured.tolerance = 0.0f;
+		measured.solver = ClothSolver::GaussSeidel;
+		measured.maxIterations = options.iterations;
+		const RunHashes gaussSeidel = RunSize(measured, size, pool);
+
+		measured.solver = ClothSolver::Jacobi;
+		for (uint32_t multiple = 1; multiple <= VERSUS_MAX_MULTIPLE; multiple++)
+		{
+			measured.maxIterations = options.iterations * multiple;
+			const RunHashes jacobi = RunSize(measured, size, pool);
+			if (jacobi.worstStretch <= gaussSeidel.worstStretch)
+			{
+				printf("  jacobi vs gauss-seidel: worst stretch %.3g needs %ux the sweeps, %.2fx the time\n",
+					gaussSeidel.worstStretch, multiple, jacobi.seconds / gaussSeidel.seconds);
+				return;
+			}
+		}
+		printf("  jacobi vs gauss-seidel: worst stretch %.3g not reached within %ux the sweeps\n",
+			gaussSeidel.worstStretch, VERSUS_MAX_MULTIPLE);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	if (!ParseOptions(argc, argv, options))
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	//one thread runs everything on the caller, no pool needed
+	ThreadPool* pool = nullptr;
+	if (options.threads != 1)
+		pool = new ThreadPool(options.threads > 0 ? options.threads - 1 : 0);
+	const uint32_t threadCount = pool ? pool->GetThreadCount() : 1;
+
+	printf("solver %s, %u iterations, %u substeps, colliders %s, %s, %u thread(s)%s%s%s%s\n",
+		SolverName(options.solver), options.iterations, options.substeps,
+		options.colliders.c_str(), options.simd ? "simd" : "scalar", threadCount,
+		options.selfCollision ? ", self-collision" : "", options.sleeping ? ", sleeping" : "",
+		options.staticEdge ? ", static edge" : "", options.async ? ", async" : "");
+	printf("%-11s %10s %10s %8s %10s %14s %14s  %s\n",
+		"size", "particles", "sticks", "frames", "ms", "particles/s", "ns/constraint", "checksum");
+	bool allMatch = true;
+	for (size_t i = 0; i < options.sizes.size(); i++)
+	{
+		const RunHashes pooled = RunSize(options, options.sizes[i], pool);
+		if (options.fixedSize && HasFixedCloth(options.sizes[i]))
+		{
+			//same scene through the compile-time sized cloth, which has to end up in the same place
+			const RunHashes fixed = RunSize(options, options.sizes[i], pool, true);
+			const bool positions = fixed.particles == pooled.particles && fixed.mesh == pooled.mesh && fixed.quantized == pooled.quantized;
+			printf("  fixed vs runtime size: positions %s, %.2fx the speed\n", positions ? "match" : "DIFFER", pooled.seconds / fixed.seconds);
+			allMatch = allMatch && positions;
+		}
+		if (options.versusGaussSeidel)
+			CompareWithGaussSeidel(options, options.sizes[i], pool);
+		if (!options.checkThreads || !pool)
+			continue;
+
+		//the same run without the pool, every hash it has must come out the same
+		const RunHashes single = RunSize(options, options.sizes[i], nullptr);
+		const bool particles = pooled.particles == single.particles;
+		const bool mesh = pooled.mesh == single.mesh;
+		const bool quantized = pooled.quantized == single.quantized;
+		printf("  1 vs %u thread(s): positions %s, mesh %s, quantized %s\n", threadCount,
+			particles ? "match" : "DIFFER", mesh ? "match" : "DIFFER", quantized ? "match" : "DIFFER");
+		allMatch = allMatch && particles && mesh && quantized;
+	}
+
+	delete pool;
+	return allMatch ? 0 : 1;
+}
@@ -0,0 +1,410 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
+#include "ObjLoader.h"
+
+// --------------------------------------------------------
+// Headless OBJ loading benchmark
+//
+// Writes a sphere of the given resolution as an OBJ file (or takes
+// an existing one), then times LoadObj on it. --baseline also times
+// the getline + sscanf loop LoadObj replaced; on the plain v/vt/vn
+// quads it understands both must produce the same triangles, though
+// only LoadObj welds them into shared vertices. --mixed
+// writes every face form LoadObj accepts (v, v/vt, v//vn, v/vt/vn,
+// triangles and quads, negative indices) instead. --optimize runs
+// the import time optimizations on the loaded mesh and prints the
+// average cache miss ratio after each of them. --cache writes the
+// result as a MeshCache and times loading it the way Mesh does on
+// the next launch: stamping the source, then mapping the cache.
+// --------------------------------------------------------
+
+namespace
+{
+	struct Options
+	{
+		uint32_t rows;
+		uint32_t runs;
+		uint32_t threads;
+		bool mixed;
+		bool baseline;
+		bool optimize;
+		bool cache;
+		const char* input;
+		const char* output;
+	};
+
+	void PrintUsage()
+	{
+		printf(
+			"usage: obj_benchmark [options]\n"
+			"  --rows N        sphere with N rows of 2N vertices (default 1000)\n"
+			"  --runs N        loads to time (default 3)\n"
+			"  --threads N     worker threads including the caller, 0 = all cores (default 0)\n"
+			"  --mixed         write every face form instead of v/vt/vn quads\n"
+			"  --baseline      also time the getline + sscanf loader\n"
+			"  --optimize      also time OptimizeMesh on the result and print its ACMR\n"
+			"  --cache         also time writing the binary mesh cache and opening it again\n"
+			"  --input FILE    load FILE instead of writing a sphere\n"
+			"  --output FILE   where the sphere is written (default obj_benchmark.obj)\n");
+	}
+
+	bool ParseOptions(int argc, char** argv, Options& options)
+	{
+		options.rows = 1000;
+		options.runs = 3;
+		options.threads = 0;
+		options.mixed = false;
+		options.baseline = false;
+		options.optimize = false;
+		options.cache = false;
+		options.input = nullptr;
+		options.output = "obj_benchmark.obj";
+
+		for (int i = 1; i < argc; i++)
+		{
+			const char* arg = argv[i];
+			const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+			if (!strcmp(arg, "--mixed"))
+				options.mixed = true;
+			else if (!strcmp(arg, "--baseline"))
+				options.baseline = true;
+			else if (!strcmp(arg, "--optimize"))
+				options.optimize = true;
+			else if (!strcmp(arg, "--cache"))
+				options.cache = true;
+			else if (!strcmp(arg, "--help") || !strcmp(arg, "-h"))
+				return false;
+			else if (!value)
+			{
+				fprintf(stderr, "missing value for %s\n", arg);
+				return false;
+			}
+			else
+			{
+				i++;
+				if (!strcmp(arg, "--rows"))
+					options.rows = static_cast<uint32_t>(atoi(value));
+				else if (!strcmp(arg, "--runs"))
+					options.runs = static_cast<uint32_t>(atoi(value));
+				else if (!strcmp(arg, "--threads"))
+					options.threads = static_cast<uint32_t>(atoi(value));
+				else if (!strcmp(arg, "--input"))
+					options.input = value;
+				else if (!strcmp(arg, "--output"))
+					options.output = value;
+				else
+				{
+					fprintf(stderr, "unknown option %s\n", arg);
+					return false;
+				}
+			}
+		}
+		return options.rows >= 2 && options.runs > 0;
+	}
+
+	// --------------------------------------------------------
+	// Writes a unit sphere: rows rings of 2 * rows vertices, each
+	// with its own position, uv and normal, and counter clockwise
+	// quads between the rings
+	// --------------------------------------------------------
+	bool WriteSphere(const char* path, uint32_t rows, bool mixed)
+	{
+		FILE* file = fopen(path, "wb");
+		if (!file)
+			return false;
+
+		const uint32_t columns = 2 * rows;
+		const long long total = static_cast<long long>(rows) * columns;
+		const float pi = 3.14159265f;
+		fprintf(file, "# obj_benchmark sphere, %u x %u\no sphere\n", rows, columns);
+		for (uint32_t r = 0; r < rows; r++)
+		{
+			const float theta = pi * r / (rows - 1);
+			for (uint32_t c = 0; c < columns; c++)
+			{
+				const float phi = 2.0f * pi * c / columns;
+				const float x = sinf(theta) * cosf(phi);
+				const float y = cosf(theta);
+				const float z = sinf(theta) * sinf(phi);
+				fprintf(file, "v %.6f %.6f %.6f\nvt %.6f %.6f\nvn %.6f %.6f %.6f\n",
+					x, y, z, static_cast<float>(c) / columns, static_cast<float>(r) / (rows - 1), x, y, z);
+			}
+		}
+		fprintf(file, "g surface\ns 1\n");
+		for (uint32_t r = 0; r + 1 < rows; r++)
+		{
+			for (uint32_t c = 0; c < columns; c++)
+			{
+				//1 based, going around the quad counter clockwise seen from outside
+				const long long row = static_cast<long long>(r) * columns + 1;
+				const long long next = row + columns;
+				const long long quad[4] = { row + c, row + (c + 1) % columns, next + (c + 1) % columns, next + c };
+				const uint32_t form = mixed ? (r * columns + c) % 4 : 0;
+				if (form == 0)
+				{
+					fprintf(file, "f %lld/%lld/%lld %lld/%lld/%lld %lld/%lld/%lld %lld/%lld/%lld\n",
+						quad[0], quad[0], quad[0], quad[1], quad[1], quad[1],
+						quad[2], quad[2], quad[2], quad[3], quad[3], quad[3]);
+				}
+				else if (form == 1)
+				{
+					//relative indices, every element was written before the faces
+					long long rel[4];
+					for (int k = 0; k < 4; k++)
+					{
+						rel[k] = quad[k] - total - 1;
+					}
+					fprintf(file, "f %lld//%lld %lld//%lld %lld//%lld\nf %lld//%lld %lld//%lld %lld//%lld\n",
+						rel[0], rel[0], rel[1], rel[1], rel[2], rel[2], rel[0], rel[0], rel[2], rel[2], rel[3], rel[3]);
+				}
+				else if (form == 2)
+				{
+					fprintf(file, "f %lld/%lld %lld/%lld %lld/%lld %lld/%lld # no normals\n",
+						quad[0], quad[0], quad[1], quad[1], quad[2], quad[2], quad[3], quad[3]);
+				}
+				else
+				{
+					fprintf(file, "f\t%lld %lld %lld %lld\r\n", quad[0], quad[1], quad[2], quad[3]);
+				}
+			}
+		}
+		return fclose(file) == 0;
+	}
+
+	// --------------------------------------------------------
+	// The loop LoadObj replaced, with std::string lines so long
+	// ones aren't cut and quads fanned the way LoadObj does
+	// --------------------------------------------------------
+	bool LoadObjBaseline(const char* path, std::vector<Vertex>& vertices)
+	{
+		std::ifstream obj(path);
+		if (!obj.is_open())
+			return false;
+
+		std::vector<XMFLOAT3> positions;
+		std::vector<XMFLOAT3> normals;
+		std::vector<XMFLOAT2> uvs;
+		std::string line;
+		vertices.clear();
+		while (std::getline(obj, line))
+		{
+			const char* chars = line.c_str();
+			if (chars[0] == 'v' && chars[1] == 'n')
+			{
+				XMFLOAT3 n;
+				sscanf(chars, "vn %f %f %f", &n.x, &n.y, &n.z);
+				normals.push_back(n);
+			}
+			else if (chars[0] == 'v' && chars[1] == 't')
+			{
+				XMFLOAT2 uv;
+				sscanf(chars, "vt %f %f", &uv.x, &uv.y);
+				uvs.push_back(uv);
+			}
+			else if (chars[0] == 'v')
+			{
+				XMFLOAT3 p;
+				sscanf(chars, "v %f %f %f", &p.x, &p.y, &p.z);
+				positions.push_back(p);
+			}
+			else if (chars[0] == 'f')
+			{
+				unsigned int i[12];
+				const int read = sscanf(chars, "f %u/%u/%u %u/%u/%u %u/%u/%u %u/%u/%u",
+					&i[0], &i[1], &i[2], &i[3], &i[4], &i[5], &i[6], &i[7], &i[8], &i[9], &i[10], &i[11]);
+				const int corners = read / 3;
+				for (int t = 0; t + 2 < corners; t++)
+				{
+					const int fan[3] = { 0, t + 1, t + 2 };
+					for (int k = 0; k < 3; k++)
+					{
+						const unsigned int* c = i + 3 * fan[k];
+						Vertex v;
+						v.Position = positions[c[0] - 1];
+						v.UV = uvs[c[1] - 1];
+						v.Normal = normals[c[2] - 1];
+						v.Position.z *= -1.0f;
+						v.Normal.z *= -1.0f;
+						v.UV.y = 1.0f - v.UV.y;
+						vertices.push_back(v);
+					}
+				}
+			}
+		}
+		return true;
+	}
+
+	//FNV-1a over the bytes of every triangle corner, so welded and unwelded
+	//meshes of the same triangles hash the same
+	uint64_t Checksum(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices)
+	{
+		uint64_t hash = 14695981039346656037ull;
+		for (size_t i = 0; i < indices.size(); i++)
+		{
+			const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&vertices[indices[i]]);
+			for (size_t b = 0; b < sizeof(Vertex); b++)
+			{
+				hash ^= bytes[b];
+				hash *= 1099511628211ull;
+			}
+		}
+		return hash;
+	}
+
+	//vertex and index buffer size, with 16 bit indices where Mesh would pick them
+	double BufferMegabytes(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices)
+	{
+		const size_t indexSize = vertices.size() <= MAX_SHORT_INDEX_VERTICES ? sizeof(uint16_t) : sizeof(uint32_t);
+		return (vertices.size() * sizeof(Vertex) + indices.size() * indexSize) / (1024.0 * 1024.0);
+	}
+
+	long long FileSize(const char* path)
+	{
+		FILE* file = fopen(path, "rb");
+		if (!file)
+			return -1;
+		fseek(file, 0, SEEK_END);
+		const long long size = ftell(file);
+		fclose(file);
+		return size;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	if (!ParseOptions(argc, argv, options))
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	const char* path = options.input;
+	if (!path)
+	{
+		path = options.output;
+		if (!WriteSphere(path, options.rows, options.mixed))
+		{
+			fprintf(stderr, "can't write %s\n", path);
+			return 1;
+		}
+	}
+	const double megabytes = FileSize(path) / (1024.0 * 1024.0);
+
+	ThreadPool* pool = nullptr;
+	if (options.threads != 1)
+		pool = new ThreadPool(options.threads > 0 ? options.threads - 1 : 0);
+	const uint32_t threadCount = pool ? pool->GetThreadCount() : 1;
+
+	std::vector<Vertex> vertices;
+	std::vector<uint32_t> indices;
+	double best = 1e30;
+	for (uint32_t run = 0; run < options.runs; run++)
+	{
+		auto start = std::chrono::steady_clock::now();
+		if (!LoadObj(path, vertices, indices, pool))
+		{
+			fprintf(stderr, "can't load %s\n", path);
+			return 1;
+		}
+		best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+	}
+
+	printf("%s, %.1f MB, %u thread(s)\n", path, megabytes, threadCount);
+	printf("%-10s %12s %12s %10s %10s %10s  %s\n", "loader", "triangles", "vertices", "buffer MB", "ms", "MB/s", "checksum");
+	printf("%-10s %12zu %12zu %10.1f %10.1f %10.1f  %016llx\n", "LoadObj", indices.size() / 3, vertices.size(),
+		BufferMegabytes(vertices, indices), best * 1000.0, megabytes / best,
+		static_cast<unsigned long long>(Checksum(vertices, indices)));
+
+	if (options.baseline)
+	{
+		std::vector<Vertex> reference;
+		auto start = std::chrono::steady_clock::now();
+		LoadObjBaseline(path, reference);
+		const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		std::vector<uint32_t> sequential(reference.size());
+		for (size_t i = 0; i < sequential.size(); i++)
+		{
+			sequential[i] = static_cast<uint32_t>(i);
+		}
+		printf("%-10s %12zu %12zu %10.1f %10.1f %10.1f  %016llx\n", "baseline", reference.size() / 3, reference.size(),
+			BufferMegabytes(reference, sequential), seconds * 1000.0, megabytes / seconds,
+			static_cast<unsigned long long>(Checksum(reference, sequential)));
+	}
+
+	if (options.optimize)
+	{
+		MeshOptimizeStats stats;
+		auto start = std::chrono::steady_clock::now();
+		OptimizeMesh(vertices, indices, &stats);
+		const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		printf("\nOptimizeMesh %.1f ms, %u overdraw clusters, checksum %016llx\n", seconds * 1000.0, stats.clusters,
+			static_cast<unsigned long long>(Checksum(vertices, indices)));
+		printf("%-14s %8s\n", "step", "ACMR");
+		printf("%-14s %8.3f\n", "input", stats.inputAcmr);
+		printf("%-14s %8.3f\n", "vertex cache", stats.vertexCacheAcmr);
+		printf("%-14s %8.3f\n", "overdraw", stats.overdrawAcmr);
+		printf("%-14s %8.3f\n", "vertex fetch", stats.vertexFetchAcmr);
+	}
+
+	if (options.cache)
+	{
+		const std::string cachePath = GetMeshCachePath(path);
+		MeshSourceStamp stamp;
+		auto start = std::chrono::steady_clock::now();
+		if (!ReadMeshSourceStamp(path, stamp, pool) || !WriteMeshCache(cachePath.c_str(), stamp, vertices, indices))
+		{
+			fprintf(stderr, "can't write %s\n", cachePath.c_str());
+			return 1;
+		}
+		const double writeSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		double bestStamp = 1e30;
+		double bestOpen = 1e30;
+		uint64_t cacheChecksum = 0;
+		for (uint32_t run = 0; run < options.runs; run++)
+		{
+			start = std::chrono::steady_clock::now();
+			MeshSourceStamp current;
+			ReadMeshSourceStamp(path, current, pool);
+			auto stamped = std::chrono::steady_clock::now();
+			MeshCache cache;
+			if (!cache.Open(cachePath.c_str(), current))
+			{
+				fprintf(stderr, "can't open %s\n", cachePath.c_str());
+				return 1;
+			}
+			auto opened = std::chrono::steady_clock::now();
+			bestStamp = std::min(bestStamp, std::chrono::duration<double>(stamped - start).count());
+			bestOpen = std::min(bestOpen, std::chrono::duration<double>(opened - stamped).count());
+
+			//not timed, the device would read the bytes during buffer creation
+			const MeshCacheHeader& header = cache.GetHeader();
+			std::vector<Vertex> cachedVertices(cache.GetVertices(), cache.GetVertices() + header.vertexCount);
+			std::vector<uint32_t> cachedIndices(header.indexCount);
+			for (uint32_t i = 0; i < header.indexCount; i++)
+			{
+				cachedIndices[i] = header.indexSize == sizeof(uint16_t) ?
+					static_cast<const uint16_t*>(cache.GetIndices())[i] : static_cast<const uint32_t*>(cache.GetIndices())[i];
+			}
+			cacheChecksum = Checksum(cachedVertices, cachedIndices);
+		}
+		printf("\n%s, %.1f MB\n", cachePath.c_str(), FileSize(cachePath.c_str()) / (1024.0 * 1024.0));
+		printf("%-14s %10.1f ms\n", "stamp + write", writeSeconds * 1000.0);
+		printf("%-14s %10.1f ms\n", "stamp", bestStamp * 1000.0);
+		printf("%-14s %10.3f ms\n", "open", bestOpen * 1000.0);
+		printf("%-14s %016llx (%s)\n", "checksum", static_cast<unsigned long long>(cacheChecksum),
+			cacheChecksum == Checksum(vertices, indices) ? "matches" : "DIFFERS");
+	}
+
+	delete pool;
+	return 0;
+}
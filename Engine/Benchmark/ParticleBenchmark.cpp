@@ -0,0 +1,234 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+#include "EmitterWorld.h"
+#include "SimdMath.h"
+
+// --------------------------------------------------------
+// Headless particle emitter benchmark
+//
+// Fills the emitters to their steady state (rate times mean
+// lifetime = capacity), then times a fixed number of 60 Hz frames
+// of Update and, optionally, billboard expansion into an aligned
+// buffer standing in for the mapped vertex buffer, and of the depth
+// sorted index buffer. The checksum of
+// the final positions is the same for any thread count and for the
+// scalar kernels.
+// --------------------------------------------------------
+
+namespace
+{
+	struct Options
+	{
+		uint32_t particles;
+		uint32_t emitters;
+		uint32_t frames;
+		uint32_t threads;
+		bool simd;
+		bool billboards;
+		bool sort;
+	};
+
+	const float FRAME_DT = 1.0f / 60.0f;
+	const float MIN_LIFETIME = 1.0f;
+	const float MAX_LIFETIME = 2.0f;
+
+	void PrintUsage()
+	{
+		printf(
+			"usage: particle_benchmark [options]\n"
+			"  --particles N   live particles over all emitters (default 1000000)\n"
+			"  --emitters N    emitters sharing them (default 1)\n"
+			"  --frames N      frames to time after the warm up (default 600)\n"
+			"  --threads N     worker threads including the caller, 0 = all cores (default 0)\n"
+			"  --scalar        use the scalar kernels instead of SIMD\n"
+			"  --billboards    also expand the billboards every frame and time that separately\n"
+			"  --sort          also depth sort the billboards every frame and time that separately\n");
+	}
+
+	bool ParseOptions(int argc, char** argv, Options& options)
+	{
+		options.particles = 1000000;
+		options.emitters = 1;
+		options.frames = 600;
+		options.threads = 0;
+		options.simd = true;
+		options.billboards = false;
+		options.sort = false;
+
+		for (int i = 1; i < argc; i++)
+		{
+			const char* arg = argv[i];
+			const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+			if (!strcmp(arg, "--scalar"))
+				options.simd = false;
+			else if (!strcmp(arg, "--billboards"))
+				options.billboards = true;
+		else if (!strcmp(arg, "--sort"))
+			options.sort = true;
+			else if (!strcmp(arg, "--help") || !strcmp(arg, "-h"))
+				return false;
+			else if (!value)
+			{
+				fprintf(stderr, "missing value for %s\n", arg);
+				return false;
+			}
+			else
+			{
+				i++;
+				if (!strcmp(arg, "--particles"))
+					options.particles = static_cast<uint32_t>(atoi(value));
+				else if (!strcmp(arg, "--emitters"))
+					options.emitters = static_cast<uint32_t>(atoi(value));
+				else if (!strcmp(arg, "--frames"))
+					options.frames = static_cast<uint32_t>(atoi(value));
+				else if (!strcmp(arg, "--threads"))
+					options.threads = static_cast<uint32_t>(atoi(value));
+				else
+				{
+					fprintf(stderr, "unknown option %s\n", arg);
+					return false;
+				}
+			}
+		}
+		return options.frames > 0 && options.emitters > 0 && options.particles >= options.emitters;
+	}
+
+	//FNV-1a over the bit patterns of every live position, emitter by emitter
+	uint64_t Checksum(const EmitterWorld& world, const std::vector<EmitterHandle>& handles)
+	{
+		uint64_t hash = 14695981039346656037ull;
+		for (size_t e = 0; e < handles.size(); e++)
+		{
+			const ParticleEmitter* emitter = world.GetEmitter(handles[e]);
+			const float* streams[3] = { emitter->GetPositionX(), emitter->GetPositionY(), emitter->GetPositionZ() };
+			for (uint32_t i = 0; i < emitter->GetCount(); i++)
+			{
+				for (int k = 0; k < 3; k++)
+				{
+					uint32_t bits;
+					memcpy(&bits, streams[k] + i, sizeof(bits));
+					for (int b = 0; b < 4; b++)
+					{
+						hash ^= (bits >> (8 * b)) & 0xff;
+						hash *= 1099511628211ull;
+					}
+				}
+			}
+		}
+		return hash;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	if (!ParseOptions(argc, argv, options))
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	ThreadPool* pool = nullptr;
+	if (options.threads != 1)
+		pool = new ThreadPool(options.threads > 0 ? options.threads - 1 : 0);
+	const uint32_t threadCount = pool ? pool->GetThreadCount() : 1;
+
+	EmitterWorld world(pool);
+	std::vector<EmitterHandle> handles;
+	const uint32_t capacity = options.particles / options.emitters;
+	for (uint32_t e = 0; e < options.emitters; e++)
+	{
+		//fountains side by side, emitting just fast enough to stay full
+		EmitterSettings settings;
+		settings.position = XMFLOAT3(static_cast<float>(e), 0.0f, 0.0f);
+		settings.velocity = XMFLOAT3(0.0f, 4.0f, 0.0f);
+		settings.spread = 1.0f;
+		settings.minLifetime = MIN_LIFETIME;
+		settings.maxLifetime = MAX_LIFETIME;
+		settings.rate = capacity / (0.5f * (MIN_LIFETIME + MAX_LIFETIME));
+		settings.drag = 0.1f;
+		EmitterHandle handle = world.CreateEmitter(capacity, settings);
+		world.GetEmitter(handle)->SetSimdEnabled(options.simd);
+		handles.push_back(handle);
+	}
+
+	//one full lifetime, after which births and deaths balance
+	const uint32_t warmUp = static_cast<uint32_t>(MAX_LIFETIME / FRAME_DT) + 1;
+	for (uint32_t f = 0; f < warmUp; f++)
+	{
+		world.Update(FRAME_DT);
+	}
+
+	BillboardVertex* vertices = nullptr;
+	if (options.billboards)
+		vertices = static_cast<BillboardVertex*>(Simd::AlignedAlloc(sizeof(BillboardVertex) * 4 * static_cast<size_t>(world.GetCapacity())));
+	const XMFLOAT3 right(1.0f, 0.0f, 0.0f);
+	const XMFLOAT3 up(0.0f, 1.0f, 0.0f);
+	uint32_t* indices = nullptr;
+	if (options.sort)
+		indices = static_cast<uint32_t*>(Simd::AlignedAlloc(sizeof(uint32_t) * 6 * static_cast<size_t>(world.GetCapacity())));
+	//transposed view of a camera at (0, 2, -5) looking down +z, so depth varies with each particle
+	XMFLOAT4X4 view;
+	for (int r = 0; r < 4; r++)
+	{
+		for (int c = 0; c < 4; c++)
+		{
+			view.m[r][c] = r == c ? 1.0f : 0.0f;
+		}
+	}
+	view._24 = -2.0f;
+	view._34 = 5.0f;
+	uint32_t sorted = 0;
+
+	double updateSeconds = 0.0;
+	double billboardSeconds = 0.0;
+	double sortSeconds = 0.0;
+	uint64_t liveSum = 0;
+	for (uint32_t f = 0; f < options.frames; f++)
+	{
+		auto start = std::chrono::steady_clock::now();
+		world.Update(FRAME_DT);
+		auto updated = std::chrono::steady_clock::now();
+		updateSeconds += std::chrono::duration<double>(updated - start).count();
+		liveSum += world.GetParticleCount();
+		if (vertices)
+		{
+			world.WriteBillboards(vertices, world.GetCapacity(), right, up);
+			billboardSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - updated).count();
+		}
+		if (indices)
+		{
+			auto sortStart = std::chrono::steady_clock::now();
+			sorted = world.WriteSortedIndices(indices, world.GetCapacity(), view);
+			sortSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - sortStart).count();
+		}
+	}
+	if (vertices)
+		Simd::AlignedFree(vertices);
+	//FNV-1a over the last frame's draw order, the same for every kernel and thread count
+	uint64_t orderHash = 14695981039346656037ull;
+	for (size_t j = 0; indices && j < 6 * static_cast<size_t>(sorted); j++)
+	{
+		orderHash ^= indices[j];
+		orderHash *= 1099511628211ull;
+	}
+	if (indices)
+		Simd::AlignedFree(indices);
+
+	printf("%u emitter(s), %s, %u thread(s)\n", options.emitters, options.simd ? "simd" : "scalar", threadCount);
+	printf("%12s %8s %12s %14s  %s\n", "particles", "frames", "update ms", "particles/s", "checksum");
+	const double live = static_cast<double>(liveSum) / options.frames;
+	printf("%12.0f %8u %12.3f %14.4g  %016llx", live, options.frames, updateSeconds * 1000.0 / options.frames,
+		live * options.frames / updateSeconds, static_cast<unsigned long long>(Checksum(world, handles)));
+	if (options.billboards)
+		printf("  billboards %.3f ms/frame", billboardSeconds * 1000.0 / options.frames);
+	if (options.sort)
+		printf("  sort %.3f ms/frame, order %016llx", sortSeconds * 1000.0 / options.frames, static_cast<unsigned long long>(orderHash));
+	printf("\n");
+
+	delete pool;
+	return 0;
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include <stdint.h>
+
+// --------------------------------------------------------
+// Portable stand-in for DirectXMath
+//
+// The cloth simulation only uses the DirectXMath storage types,
+// so a headless build on a machine without the Windows SDK gets
+// just those. Layouts match the real ones. Point CMake at a real
+// DirectXMath (DIRECTXMATH_INCLUDE_DIR) to build against it instead.
+// --------------------------------------------------------
+namespace DirectX
+{
+	struct XMFLOAT2
+	{
+		float x;
+		float y;
+
+		XMFLOAT2() {}
+		XMFLOAT2(float _x, float _y) : x(_x), y(_y) {}
+	};
+
+	struct XMFLOAT3
+	{
+		float x;
+		float y;
+		float z;
+
+		XMFLOAT3() {}
+		XMFLOAT3(float _x, float _y, float _z) : x(_x), y(_y), z(_z) {}
+	};
+
+	struct XMFLOAT4
+	{
+		float x;
+		float y;
+		float z;
+		float w;
+
+		XMFLOAT4() {}
+		XMFLOAT4(float _x, float _y, float _z, float _w) : x(_x), y(_y), z(_z), w(_w) {}
+	};
+
+	struct XMFLOAT4X4
+	{
+		union
+		{
+			struct
+			{
+				float _11, _12, _13, _14;
+				float _21, _22, _23, _24;
+				float _31, _32, _33, _34;
+				float _41, _42, _43, _44;
+			};
+			float m[4][4];
+		};
+
+		XMFLOAT4X4() {}
+	};
+}
@@ -0,0 +1,939 @@
+#pragma once
+#include <DirectXMath.h>
+#include <algorithm>
+#include "SimdMath.h"
+
+using namespace DirectX;
+
+// --------------------------------------------------------
+// SoA view of a cloth's particle state
+//
+// Every stream is 32 byte aligned and padded to a whole number
+// of AVX vectors. The kernels still load unaligned, since a
+// sleeping cloth runs them on runs of awake tiles that start anywhere.
+// --------------------------------------------------------
+struct ParticleStreams
+{
+	float* posX;
+	float* posY;
+	float* posZ;
+	float* oldPosX;
+	float* oldPosY;
+	float* oldPosZ;
+	float* accelerationX;
+	float* accelerationY;
+	float* accelerationZ;
+};
+
+//stretch |length - rest| seen by a stick sweep, summed up per chunk
+struct StickError
+{
+	StickError() : maxError(0.0f), sumSquares(0.0f), count(0) {}
+	float maxError;
+	float sumSquares;
+	uint32_t count;
+};
+
+// --------------------------------------------------------
+// Cloth kernels shared by ParticleSystem and FixedParticleSystem
+//
+// They live in a header so the fixed-size specialization can
+// inline them with compile-time bounds. Each kernel works on a
+// [begin, end) range so it can also be handed to the thread pool.
+// The SIMD and scalar paths perform the same operations in the
+// same order and give bit-identical results.
+// --------------------------------------------------------
+namespace ClothKernels
+{
+	inline void AccumulateForces(const ParticleStreams& s, uint32_t begin, uint32_t end, const XMFLOAT3& gravity, bool useSimd)
+	{
+		uint32_t i = begin;
+		if (useSimd)
+		{
+			const Simd::Float gx = Simd::Set1(gravity.x);
+			const Simd::Float gy = Simd::Set1(gravity.y);
+			const Simd::Float gz = Simd::Set1(gravity.z);
+			const uint32_t simdEnd = begin + Simd::AlignDown(end - begin);
+			for (; i < simdEnd; i += Simd::WIDTH)
+			{
+				Simd::StoreU(s.accelerationX + i, Simd::Add(Simd::LoadU(s.accelerationX + i), gx));
+				Simd::StoreU(s.accelerationY + i, Simd::Add(Simd::LoadU(s.accelerationY + i), gy));
+				Simd::StoreU(s.accelerationZ + i, Simd::Add(Simd::LoadU(s.accelerationZ + i), gz));
+			}
+		}
+		for (; i < end; i++)
+		{
+			s.accelerationX[i] += gravity.x;
+			s.accelerationY[i] += gravity.y;
+			s.accelerationZ[i] += gravity.z;
+		}
+	}
+
+	//x' = x + (x - x*) * (1 - damping) + a * dt^2, then x* = x and a = 0
+	inline void Verlet(const ParticleStreams& s, uint32_t begin, uint32_t end, float dt2, float damping, bool useSimd)
+	{
+		const float keep = 1.0f - damping;
+		uint32_t i = begin;
+		if (useSimd)
+		{
+			const Simd::Float vDt2 = Simd::Set1(dt2);
+			const Simd::Float vKeep = Simd::Set1(keep);
+			const Simd::Float vZero = Simd::Zero();
+			const uint32_t simdEnd = begin + Simd::AlignDown(end - begin);
+			for (; i < simdEnd; i += Simd::WIDTH)
+			{
+				Simd::Float px = Simd::LoadU(s.posX + i);
+				Simd::Float py = Simd::LoadU(s.posY + i);
+				Simd::Float pz = Simd::LoadU(s.posZ + i);
+
+				Simd::Float nx = Simd::Add(px, Simd::Add(Simd::Mul(Simd::Sub(px, Simd::LoadU(s.oldPosX + i)), vKeep), Simd::Mul(Simd::LoadU(s.accelerationX + i), vDt2)));
+				Simd::Float ny = Simd::Add(py, Simd::Add(Simd::Mul(Simd::Sub(py, Simd::LoadU(s.oldPosY + i)), vKeep), Simd::Mul(Simd::LoadU(s.accelerationY + i), vDt2)));
+				Simd::Float nz = Simd::Add(pz, Simd::Add(Simd::Mul(Simd::Sub(pz, Simd::LoadU(s.oldPosZ + i)), vKeep), Simd::Mul(Simd::LoadU(s.accelerationZ + i), vDt2)));
+
+				Simd::StoreU(s.oldPosX + i, px);
+				Simd::StoreU(s.oldPosY + i, py);
+				Simd::StoreU(s.oldPosZ + i, pz);
+				Simd::StoreU(s.posX + i, nx);
+				Simd::StoreU(s.posY + i, ny);
+				Simd::StoreU(s.posZ + i, nz);
+				Simd::StoreU(s.accelerationX + i, vZero);
+				Simd::StoreU(s.accelerationY + i, vZero);
+				Simd::StoreU(s.accelerationZ + i, vZero);
+			}
+		}
+		//remainder (or everything when the scalar path is selected)
+		for (; i < end; i++)
+		{
+			float px = s.posX[i];
+			float py = s.posY[i];
+			float pz = s.posZ[i];
+			//Integrate old pos and new pos with acceleration
+			s.posX[i] = px + ((px - s.oldPosX[i]) * keep + s.accelerationX[i] * dt2);
+			s.posY[i] = py + ((py - s.oldPosY[i]) * keep + s.accelerationY[i] * dt2);
+			s.posZ[i] = pz + ((pz - s.oldPosZ[i]) * keep + s.accelerationZ[i] * dt2);
+
+			s.oldPosX[i] = px;
+			s.oldPosY[i] = py;
+			s.oldPosZ[i] = pz;
+			s.accelerationX[i] = 0.0f;
+			s.accelerationY[i] = 0.0f;
+			s.accelerationZ[i] = 0.0f;
+		}
+	}
+
+	//largest squared distance of particles [begin, end) from x* and from the anchor,
+	//folded into motion and drift
+	inline void MaxMotion(const ParticleStreams& s, const float* anchorX, const float* anchorY, const float* anchorZ,
+		uint32_t begin, uint32_t end, bool useSimd, float& motion, float& drift)
+	{
+		uint32_t i = begin;
+		if (useSimd)
+		{
+			Simd::Float vMotion = Simd::Zero();
+			Simd::Float vDrift = Simd::Zero();
+			const uint32_t simdEnd = begin + Simd::AlignDown(end - begin);
+			for (; i < simdEnd; i += Simd::WIDTH)
+			{
+				const Simd::Float px = Simd::LoadU(s.posX + i);
+				const Simd::Float py = Simd::LoadU(s.posY + i);
+				const Simd::Float pz = Simd::LoadU(s.posZ + i);
+				const Simd::Float dx = Simd::Sub(px, Simd::LoadU(s.oldPosX + i));
+				const Simd::Float dy = Simd::Sub(py, Simd::LoadU(s.oldPosY + i));
+				const Simd::Float dz = Simd::Sub(pz, Simd::LoadU(s.oldPosZ + i));
+				vMotion = Simd::Max(vMotion, Simd::Add(Simd::Add(Simd::Mul(dx, dx), Simd::Mul(dy, dy)), Simd::Mul(dz, dz)));
+				const Simd::Float ax = Simd::Sub(px, Simd::LoadU(anchorX + i));
+				const Simd::Float ay = Simd::Sub(py, Simd::LoadU(anchorY + i));
+				const Simd::Float az = Simd::Sub(pz, Simd::LoadU(anchorZ + i));
+				vDrift = Simd::Max(vDrift, Simd::Add(Simd::Add(Simd::Mul(ax, ax), Simd::Mul(ay, ay)), Simd::Mul(az, az)));
+			}
+			motion = std::max(motion, Simd::ReduceMax(vMotion));
+			drift = std::max(drift, Simd::ReduceMax(vDrift));
+		}
+		for (; i < end; i++)
+		{
+			const float dx = s.posX[i] - s.oldPosX[i];
+			const float dy = s.posY[i] - s.oldPosY[i];
+			const float dz = s.posZ[i] - s.oldPosZ[i];
+			motion = std::max(motion, dx * dx + dy * dy + dz * dz);
+			const float ax = s.posX[i] - anchorX[i];
+			const float ay = s.posY[i] - anchorY[i];
+			const float az = s.posZ[i] - anchorZ[i];
+			drift = std::max(drift, ax * ax + ay * ay + az * az);
+		}
+	}
+
+	//relax a single stick between particles a and b, returns its stretch before the correction
+	inline float SolveStick(const ParticleStreams& s, uint32_t a, uint32_t b, float restLength)
+	{
+		XMFLOAT3 delta;
+		delta.x = s.posX[b] - s.posX[a];
+		delta.y = s.posY[b] - s.posY[a];
+		delta.z = s.posZ[b] - s.posZ[a];
+
+		float deltalength = sqrtf(delta.x * delta.x + delta.y * delta.y + delta.z * delta.z);
+		float diff = (deltalength - restLength) / deltalength;
+		//float diff = delta * (1 - m_restLength / deltalength);
+
+		s.posX[a] += delta.x * 0.5f * diff;
+		s.posY[a] += delta.y * 0.5f * diff;
+		s.posZ[a] += delta.z * 0.5f * diff;
+
+		s.posX[b] -= delta.x * 0.5f * diff;
+		s.posY[b] -= delta.y * 0.5f * diff;
+		s.posZ[b] -= delta.z * 0.5f * diff;
+		return deltalength - restLength;
+	}
+
+	//stick whose b end is held in place (asleep), a takes the whole correction
+	inline float SolveStickFixedB(const ParticleStreams& s, uint32_t a, uint32_t b, float restLength)
+	{
+		XMFLOAT3 delta;
+		delta.x = s.posX[b] - s.posX[a];
+		delta.y = s.posY[b] - s.posY[a];
+		delta.z = s.posZ[b] - s.posZ[a];
+
+		float deltalength = sqrtf(delta.x * delta.x + delta.y * delta.y + delta.z * delta.z);
+		float diff = (deltalength - restLength) / deltalength;
+
+		s.posX[a] += delta.x * diff;
+		s.posY[a] += delta.y * diff;
+		s.posZ[a] += delta.z * diff;
+		return deltalength - restLength;
+	}
+
+	inline void AddStickError(StickError* error, float stretch)
+	{
+		if (!error)
+			return;
+		error->maxError = std::max(error->maxError, fabsf(stretch));
+		error->sumSquares += stretch * stretch;
+		error->count++;
+	}
+
+	//folds the per-lane |stretch| maximum and stretch^2 sum into error
+	inline void AddStickErrorLanes(StickError* error, Simd::Float maxLanes, Simd::Float sumLanes, uint32_t count)
+	{
+		if (!error || count == 0)
+			return;
+		error->maxError = std::max(error->maxError, Simd::ReduceMax(maxLanes));
+		error->sumSquares += Simd::ReduceAdd(sumLanes);
+		error->count += count;
+	}
+
+	//the move a gets from its stick to b (b gets the opposite), returns the stretch
+	inline Simd::Float StickCorrectionLanes(
+		Simd::Float ax, Simd::Float ay, Simd::Float az,
+		Simd::Float bx, Simd::Float by, Simd::Float bz,
+		Simd::Float restLength, Simd::Float& cx, Simd::Float& cy, Simd::Float& cz)
+	{
+		const Simd::Float half = Simd::Set1(0.5f);
+		Simd::Float dx = Simd::Sub(bx, ax);
+		Simd::Float dy = Simd::Sub(by, ay);
+		Simd::Float dz = Simd::Sub(bz, az);
+		Simd::Float deltaLength = Simd::Sqrt(Simd::Add(Simd::Add(Simd::Mul(dx, dx), Simd::Mul(dy, dy)), Simd::Mul(dz, dz)));
+		Simd::Float diff = Simd::Div(Simd::Sub(deltaLength, restLength), deltaLength);
+
+		cx = Simd::Mul(Simd::Mul(dx, half), diff);
+		cy = Simd::Mul(Simd::Mul(dy, half), diff);
+		cz = Simd::Mul(Simd::Mul(dz, half), diff);
+		return Simd::Sub(deltaLength, restLength);
+	}
+
+	//vector body shared by the gathered and contiguous stick kernels, returns the stretch
+	inline Simd::Float SolveStickLanes(
+		Simd::Float& ax, Simd::Float& ay, Simd::Float& az,
+		Simd::Float& bx, Simd::Float& by, Simd::Float& bz,
+		Simd::Float restLength)
+	{
+		Simd::Float cx, cy, cz;
+		const Simd::Float stretch = StickCorrectionLanes(ax, ay, az, bx, by, bz, restLength, cx, cy, cz);
+		ax = Simd::Add(ax, cx);
+		ay = Simd::Add(ay, cy);
+		az = Simd::Add(az, cz);
+		bx = Simd::Sub(bx, cx);
+		by = Simd::Sub(by, cy);
+		bz = Simd::Sub(bz, cz);
+		return stretch;
+	}
+
+	// --------------------------------------------------------
+	// Relaxes sticks [begin, end) of a single colour batch. Sticks in
+	// a batch never share a particle, so lanes can gather/scatter freely.
+	// When error is given, the stretch each stick had before its
+	// correction is added to it.
+	// --------------------------------------------------------
+	inline void SolveSticks(const ParticleStreams& s, const uint32_t* stickA, const uint32_t* stickB, uint32_t begin, uint32_t end, float restLength, bool useSimd,
+		StickError* error = nullptr)
+	{
+		uint32_t i = begin;
+		if (useSimd)
+		{
+			const Simd::Float rest = Simd::Set1(restLength);
+			const Simd::Float vZero = Simd::Zero();
+			Simd::Float maxLanes = vZero;
+			Simd::Float sumLanes = vZero;
+			const uint32_t simdEnd = begin + Simd::AlignDown(end - begin);
+			for (; i < simdEnd; i += Simd::WIDTH)
+			{
+				Simd::Float ax = Simd::Gather(s.posX, stickA + i);
+				Simd::Float ay = Simd::Gather(s.posY, stickA + i);
+				Simd::Float az = Simd::Gather(s.posZ, stickA + i);
+				Simd::Float bx = Simd::Gather(s.posX, stickB + i);
+				Simd::Float by = Simd::Gather(s.posY, stickB + i);
+				Simd::Float bz = Simd::Gather(s.posZ, stickB + i);
+				Simd::Float stretch = SolveStickLanes(ax, ay, az, bx, by, bz, rest);
+				Simd::Scatter(s.posX, stickA + i, ax);
+				Simd::Scatter(s.posY, stickA + i, ay);
+				Simd::Scatter(s.posZ, stickA + i, az);
+				Simd::Scatter(s.posX, stickB + i, bx);
+				Simd::Scatter(s.posY, stickB + i, by);
+				Simd::Scatter(s.posZ, stickB + i, bz);
+				if (error)
+				{
+					maxLanes = Simd::Max(maxLanes, Simd::Max(stretch, Simd::Sub(vZero, stretch)));
+					sumLanes = Simd::Add(sumLanes, Simd::Mul(stretch, stretch));
+				}
+			}
+			AddStickErrorLanes(error, maxLanes, sumLanes, i - begin);
+		}
+		for (; i < end; i++)
+		{
+			AddStickError(error, SolveStick(s, stickA[i], stickB[i], restLength));
+		}
+	}
+
+	//vertical sticks between two whole rows: both ends are contiguous, no gather needed
+	inline void SolveRowSticks(const ParticleStreams& s, uint32_t rowA, uint32_t rowB, uint32_t count, float restLength, bool useSimd,
+		StickError* error = nullptr)
+	{
+		uint32_t i = 0;
+		if (useSimd)
+		{
+			const Simd::Float rest = Simd::Set1(restLength);
+			const Simd::Float vZero = Simd::Zero();
+			Simd::Float maxLanes = vZero;
+			Simd::Float sumLanes = vZero;
+			const uint32_t simdEnd = Simd::AlignDown(count);
+			for (; i < simdEnd; i += Simd::WIDTH)
+			{
+				Simd::Float ax = Simd::LoadU(s.posX + rowA + i);
+				Simd::Float ay = Simd::LoadU(s.posY + rowA + i);
+				Simd::Float az = Simd::LoadU(s.posZ + rowA + i);
+				Simd::Float bx = Simd::LoadU(s.posX + rowB + i);
+				Simd::Float by = Simd::LoadU(s.posY + rowB + i);
+				Simd::Float bz = Simd::LoadU(s.posZ + rowB + i);
+				Simd::Float stretch = SolveStickLanes(ax, ay, az, bx, by, bz, rest);
+				Simd::StoreU(s.posX + rowA + i, ax);
+				Simd::StoreU(s.posY + rowA + i, ay);
+				Simd::StoreU(s.posZ + rowA + i, az);
+				Simd::StoreU(s.posX + rowB + i, bx);
+				Simd::StoreU(s.posY + rowB + i, by);
+				Simd::StoreU(s.posZ + rowB + i, bz);
+				if (error)
+				{
+					maxLanes = Simd::Max(maxLanes, Simd::Max(stretch, Simd::Sub(vZero, stretch)));
+					sumLanes = Simd::Add(sumLanes, Simd::Mul(stretch, stretch));
+				}
+			}
+			AddStickErrorLanes(error, maxLanes, sumLanes, i);
+		}
+		for (; i < count; i++)
+		{
+			AddStickError(error, SolveStick(s, rowA + i, rowB + i, restLength));
+		}
+	}
+
+	// --------------------------------------------------------
+	// Horizontal sticks (x, x + 1) of one row, for every x of the given
+	// parity, with plain vector loads: each lane solves the stick that
+	// starts at its own particle, and the lanes of the other parity are
+	// masked to no correction. The corrections go to scratch (3 *
+	// (count + 1) floats) first, then every particle adds the one of
+	// the stick it starts and subtracts the one of the stick it ends,
+	// at most one of which isn't zero, so the result matches
+	// SolveStick bit for bit. Without SIMD the sticks are simply
+	// solved one by one.
+	// --------------------------------------------------------
+	inline void SolveRowPairSticks(const ParticleStreams& s, uint32_t row, uint32_t count, uint32_t parity, float restLength, bool useSimd,
+		float* scratch, StickError* error = nullptr)
+	{
+		//blocks start on even x (WIDTH is even), so lane parity is fixed
+		if (!useSimd || Simd::WIDTH % 2 != 0)
+		{
+			//without vectors the two passes only cost, solve the sticks in place
+			for (uint32_t x = parity; x + 1 < count; x += 2)
+			{
+				AddStickError(error, SolveStick(s, row + x, row + x + 1, restLength));
+			}
+			return;
+		}
+
+		//correction of stick x at x + 1, with the ends padded by zero
+		float* cx = scratch;
+		float* cy = scratch + (count + 1);
+		float* cz = scratch + 2 * (count + 1);
+		float* px = s.posX + row;
+		float* py = s.posY + row;
+		float* pz = s.posZ + row;
+		cx[0] = cy[0] = cz[0] = 0.0f;
+		cx[count] = cy[count] = cz[count] = 0.0f;
+
+		alignas(32) static const float LANE_PARITY[8] = { 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 1.0f };
+		const Simd::Float lanes = Simd::Load(LANE_PARITY);
+		const Simd::Float halfway = Simd::Set1(0.5f);
+		const Simd::Mask active = parity ? Simd::CmpLt(halfway, lanes) : Simd::CmpLt(lanes, halfway);
+		const Simd::Float rest = Simd::Set1(restLength);
+		const Simd::Float vZero = Simd::Zero();
+		Simd::Float maxLanes = vZero;
+		Simd::Float sumLanes = vZero;
+		const uint32_t sticks = count - 1;
+		const uint32_t stickEnd = Simd::AlignDown(sticks);
+		uint32_t x = 0;
+		for (; x < stickEnd; x += Simd::WIDTH)
+		{
+			Simd::Float lx, ly, lz;
+			Simd::Float stretch = StickCorrectionLanes(
+				Simd::LoadU(px + x), Simd::LoadU(py + x), Simd::LoadU(pz + x),
+				Simd::LoadU(px + x + 1), Simd::LoadU(py + x + 1), Simd::LoadU(pz + x + 1),
+				rest, lx, ly, lz);
+			Simd::StoreU(cx + x + 1, Simd::Select(active, lx, vZero));
+			Simd::StoreU(cy + x + 1, Simd::Select(active, ly, vZero));
+			Simd::StoreU(cz + x + 1, Simd::Select(active, lz, vZero));
+			if (error)
+			{
+				stretch = Simd::Select(active, stretch, vZero);
+				maxLanes = Simd::Max(maxLanes, Simd::Max(stretch, Simd::Sub(vZero, stretch)));
+				sumLanes = Simd::Add(sumLanes, Simd::Mul(stretch, stretch));
+			}
+		}
+		//half of every block was active
+		AddStickErrorLanes(error, maxLanes, sumLanes, x / 2);
+		for (; x < sticks; x++)
+		{
+			if ((x & 1) != parity)
+			{
+				cx[x + 1] = cy[x + 1] = cz[x + 1] = 0.0f;
+				continue;
+			}
+			const float dx = px[x + 1] - px[x];
+			const float dy = py[x + 1] - py[x];
+			const float dz = pz[x + 1] - pz[x];
+			const float deltaLength = sqrtf(dx * dx + dy * dy + dz * dz);
+			const float diff = (deltaLength - restLength) / deltaLength;
+			cx[x + 1] = dx * 0.5f * diff;
+			cy[x + 1] = dy * 0.5f * diff;
+			cz[x + 1] = dz * 0.5f * diff;
+			AddStickError(error, deltaLength - restLength);
+		}
+
+		const uint32_t simdEnd = Simd::AlignDown(count);
+		x = 0;
+		for (; x < simdEnd; x += Simd::WIDTH)
+		{
+			Simd::StoreU(px + x, Simd::Sub(Simd::Add(Simd::LoadU(px + x), Simd::LoadU(cx + x + 1)), Simd::LoadU(cx + x)));
+			Simd::StoreU(py + x, Simd::Sub(Simd::Add(Simd::LoadU(py + x), Simd::LoadU(cy + x + 1)), Simd::LoadU(cy + x)));
+			Simd::StoreU(pz + x, Simd::Sub(Simd::Add(Simd::LoadU(pz + x), Simd::LoadU(cz + x + 1)), Simd::LoadU(cz + x)));
+		}
+		for (; x < count; x++)
+		{
+			px[x] = px[x] + cx[x + 1] - cx[x];
+			py[x] = py[x] + cy[x + 1] - cy[x];
+			pz[x] = pz[x] + cz[x + 1] - cz[x];
+		}
+	}
+
+	// --------------------------------------------------------
+	// XPBD relaxation of sticks [begin, end) of a single colour batch
+	//
+	// C = |b - a| - rest, alpha~ = compliance / h^2
+	// dLambda = (-C - alpha~ * lambda) / (wA + wB + alpha~)
+	// a -= wA * n * dLambda, b += wB * n * dLambda
+	// --------------------------------------------------------
+	inline void SolveStickXPBD(const ParticleStreams& s, const float* invMass, uint32_t a, uint32_t b, float restLength, float compliance, float& lambda, float invH2)
+	{
+		float dx = s.posX[b] - s.posX[a];
+		float dy = s.posY[b] - s.posY[a];
+		float dz = s.posZ[b] - s.posZ[a];
+		float deltaLength = sqrtf(dx * dx + dy * dy + dz * dz);
+		float alpha = compliance * invH2;
+		float wA = invMass[a];
+		float wB = invMass[b];
+		//two pinned ends would divide by zero, the w = 0 factors cancel the result anyway
+		float denom = wA + wB + alpha;
+		if (denom < 1e-12f) denom = 1e-12f;
+		float dLambda = ((0.0f - (deltaLength - restLength)) - alpha * lambda) / denom;
+		lambda += dLambda;
+
+		float scale = dLambda / deltaLength;
+		s.posX[a] -= wA * (dx * scale);
+		s.posY[a] -= wA * (dy * scale);
+		s.posZ[a] -= wA * (dz * scale);
+		s.posX[b] += wB * (dx * scale);
+		s.posY[b] += wB * (dy * scale);
+		s.posZ[b] += wB * (dz * scale);
+	}
+
+	inline void SolveSticksXPBD(const ParticleStreams& s, const float* invMass, const uint32_t* stickA, const uint32_t* stickB,
+		const float* compliance, float* lambda, uint32_t begin, uint32_t end, float restLength, float invH2, bool useSimd)
+	{
+		uint32_t i = begin;
+		if (useSimd)
+		{
+			const Simd::Float rest = Simd::Set1(restLength);
+			const Simd::Float vInvH2 = Simd::Set1(invH2);
+			const Simd::Float minDenom = Simd::Set1(1e-12f);
+			const Simd::Float vZero = Simd::Zero();
+			const uint32_t simdEnd = begin + Simd::AlignDown(end - begin);
+			for (; i < simdEnd; i += Simd::WIDTH)
+			{
+				Simd::Float ax = Simd::Gather(s.posX, stickA + i);
+				Simd::Float ay = Simd::Gather(s.posY, stickA + i);
+				Simd::Float az = Simd::Gather(s.posZ, stickA + i);
+				Simd::Float bx = Simd::Gather(s.posX, stickB + i);
+				Simd::Float by = Simd::Gather(s.posY, stickB + i);
+				Simd::Float bz = Simd::Gather(s.posZ, stickB + i);
+				Simd::Float wA = Simd::Gather(invMass, stickA + i);
+				Simd::Float wB = Simd::Gather(invMass, stickB + i);
+				Simd::Float vLambda = Simd::LoadU(lambda + i);
+
+				Simd::Float dx = Simd::Sub(bx, ax);
+				Simd::Float dy = Simd::Sub(by, ay);
+				Simd::Float dz = Simd::Sub(bz, az);
+				Simd::Float deltaLength = Simd::Sqrt(Simd::Add(Simd::Add(Simd::Mul(dx, dx), Simd::Mul(dy, dy)), Simd::Mul(dz, dz)));
+				Simd::Float alpha = Simd::Mul(Simd::LoadU(compliance + i), vInvH2);
+				Simd::Float denom = Simd::Max(Simd::Add(Simd::Add(wA, wB), alpha), minDenom);
+				Simd::Float c = Simd::Sub(vZero, Simd::Sub(deltaLength, rest));
+				Simd::Float dLambda = Simd::Div(Simd::Sub(c, Simd::Mul(alpha, vLambda)), denom);
+				Simd::StoreU(lambda + i, Simd::Add(vLambda, dLambda));
+
+				Simd::Float scale = Simd::Div(dLambda, deltaLength);
+				Simd::Float cx = Simd::Mul(dx, scale);
+				Simd::Float cy = Simd::Mul(dy, scale);
+				Simd::Float cz = Simd::Mul(dz, scale);
+				Simd::Scatter(s.posX, stickA + i, Simd::Sub(ax, Simd::Mul(wA, cx)));
+				Simd::Scatter(s.posY, stickA + i, Simd::Sub(ay, Simd::Mul(wA, cy)));
+				Simd::Scatter(s.posZ, stickA + i, Simd::Sub(az, Simd::Mul(wA, cz)));
+				Simd::Scatter(s.posX, stickB + i, Simd::Add(bx, Simd::Mul(wB, cx)));
+				Simd::Scatter(s.posY, stickB + i, Simd::Add(by, Simd::Mul(wB, cy)));
+				Simd::Scatter(s.posZ, stickB + i, Simd::Add(bz, Simd::Mul(wB, cz)));
+			}
+		}
+		for (; i < end; i++)
+		{
+			SolveStickXPBD(s, invMass, stickA[i], stickB[i], restLength, compliance[i], lambda[i], invH2);
+		}
+	}
+
+	//correction stick i-j asks of particle i (inverse mass w), added to sum
+	inline void JacobiStick(const ParticleStreams& s, const float* invMass, uint32_t i, uint32_t j, float w, float restLength,
+		float& sumX, float& sumY, float& sumZ, StickError* error)
+	{
+		float dx = s.posX[j] - s.posX[i];
+		float dy = s.posY[j] - s.posY[i];
+		float dz = s.posZ[j] - s.posZ[i];
+		float deltaLength = sqrtf(dx * dx + dy * dy + dz * dz);
+		float stretch = deltaLength - restLength;
+		float diff = stretch / deltaLength;
+		//two pinned ends would divide by zero, w = 0 zeroes the share anyway
+		float total = w + invMass[j];
+		if (total < 1e-12f) total = 1e-12f;
+		float share = w / total;
+		sumX += (dx * diff) * share;
+		sumY += (dy * diff) * share;
+		sumZ += (dz * diff) * share;
+		AddStickError(error, stretch);
+	}
+
+	//share of its summed stick corrections a Jacobi sweep moves a particle by:
+	//the average over an interior particle's 4 sticks. Averaging a border
+	//particle over its own 2 or 3 over-relaxed the border, where larger
+	//relaxations diverged first
+	const float JACOBI_STICK_WEIGHT = 0.25f;
+
+	//scalar Jacobi update of particle i, also handles the grid border
+	inline void JacobiParticle(const ParticleStreams& s, const float* invMass, float* nextX, float* nextY, float* nextZ,
+		uint32_t width, uint32_t height, uint32_t i, float restLength, float relaxation, StickError* error)
+	{
+		const uint32_t xx = i % width;
+		const uint32_t zz = i / width;
+		const float w = invMass[i];
+		float sumX = 0.0f;
+		float sumY = 0.0f;
+		float sumZ = 0.0f;
+		//same neighbour order as the vector path: left, right, up, down
+		if (xx > 0) JacobiStick(s, invMass, i, i - 1, w, restLength, sumX, sumY, sumZ, error);
+		if (xx + 1 < width) JacobiStick(s, invMass, i, i + 1, w, restLength, sumX, sumY, sumZ, error);
+		if (zz > 0) JacobiStick(s, invMass, i, i - width, w, restLength, sumX, sumY, sumZ, error);
+		if (zz + 1 < height) JacobiStick(s, invMass, i, i + width, w, restLength, sumX, sumY, sumZ, error);
+		const float scale = relaxation * JACOBI_STICK_WEIGHT;
+		nextX[i] = s.posX[i] + sumX * scale;
+		nextY[i] = s.posY[i] + sumY * scale;
+		nextZ[i] = s.posZ[i] + sumZ * scale;
+	}
+
+	inline void JacobiStickLanes(
+		Simd::Float px, Simd::Float py, Simd::Float pz, Simd::Float w,
+		Simd::Float qx, Simd::Float qy, Simd::Float qz, Simd::Float wq, Simd::Float rest,
+		Simd::Float& sumX, Simd::Float& sumY, Simd::Float& sumZ, Simd::Float& maxLanes, Simd::Float& sumLanes, bool measure)
+	{
+		const Simd::Float minTotal = Simd::Set1(1e-12f);
+		Simd::Float dx = Simd::Sub(qx, px);
+		Simd::Float dy = Simd::Sub(qy, py);
+		Simd::Float dz = Simd::Sub(qz, pz);
+		Simd::Float deltaLength = Simd::Sqrt(Simd::Add(Simd::Add(Simd::Mul(dx, dx), Simd::Mul(dy, dy)), Simd::Mul(dz, dz)));
+		Simd::Float stretch = Simd::Sub(deltaLength, rest);
+		Simd::Float diff = Simd::Div(stretch, deltaLength);
+		Simd::Float share = Simd::Div(w, Simd::Max(Simd::Add(w, wq), minTotal));
+		sumX = Simd::Add(sumX, Simd::Mul(Simd::Mul(dx, diff), share));
+		sumY = Simd::Add(sumY, Simd::Mul(Simd::Mul(dy, diff), share));
+		sumZ = Simd::Add(sumZ, Simd::Mul(Simd::Mul(dz, diff), share));
+		if (measure)
+		{
+			maxLanes = Simd::Max(maxLanes, Simd::Max(stretch, Simd::Sub(Simd::Zero(), stretch)));
+			sumLanes = Simd::Add(sumLanes, Simd::Mul(stretch, stretch));
+		}
+	}
+
+	// --------------------------------------------------------
+	// Jacobi relaxation of the grid sticks around particles [begin, end)
+	//
+	// Every particle sums the corrections its (up to 4) sticks ask for,
+	// all computed from the positions before the sweep, and moves by
+	// relaxation times a quarter of the sum (JACOBI_STICK_WEIGHT).
+	// Results go to nextX/Y/Z, so the particles can be processed in
+	// any order and no two threads ever write the same one.
+	// Corrections are split by inverse mass, so pinned and sleeping
+	// particles hold still. Interior columns run with plain vector
+	// loads of the 4 neighbours, the first and last column of each
+	// row on the scalar path.
+	// --------------------------------------------------------
+	inline void JacobiSticks(const ParticleStreams& s, const float* invMass, float* nextX, float* nextY, float* nextZ,
+		uint32_t width, uint32_t height, uint32_t begin, uint32_t end, float restLength, float relaxation, bool useSimd,
+		StickError* error = nullptr)
+	{
+		uint32_t i = begin;
+		while (i < end)
+		{
+			const uint32_t zz = i / width;
+			const uint32_t rowStart = zz * width;
+			const uint32_t rowEnd = std::min(rowStart + width, end);
+			const bool up = zz > 0;
+			const bool down = zz + 1 < height;
+			const uint32_t sticks = (up ? 1 : 0) + (down ? 1 : 0) + 2;
+
+			if (useSimd)
+			{
+				//the interior of the row has both horizontal neighbours
+				const uint32_t first = std::max(i, rowStart + 1);
+				const uint32_t last = std::min(rowEnd, rowStart + width - 1);
+				for (; i < first; i++)
+				{
+					JacobiParticle(s, invMass, nextX, nextY, nextZ, width, height, i, restLength, relaxation, error);
+				}
+				if (last > first)
+				{
+					const Simd::Float rest = Simd::Set1(restLength);
+					const Simd::Float scale = Simd::Set1(relaxation * JACOBI_STICK_WEIGHT);
+					const bool measure = error != nullptr;
+					Simd::Float maxLanes = Simd::Zero();
+					Simd::Float sumLanes = Simd::Zero();
+					const uint32_t simdEnd = first + Simd::AlignDown(last - first);
+					for (; i < simdEnd; i += Simd::WIDTH)
+					{
+						Simd::Float px = Simd::LoadU(s.posX + i);
+						Simd::Float py = Simd::LoadU(s.posY + i);
+						Simd::Float pz = Simd::LoadU(s.posZ + i);
+						Simd::Float w = Simd::LoadU(invMass + i);
+						Simd::Float sumX = Simd::Zero();
+						Simd::Float sumY = Simd::Zero();
+						Simd::Float sumZ = Simd::Zero();
+						JacobiStickLanes(px, py, pz, w, Simd::LoadU(s.posX + i - 1), Simd::LoadU(s.posY + i - 1), Simd::LoadU(s.posZ + i - 1),
+							Simd::LoadU(invMass + i - 1), rest, sumX, sumY, sumZ, maxLanes, sumLanes, measure);
+						JacobiStickLanes(px, py, pz, w, Simd::LoadU(s.posX + i + 1), Simd::LoadU(s.posY + i + 1), Simd::LoadU(s.posZ + i + 1),
+							Simd::LoadU(invMass + i + 1), rest, sumX, sumY, sumZ, maxLanes, sumLanes, measure);
+						if (up)
+							JacobiStickLanes(px, py, pz, w, Simd::LoadU(s.posX + i - width), Simd::LoadU(s.posY + i - width), Simd::LoadU(s.posZ + i - width),
+								Simd::LoadU(invMass + i - width), rest, sumX, sumY, sumZ, maxLanes, sumLanes, measure);
+						if (down)
+							JacobiStickLanes(px, py, pz, w, Simd::LoadU(s.posX + i + width), Simd::LoadU(s.posY + i + width), Simd::LoadU(s.posZ + i + width),
+								Simd::LoadU(invMass + i + width), rest, sumX, sumY, sumZ, maxLanes, sumLanes, measure);
+						Simd::StoreU(nextX + i, Simd::Add(px, Simd::Mul(sumX, scale)));
+						Simd::StoreU(nextY + i, Simd::Add(py, Simd::Mul(sumY, scale)));
+						Simd::StoreU(nextZ + i, Simd::Add(pz, Simd::Mul(sumZ, scale)));
+					}
+					AddStickErrorLanes(error, maxLanes, sumLanes, (i - first) * sticks);
+				}
+			}
+			for (; i < rowEnd; i++)
+			{
+				JacobiParticle(s, invMass, nextX, nextY, nextZ, width, height, i, restLength, relaxation, error);
+			}
+		}
+	}
+
+	// --------------------------------------------------------
+	// Moves particles [begin, end) to the Jacobi result. With omega != 1
+	// this is the Chebyshev semi-iterative step
+	//   x(k+1) = x(k-1) + omega * (jacobi(x(k)) - x(k-1))
+	// and prevX/Y/Z, holding x(k-1), are advanced to x(k).
+	// --------------------------------------------------------
+	inline void ApplyJacobi(const ParticleStreams& s, const float* nextX, const float* nextY, const float* nextZ,
+		float* prevX, float* prevY, float* prevZ, uint32_t begin, uint32_t end, float omega, bool useSimd)
+	{
+		uint32_t i = begin;
+		if (useSimd)
+		{
+			const Simd::Float vOmega = Simd::Set1(omega);
+			const uint32_t simdEnd = begin + Simd::AlignDown(end - begin);
+			for (; i < simdEnd; i += Simd::WIDTH)
+			{
+				Simd::Float px = Simd::LoadU(s.posX + i);
+				Simd::Float py = Simd::LoadU(s.posY + i);
+				Simd::Float pz = Simd::LoadU(s.posZ + i);
+				Simd::Float nx = Simd::LoadU(nextX + i);
+				Simd::Float ny = Simd::LoadU(nextY + i);
+				Simd::Float nz = Simd::LoadU(nextZ + i);
+				if (omega != 1.0f)
+				{
+					Simd::Float qx = Simd::LoadU(prevX + i);
+					Simd::Float qy = Simd::LoadU(prevY + i);
+					Simd::Float qz = Simd::LoadU(prevZ + i);
+					nx = Simd::Add(qx, Simd::Mul(vOmega, Simd::Sub(nx, qx)));
+					ny = Simd::Add(qy, Simd::Mul(vOmega, Simd::Sub(ny, qy)));
+					nz = Simd::Add(qz, Simd::Mul(vOmega, Simd::Sub(nz, qz)));
+				}
+				if (prevX)
+				{
+					Simd::StoreU(prevX + i, px);
+					Simd::StoreU(prevY + i, py);
+					Simd::StoreU(prevZ + i, pz);
+				}
+				Simd::StoreU(s.posX + i, nx);
+				Simd::StoreU(s.posY + i, ny);
+				Simd::StoreU(s.posZ + i, nz);
+			}
+		}
+		for (; i < end; i++)
+		{
+			float nx = nextX[i];
+			float ny = nextY[i];
+			float nz = nextZ[i];
+			if (omega != 1.0f)
+			{
+				nx = prevX[i] + omega * (nx - prevX[i]);
+				ny = prevY[i] + omega * (ny - prevY[i]);
+				nz = prevZ[i] + omega * (nz - prevZ[i]);
+			}
+			if (prevX)
+			{
+				prevX[i] = s.posX[i];
+				prevY[i] = s.posY[i];
+				prevZ[i] = s.posZ[i];
+			}
+			s.posX[i] = nx;
+			s.posY[i] = ny;
+			s.posZ[i] = nz;
+		}
+	}
+
+	//push particles in [begin, end) out of a sphere: P' = Center + ContactNormal * Radius
+	inline void SphereConstraint(const ParticleStreams& s, uint32_t begin, uint32_t end, const XMFLOAT3& sphereCenter, float sphereRadius, bool useSimd)
+	{
+		uint32_t i = begin;
+		if (useSimd)
+		{
+			const Simd::Float cx = Simd::Set1(sphereCenter.x);
+			const Simd::Float cy = Simd::Set1(sphereCenter.y);
+			const Simd::Float cz = Simd::Set1(sphereCenter.z);
+			const Simd::Float radius = Simd::Set1(sphereRadius);
+			const uint32_t simdEnd = begin + Simd::AlignDown(end - begin);
+			for (; i < simdEnd; i += Simd::WIDTH)
+			{
+				Simd::Float px = Simd::LoadU(s.posX + i);
+				Simd::Float py = Simd::LoadU(s.posY + i);
+				Simd::Float pz = Simd::LoadU(s.posZ + i);
+				Simd::Float nx = Simd::Sub(px, cx);
+				Simd::Float ny = Simd::Sub(py, cy);
+				Simd::Float nz = Simd::Sub(pz, cz);
+				Simd::Float deltaLength = Simd::Sqrt(Simd::Add(Simd::Add(Simd::Mul(nx, nx), Simd::Mul(ny, ny)), Simd::Mul(nz, nz)));
+				Simd::Mask inside = Simd::CmpLt(deltaLength, radius);
+				//most lanes are nowhere near the sphere
+				if (!Simd::Any(inside))
+					continue;
+
+				nx = Simd::Div(nx, deltaLength);
+				ny = Simd::Div(ny, deltaLength);
+				nz = Simd::Div(nz, deltaLength);
+				Simd::StoreU(s.posX + i, Simd::Select(inside, Simd::Add(cx, Simd::Mul(radius, nx)), px));
+				Simd::StoreU(s.posY + i, Simd::Select(inside, Simd::Add(cy, Simd::Mul(radius, ny)), py));
+				Simd::StoreU(s.posZ + i, Simd::Select(inside, Simd::Add(cz, Simd::Mul(radius, nz)), pz));
+			}
+		}
+		for (; i < end; i++)
+		{
+			XMFLOAT3 contactNormal;
+			contactNormal.x = s.posX[i] - sphereCenter.x;
+			contactNormal.y = s.posY[i] - sphereCenter.y;
+			contactNormal.z = s.posZ[i] - sphereCenter.z;
+
+			float deltaLength = sqrtf(
+				contactNormal.x * contactNormal.x +
+				contactNormal.y * contactNormal.y +
+				contactNormal.z * contactNormal.z);
+
+			if (deltaLength < sphereRadius)
+			{
+				contactNormal.x /= deltaLength;
+				contactNormal.y /= deltaLength;
+				contactNormal.z /= deltaLength;
+
+				s.posX[i] = sphereCenter.x + (sphereRadius * contactNormal.x);
+				s.posY[i] = sphereCenter.y + (sphereRadius * contactNormal.y);
+				s.posZ[i] = sphereCenter.z + (sphereRadius * contactNormal.z);
+			}
+		}
+	}
+
+	//push particles in [begin, end) out of a capsule: the contact normal runs from
+	//the closest point on segment a-b. invLength2 = 1 / |b - a|^2
+	inline void CapsuleConstraint(const ParticleStreams& s, uint32_t begin, uint32_t end, const XMFLOAT3& a, const XMFLOAT3& b, float invLength2, float radius, bool useSimd)
+	{
+		const XMFLOAT3 ab(b.x - a.x, b.y - a.y, b.z - a.z);
+		uint32_t i = begin;
+		if (useSimd)
+		{
+			const Simd::Float ax = Simd::Set1(a.x);
+			const Simd::Float ay = Simd::Set1(a.y);
+			const Simd::Float az = Simd::Set1(a.z);
+			const Simd::Float abx = Simd::Set1(ab.x);
+			const Simd::Float aby = Simd::Set1(ab.y);
+			const Simd::Float abz = Simd::Set1(ab.z);
+			const Simd::Float invAb2 = Simd::Set1(invLength2);
+			const Simd::Float r = Simd::Set1(radius);
+			const Simd::Float zero = Simd::Zero();
+			const Simd::Float one = Simd::Set1(1.0f);
+			const uint32_t simdEnd = begin + Simd::AlignDown(end - begin);
+			for (; i < simdEnd; i += Simd::WIDTH)
+			{
+				Simd::Float px = Simd::LoadU(s.posX + i);
+				Simd::Float py = Simd::LoadU(s.posY + i);
+				Simd::Float pz = Simd::LoadU(s.posZ + i);
+				Simd::Float t = Simd::Mul(Simd::Add(Simd::Add(Simd::Mul(Simd::Sub(px, ax), abx), Simd::Mul(Simd::Sub(py, ay), aby)), Simd::Mul(Simd::Sub(pz, az), abz)), invAb2);
+				t = Simd::Min(Simd::Max(t, zero), one);
+				Simd::Float qx = Simd::Add(ax, Simd::Mul(abx, t));
+				Simd::Float qy = Simd::Add(ay, Simd::Mul(aby, t));
+				Simd::Float qz = Simd::Add(az, Simd::Mul(abz, t));
+				Simd::Float nx = Simd::Sub(px, qx);
+				Simd::Float ny = Simd::Sub(py, qy);
+				Simd::Float nz = Simd::Sub(pz, qz);
+				Simd::Float deltaLength = Simd::Sqrt(Simd::Add(Simd::Add(Simd::Mul(nx, nx), Simd::Mul(ny, ny)), Simd::Mul(nz, nz)));
+				Simd::Mask inside = Simd::CmpLt(deltaLength, r);
+				if (!Simd::Any(inside))
+					continue;
+
+				Simd::Float scale = Simd::Div(r, deltaLength);
+				Simd::StoreU(s.posX + i, Simd::Select(inside, Simd::Add(qx, Simd::Mul(nx, scale)), px));
+				Simd::StoreU(s.posY + i, Simd::Select(inside, Simd::Add(qy, Simd::Mul(ny, scale)), py));
+				Simd::StoreU(s.posZ + i, Simd::Select(inside, Simd::Add(qz, Simd::Mul(nz, scale)), pz));
+			}
+		}
+		for (; i < end; i++)
+		{
+			float t = ((s.posX[i] - a.x) * ab.x + (s.posY[i] - a.y) * ab.y + (s.posZ[i] - a.z) * ab.z) * invLength2;
+			t = t > 0.0f ? t : 0.0f;
+			t = t < 1.0f ? t : 1.0f;
+			const float qx = a.x + ab.x * t;
+			const float qy = a.y + ab.y * t;
+			const float qz = a.z + ab.z * t;
+			const float nx = s.posX[i] - qx;
+			const float ny = s.posY[i] - qy;
+			const float nz = s.posZ[i] - qz;
+			float deltaLength = sqrtf(nx * nx + ny * ny + nz * nz);
+			if (deltaLength < radius)
+			{
+				float scale = radius / deltaLength;
+				s.posX[i] = qx + nx * scale;
+				s.posY[i] = qy + ny * scale;
+				s.posZ[i] = qz + nz * scale;
+			}
+		}
+	}
+
+	//keep particles in [begin, end) on the positive side of the plane dot(P, normal) = offset
+	inline void PlaneConstraint(const ParticleStreams& s, uint32_t begin, uint32_t end, const XMFLOAT3& normal, float offset, bool useSimd)
+	{
+		uint32_t i = begin;
+		if (useSimd)
+		{
+			const Simd::Float nx = Simd::Set1(normal.x);
+			const Simd::Float ny = Simd::Set1(normal.y);
+			const Simd::Float nz = Simd::Set1(normal.z);
+			const Simd::Float d0 = Simd::Set1(offset);
+			const Simd::Float zero = Simd::Zero();
+			const uint32_t simdEnd = begin + Simd::AlignDown(end - begin);
+			for (; i < simdEnd; i += Simd::WIDTH)
+			{
+				Simd::Float px = Simd::LoadU(s.posX + i);
+				Simd::Float py = Simd::LoadU(s.posY + i);
+				Simd::Float pz = Simd::LoadU(s.posZ + i);
+				Simd::Float d = Simd::Sub(Simd::Add(Simd::Add(Simd::Mul(px, nx), Simd::Mul(py, ny)), Simd::Mul(pz, nz)), d0);
+				Simd::Mask inside = Simd::CmpLt(d, zero);
+				if (!Simd::Any(inside))
+					continue;
+
+				Simd::StoreU(s.posX + i, Simd::Select(inside, Simd::Sub(px, Simd::Mul(nx, d)), px));
+				Simd::StoreU(s.posY + i, Simd::Select(inside, Simd::Sub(py, Simd::Mul(ny, d)), py));
+				Simd::StoreU(s.posZ + i, Simd::Select(inside, Simd::Sub(pz, Simd::Mul(nz, d)), pz));
+			}
+		}
+		for (; i < end; i++)
+		{
+			float d = (s.posX[i] * normal.x + s.posY[i] * normal.y + s.posZ[i] * normal.z) - offset;
+			if (d < 0.0f)
+			{
+				s.posX[i] = s.posX[i] - normal.x * d;
+				s.posY[i] = s.posY[i] - normal.y * d;
+				s.posZ[i] = s.posZ[i] - normal.z * d;
+			}
+		}
+	}
+
+	//push particles in [begin, end) out of an oriented box through its nearest face.
+	//axes are the box's unit axes, halfExtents already include the bias. Scalar only,
+	//boxes are rare next to spheres and capsules and the face pick does not vectorize cleanly
+	inline void BoxConstraint(const ParticleStreams& s, uint32_t begin, uint32_t end, const XMFLOAT3& center, const XMFLOAT3* axes, const XMFLOAT3& halfExtents)
+	{
+		const float he[3] = { halfExtents.x, halfExtents.y, halfExtents.z };
+		for (uint32_t i = begin; i < end; i++)
+		{
+			const float dx = s.posX[i] - center.x;
+			const float dy = s.posY[i] - center.y;
+			const float dz = s.posZ[i] - center.z;
+			float local[3];
+			float depth = 0.0f;
+			int face = -1;
+			for (int k = 0; k < 3; k++)
+			{
+				local[k] = dx * axes[k].x + dy * axes[k].y + dz * axes[k].z;
+				float penetration = he[k] - fabsf(local[k]);
+				if (penetration <= 0.0f)
+				{
+					face = -1;
+					break;
+				}
+				if (face < 0 || penetration < depth)
+				{
+					depth = penetration;
+					face = k;
+				}
+			}
+			if (face < 0)
+				continue;
+
+			float push = local[face] < 0.0f ? -depth : depth;
+			s.posX[i] += axes[face].x * push;
+			s.posY[i] += axes[face].y * push;
+			s.posZ[i] += axes[face].z * push;
+		}
+	}
+}
@@ -0,0 +1,542 @@
+#include "ClothMesh.h"
+#include <float.h>
+#include <math.h>
+#include <stddef.h>
+#include <string.h>
+#include <algorithm>
+#include "SimdMath.h"
+
+//WriteVertices streams each vertex as one 16 byte store
+static_assert(sizeof(DynamicVertex) == 4 * sizeof(float), "DynamicVertex layout changed");
+//WriteQuantizedVertices streams two vertices per 16 byte store
+static_assert(sizeof(QuantizedVertex) == 4 * sizeof(uint16_t), "QuantizedVertex layout changed");
+
+namespace
+{
+	//keeps a vertex whose faces all collapsed at a zero normal instead of NaN
+	const float MIN_NORMAL_LENGTH = 1e-12f;
+	//snorm8 maps -1..1 to -127..127
+	const float NORMAL_SCALE = 127.0f;
+	//largest 16 bit quantized coordinate
+	const float QUANTIZED_MAX = 65535.0f;
+
+	//rounds to nearest even like _mm_cvtps_epi32 under the default rounding mode
+	inline uint32_t PackSnorm8(float f)
+	{
+		return static_cast<uint32_t>(lrintf(f * NORMAL_SCALE)) & 0xff;
+	}
+
+	//octahedral normal: project onto |x| + |y| + |z| = 1 and fold the lower
+	//half over the diagonals, two snorm8 values in 16 bits
+	inline uint32_t PackOctahedral(float x, float y, float z)
+	{
+		const float inv = 1.0f / std::max(fabsf(x) + fabsf(y) + fabsf(z), MIN_NORMAL_LENGTH);
+		float u = x * inv;
+		float v = y * inv;
+		if (z < 0.0f)
+		{
+			const float foldedU = copysignf(1.0f - fabsf(v), u);
+			v = copysignf(1.0f - fabsf(u), v);
+			u = foldedU;
+		}
+		return PackSnorm8(u) | (PackSnorm8(v) << 8);
+	}
+
+	inline uint32_t Quantize(float p, float min, float scale)
+	{
+		const float q = std::min(std::max((p - min) * scale, 0.0f), QUANTIZED_MAX);
+		return static_cast<uint32_t>(lrintf(q));
+	}
+}
+
+ClothMesh::ClothMesh()
+{
+	m_width = 0;
+	m_height = 0;
+	m_rowGrain = 1;
+	m_useSimd = true;
+	m_boundsMin = XMFLOAT3(0.0f, 0.0f, 0.0f);
+	m_boundsMax = XMFLOAT3(0.0f, 0.0f, 0.0f);
+}
+
+void ClothMesh::BuildIndices(uint32_t width, uint32_t height, std::vector<uint32_t>& indices)
+{
+	indices.clear();
+	if (width < 2 || height < 2)
+		return;
+	indices.reserve((width - 1) * (height - 1) * 6);
+	for (uint32_t zz = 0; zz < height - 1; zz++)
+	{
+		for (uint32_t xx = 0; xx < width - 1; xx++)
+		{
+			//a b
+			//c d, split along b-c, both facing +y while the cloth lies flat
+			const uint32_t a = zz * width + xx;
+			const uint32_t b = a + 1;
+			const uint32_t c = a + width;
+			const uint32_t d = c + 1;
+			indices.push_back(a);
+			indices.push_back(c);
+			indices.push_back(b);
+			indices.push_back(b);
+			indices.push_back(c);
+			indices.push_back(d);
+		}
+	}
+}
+
+void ClothMesh::BuildStaticVertices(uint32_t width, uint32_t height, std::vector<StaticVertex>& vertices)
+{
+	const float du = width > 1 ? 1.0f / (width - 1) : 0.0f;
+	const float dv = height > 1 ? 1.0f / (height - 1) : 0.0f;
+	vertices.resize(static_cast<size_t>(width) * height);
+	for (uint32_t zz = 0; zz < height; zz++)
+	{
+		for (uint32_t xx = 0; xx < width; xx++)
+		{
+			vertices[zz * width + xx].UV = XMFLOAT2(xx * du, zz * dv);
+		}
+	}
+}
+
+void ClothMesh::Resize(uint32_t width, uint32_t height)
+{
+	m_width = width;
+	m_height = height;
+	m_rowGrain = std::max(1u, PARALLEL_GRAIN / std::max(width, 1u));
+	const size_t count = static_cast<size_t>(width) * height;
+	m_posX.assign(count, 0.0f);
+	m_posY.assign(count, 0.0f);
+	m_posZ.assign(count, 0.0f);
+	m_normalX.assign(count, 0.0f);
+	m_normalY.assign(count, 0.0f);
+	m_normalZ.assign(count, 0.0f);
+	//the zero quads at both ends of the face rows are never written
+	const size_t bands = (height + m_rowGrain - 1) / m_rowGrain;
+	m_scratch.assign(bands * (6 * width + 12 * (width + 1)), 0.0f);
+	m_bandBounds.assign(bands * 6, 0.0f);
+}
+
+void ClothMesh::Update(const ParticleSystem& cloth, float alpha, ThreadPool* pool)
+{
+	if (cloth.GetWidth() != m_width || cloth.GetHeight() != m_height)
+		Resize(cloth.GetWidth(), cloth.GetHeight());
+	m_useSimd = cloth.IsSimdEnabled();
+	if (m_width == 0 || m_height == 0)
+		return;
+
+	ParallelRows(pool, [this, &cloth, alpha](uint32_t rowBegin, uint32_t rowEnd) {
+		UpdateRows(cloth, alpha, rowBegin, rowEnd);
+	});
+
+	const float* band = m_bandBounds.data();
+	float bounds[6] = { band[0], band[1], band[2], band[3], band[4], band[5] };
+	for (size_t b = 6; b < m_bandBounds.size(); b += 6)
+	{
+		for (int k = 0; k < 3; k++)
+		{
+			bounds[k] = std::min(bounds[k], band[b + k]);
+			bounds[k + 3] = std::max(bounds[k + 3], band[b + k + 3]);
+		}
+	}
+	m_boundsMin = XMFLOAT3(bounds[0], bounds[1], bounds[2]);
+	m_boundsMax = XMFLOAT3(bounds[3], bounds[4], bounds[5]);
+}
+
+void ClothMesh::UpdateRows(const ParticleSystem& cloth, float alpha, uint32_t rowBegin, uint32_t rowEnd)
+{
+	const uint32_t W = m_width;
+	const uint32_t band = rowBegin / m_rowGrain;
+	float* scratch = m_scratch.data() + band * (6 * W + 12 * (W + 1));
+	//the range covers several bands when the rows aren't split (no pool or no
+	//workers), so every band in it is refilled and each row goes to its own
+	const uint32_t bandEnd = (rowEnd + m_rowGrain - 1) / m_rowGrain;
+	for (uint32_t b = band; b < bandEnd; b++)
+	{
+		float* bounds = m_bandBounds.data() + b * 6;
+		for (int k = 0; k < 3; k++)
+		{
+			bounds[k] = FLT_MAX;
+			bounds[k + 3] = -FLT_MAX;
+		}
+	}
+	const Row topHalo = { scratch, scratch + W, scratch + 2 * W };
+	const Row bottomHalo = { scratch + 3 * W, scratch + 4 * W, scratch + 5 * W };
+	float* faceScratch = scratch + 6 * W;
+	FaceRow faces[2];
+	for (int k = 0; k < 2; k++)
+	{
+		float* f = faceScratch + k * 6 * (W + 1);
+		faces[k].face0 = { f, f + (W + 1), f + 2 * (W + 1) };
+		faces[k].face1 = { f + 3 * (W + 1), f + 4 * (W + 1), f + 5 * (W + 1) };
+	}
+
+	auto OwnRow = [this, W](uint32_t row) {
+		const Row r = { m_posX.data() + row * W, m_posY.data() + row * W, m_posZ.data() + row * W };
+		return r;
+	};
+	auto Interpolate = [&cloth, alpha, W](uint32_t row, const Row& r) {
+		cloth.GetInterpolatedPositions(row * W, (row + 1) * W, alpha, r.x, r.y, r.z);
+	};
+
+	//quads between the band's first row and the one above it
+	Row current = OwnRow(rowBegin);
+	Interpolate(rowBegin, current);
+	const FaceRow* above = &faces[0];
+	const FaceRow* below = &faces[1];
+	if (rowBegin > 0)
+	{
+		Interpolate(rowBegin - 1, topHalo);
+		FaceNormals(topHalo, current, *above);
+	}
+	else
+	{
+		ZeroFaces(*above);
+	}
+
+	for (uint32_t zz = rowBegin; zz < rowEnd; zz++)
+	{
+		if (zz + 1 < m_height)
+		{
+			const Row next = zz + 1 < rowEnd ? OwnRow(zz + 1) : bottomHalo;
+			Interpolate(zz + 1, next);
+			FaceNormals(current, next, *below);
+			current = next;
+		}
+		else
+		{
+			ZeroFaces(*below);
+		}
+		VertexNormals(zz, *above, *below);
+		RowBounds(OwnRow(zz), m_bandBounds.data() + (zz / m_rowGrain) * 6);
+		std::swap(above, below);
+	}
+}
+
+void ClothMesh::FaceNormals(const Row& top, const Row& bottom, const FaceRow& faces) const
+{
+	//un-normalized cross products, so bigger triangles weigh more in the vertex sums;
+	//quad x is stored at x + 1, behind the zero quad
+	const uint32_t quads = m_width - 1;
+	float* f0x = faces.face0.x + 1;
+	float* f0y = faces.face0.y + 1;
+	float* f0z = faces.face0.z + 1;
+	float* f1x = faces.face1.x + 1;
+	float* f1y = faces.face1.y + 1;
+	float* f1z = faces.face1.z + 1;
+
+	uint32_t a = 0;
+	if (m_useSimd)
+	{
+		const uint32_t simdEnd = Simd::AlignDown(quads);
+		for (; a < simdEnd; a += Simd::WIDTH)
+		{
+			const uint32_t b = a + 1;
+			const Simd::Float ax = Simd::LoadU(top.x + a);
+			const Simd::Float ay = Simd::LoadU(top.y + a);
+			const Simd::Float az = Simd::LoadU(top.z + a);
+			const Simd::Float bx = Simd::LoadU(top.x + b);
+			const Simd::Float by = Simd::LoadU(top.y + b);
+			const Simd::Float bz = Simd::LoadU(top.z + b);
+			const Simd::Float cx = Simd::LoadU(bottom.x + a);
+			const Simd::Float cy = Simd::LoadU(bottom.y + a);
+			const Simd::Float cz = Simd::LoadU(bottom.z + a);
+
+			//triangle a c b: (c - a) x (b - a)
+			Simd::Float ux = Simd::Sub(cx, ax);
+			Simd::Float uy = Simd::Sub(cy, ay);
+			Simd::Float uz = Simd::Sub(cz, az);
+			Simd::Float vx = Simd::Sub(bx, ax);
+			Simd::Float vy = Simd::Sub(by, ay);
+			Simd::Float vz = Simd::Sub(bz, az);
+			Simd::StoreU(f0x + a, Simd::Sub(Simd::Mul(uy, vz), Simd::Mul(uz, vy)));
+			Simd::StoreU(f0y + a, Simd::Sub(Simd::Mul(uz, vx), Simd::Mul(ux, vz)));
+			Simd::StoreU(f0z + a, Simd::Sub(Simd::Mul(ux, vy), Simd::Mul(uy, vx)));
+
+			//triangle b c d: (c - b) x (d - b)
+			ux = Simd::Sub(cx, bx);
+			uy = Simd::Sub(cy, by);
+			uz = Simd::Sub(cz, bz);
+			vx = Simd::Sub(Simd::LoadU(bottom.x + b), bx);
+			vy = Simd::Sub(Simd::LoadU(bottom.y + b), by);
+			vz = Simd::Sub(Simd::LoadU(bottom.z + b), bz);
+			Simd::StoreU(f1x + a, Simd::Sub(Simd::Mul(uy, vz), Simd::Mul(uz, vy)));
+			Simd::StoreU(f1y + a, Simd::Sub(Simd::Mul(uz, vx), Simd::Mul(ux, vz)));
+			Simd::StoreU(f1z + a, Simd::Sub(Simd::Mul(ux, vy), Simd::Mul(uy, vx)));
+		}
+	}
+	for (; a < quads; a++)
+	{
+		const uint32_t b = a + 1;
+
+		float ux = bottom.x[a] - top.x[a];
+		float uy = bottom.y[a] - top.y[a];
+		float uz = bottom.z[a] - top.z[a];
+		float vx = top.x[b] - top.x[a];
+		float vy = top.y[b] - top.y[a];
+		float vz = top.z[b] - top.z[a];
+		f0x[a] = uy * vz - uz * vy;
+		f0y[a] = uz * vx - ux * vz;
+		f0z[a] = ux * vy - uy * vx;
+
+		ux = bottom.x[a] - top.x[b];
+		uy = bottom.y[a] - top.y[b];
+		uz = bottom.z[a] - top.z[b];
+		vx = bottom.x[b] - top.x[b];
+		vy = bottom.y[b] - top.y[b];
+		vz = bottom.z[b] - top.z[b];
+		f1x[a] = uy * vz - uz * vy;
+		f1y[a] = uz * vx - ux * vz;
+		f1z[a] = ux * vy - uy * vx;
+	}
+}
+
+void ClothMesh::ZeroFaces(const FaceRow& faces) const
+{
+	const size_t bytes = sizeof(float) * (m_width + 1);
+	memset(faces.face0.x, 0, bytes);
+	memset(faces.face0.y, 0, bytes);
+	memset(faces.face0.z, 0, bytes);
+	memset(faces.face1.x, 0, bytes);
+	memset(faces.face1.y, 0, bytes);
+	memset(faces.face1.z, 0, bytes);
+}
+
+void ClothMesh::RowBounds(const Row& row, float* bounds) const
+{
+	const float* streams[3] = { row.x, row.y, row.z };
+	for (int k = 0; k < 3; k++)
+	{
+		const float* p = streams[k];
+		float lo = bounds[k];
+		float hi = bounds[k + 3];
+		uint32_t i = 0;
+		if (m_useSimd)
+		{
+			Simd::Float vLo = Simd::Set1(lo);
+			Simd::Float vHi = Simd::Set1(hi);
+			const uint32_t simdEnd = Simd::AlignDown(m_width);
+			for (; i < simdEnd; i += Simd::WIDTH)
+			{
+				const Simd::Float v = Simd::LoadU(p + i);
+				vLo = Simd::Min(vLo, v);
+				vHi = Simd::Max(vHi, v);
+			}
+			lo = Simd::ReduceMin(vLo);
+			hi = Simd::ReduceMax(vHi);
+		}
+		for (; i < m_width; i++)
+		{
+			lo = std::min(lo, p[i]);
+			hi = std::max(hi, p[i]);
+		}
+		bounds[k] = lo;
+		bounds[k + 3] = hi;
+	}
+}
+
+void ClothMesh::VertexNormals(uint32_t row, const FaceRow& above, const FaceRow& below)
+{
+	//vertex x is corner a of quad x below (face 0), b of quad x - 1 below (both),
+	//c of quad x above (both) and d of quad x - 1 above (face 1); with the zero
+	//quad in front, quad x - 1 sits at x and quad x at x + 1
+	const uint32_t W = m_width;
+	float* nx = m_normalX.data() + row * W;
+	float* ny = m_normalY.data() + row * W;
+	float* nz = m_normalZ.data() + row * W;
+
+	uint32_t i = 0;
+	if (m_useSimd)
+	{
+		const Simd::Float vOne = Simd::Set1(1.0f);
+		const Simd::Float vMin = Simd::Set1(MIN_NORMAL_LENGTH);
+		const uint32_t simdEnd = Simd::AlignDown(W);
+		for (; i < simdEnd; i += Simd::WIDTH)
+		{
+			Simd::Float x = Simd::Add(Simd::LoadU(below.face0.x + i + 1), Simd::LoadU(below.face0.x + i));
+			Simd::Float y = Simd::Add(Simd::LoadU(below.face0.y + i + 1), Simd::LoadU(below.face0.y + i));
+			Simd::Float z = Simd::Add(Simd::LoadU(below.face0.z + i + 1), Simd::LoadU(below.face0.z + i));
+			x = Simd::Add(x, Simd::LoadU(below.face1.x + i));
+			y = Simd::Add(y, Simd::LoadU(below.face1.y + i));
+			z = Simd::Add(z, Simd::LoadU(below.face1.z + i));
+			x = Simd::Add(x, Simd::LoadU(above.face0.x + i + 1));
+			y = Simd::Add(y, Simd::LoadU(above.face0.y + i + 1));
+			z = Simd::Add(z, Simd::LoadU(above.face0.z + i + 1));
+			x = Simd::Add(x, Simd::LoadU(above.face1.x + i + 1));
+			y = Simd::Add(y, Simd::LoadU(above.face1.y + i + 1));
+			z = Simd::Add(z, Simd::LoadU(above.face1.z + i + 1));
+			x = Simd::Add(x, Simd::LoadU(above.face1.x + i));
+			y = Simd::Add(y, Simd::LoadU(above.face1.y + i));
+			z = Simd::Add(z, Simd::LoadU(above.face1.z + i));
+
+			const Simd::Float length = Simd::Sqrt(Simd::Add(Simd::Add(Simd::Mul(x, x), Simd::Mul(y, y)), Simd::Mul(z, z)));
+			const Simd::Float inv = Simd::Div(vOne, Simd::Max(length, vMin));
+			Simd::StoreU(nx + i, Simd::Mul(x, inv));
+			Simd::StoreU(ny + i, Simd::Mul(y, inv));
+			Simd::StoreU(nz + i, Simd::Mul(z, inv));
+		}
+	}
+	for (; i < W; i++)
+	{
+		float x = below.face0.x[i + 1] + below.face0.x[i];
+		float y = below.face0.y[i + 1] + below.face0.y[i];
+		float z = below.face0.z[i + 1] + below.face0.z[i];
+		x = x + below.face1.x[i];
+		y = y + below.face1.y[i];
+		z = z + below.face1.z[i];
+		x = x + above.face0.x[i + 1];
+		y = y + above.face0.y[i + 1];
+		z = z + above.face0.z[i + 1];
+		x = x + above.face1.x[i + 1];
+		y = y + above.face1.y[i + 1];
+		z = z + above.face1.z[i + 1];
+		x = x + above.face1.x[i];
+		y = y + above.face1.y[i];
+		z = z + above.face1.z[i];
+
+		const float length = sqrtf(x * x + y * y + z * z);
+		const float inv = 1.0f / std::max(length, MIN_NORMAL_LENGTH);
+		nx[i] = x * inv;
+		ny[i] = y * inv;
+		nz[i] = z * inv;
+	}
+}
+
+void ClothMesh::WriteVertices(DynamicVertex* vertices, ThreadPool* pool) const
+{
+	const uint32_t W = m_width;
+	const bool stream = m_useSimd && (reinterpret_cast<uintptr_t>(vertices) & 15) == 0;
+	ParallelRows(pool, [this, vertices, W, stream](uint32_t rowBegin, uint32_t rowEnd) {
+		uint32_t i = rowBegin * W;
+		const uint32_t end = rowEnd * W;
+#if !defined(SIMD_SCALAR)
+		if (stream)
+		{
+			//4 vertices are 4 16 byte stores, a transpose of the SoA streams
+			const __m128 vScale = _mm_set1_ps(NORMAL_SCALE);
+			const __m128i byteMask = _mm_set1_epi32(0xff);
+			for (; i + 4 <= end; i += 4)
+			{
+				__m128i nx = _mm_and_si128(_mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(m_normalX.data() + i), vScale)), byteMask);
+				__m128i ny = _mm_and_si128(_mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(m_normalY.data() + i), vScale)), byteMask);
+				__m128i nz = _mm_and_si128(_mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(m_normalZ.data() + i), vScale)), byteMask);
+				__m128 px = _mm_loadu_ps(m_posX.data() + i);
+				__m128 py = _mm_loadu_ps(m_posY.data() + i);
+				__m128 pz = _mm_loadu_ps(m_posZ.data() + i);
+				__m128 n = _mm_castsi128_ps(_mm_or_si128(nx, _mm_or_si128(_mm_slli_epi32(ny, 8), _mm_slli_epi32(nz, 16))));
+				_MM_TRANSPOSE4_PS(px, py, pz, n);
+				float* out = reinterpret_cast<float*>(vertices + i);
+				_mm_stream_ps(out, px);
+				_mm_stream_ps(out + 4, py);
+				_mm_stream_ps(out + 8, pz);
+				_mm_stream_ps(out + 12, n);
+			}
+		}
+#endif
+		for (; i < end; i++)
+		{
+			DynamicVertex& v = vertices[i];
+			v.Position = XMFLOAT3(m_posX[i], m_posY[i], m_posZ[i]);
+			v.Normal = PackSnorm8(m_normalX[i]) | (PackSnorm8(m_normalY[i]) << 8) | (PackSnorm8(m_normalZ[i]) << 16);
+		}
+		//the streamed lines have to land before the buffer is unmapped
+		if (stream)
+			Simd::StreamFence();
+	});
+}
+
+void ClothMesh::WriteQuantizedVertices(QuantizedVertex* vertices, QuantizationBounds& bounds, ThreadPool* pool) const
+{
+	//an axis the cloth is flat along quantizes to 0 and decodes to Min
+	const float extent[3] = { m_boundsMax.x - m_boundsMin.x, m_boundsMax.y - m_boundsMin.y, m_boundsMax.z - m_boundsMin.z };
+	float scale[3];
+	float step[3];
+	for (int k = 0; k < 3; k++)
+	{
+		scale[k] = extent[k] > 0.0f ? QUANTIZED_MAX / extent[k] : 0.0f;
+		step[k] = extent[k] / QUANTIZED_MAX;
+	}
+	bounds.Min = m_boundsMin;
+	bounds.Step = XMFLOAT3(step[0], step[1], step[2]);
+	if (m_width == 0 || m_height == 0)
+		return;
+
+	const uint32_t W = m_width;
+	const XMFLOAT3 min = m_boundsMin;
+	const bool stream = m_useSimd && (reinterpret_cast<uintptr_t>(vertices) & 15) == 0;
+	ParallelRows(pool, [this, vertices, W, stream, min, scale](uint32_t rowBegin, uint32_t rowEnd) {
+		uint32_t i = rowBegin * W;
+		const uint32_t end = rowEnd * W;
+#if !defined(SIMD_SCALAR)
+		if (stream)
+		{
+			//4 vertices are 2 16 byte stores of interleaved 16 bit values
+			const __m128 vZero = _mm_setzero_ps();
+			const __m128 vMax = _mm_set1_ps(QUANTIZED_MAX);
+			const __m128 vOne = _mm_set1_ps(1.0f);
+			const __m128 vMinLength = _mm_set1_ps(MIN_NORMAL_LENGTH);
+			const __m128 vNormalScale = _mm_set1_ps(NORMAL_SCALE);
+			const __m128 signMask = _mm_set1_ps(-0.0f);
+			const __m128i byteMask = _mm_set1_epi32(0xff);
+			const __m128 minX = _mm_set1_ps(min.x), minY = _mm_set1_ps(min.y), minZ = _mm_set1_ps(min.z);
+			const __m128 scaleX = _mm_set1_ps(scale[0]), scaleY = _mm_set1_ps(scale[1]), scaleZ = _mm_set1_ps(scale[2]);
+			auto Quantize4 = [vZero, vMax](__m128 p, __m128 min, __m128 scale) {
+				return _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_sub_ps(p, min), scale), vZero), vMax));
+			};
+			auto CopySign = [signMask](__m128 magnitude, __m128 sign) {
+				return _mm_or_ps(_mm_andnot_ps(signMask, magnitude), _mm_and_ps(signMask, sign));
+			};
+			for (; i + 4 <= end; i += 4)
+			{
+				const __m128i qx = Quantize4(_mm_loadu_ps(m_posX.data() + i), minX, scaleX);
+				const __m128i qy = Quantize4(_mm_loadu_ps(m_posY.data() + i), minY, scaleY);
+				const __m128i qz = Quantize4(_mm_loadu_ps(m_posZ.data() + i), minZ, scaleZ);
+
+				const __m128 nx = _mm_loadu_ps(m_normalX.data() + i);
+				const __m128 ny = _mm_loadu_ps(m_normalY.data() + i);
+				const __m128 nz = _mm_loadu_ps(m_normalZ.data() + i);
+				const __m128 ax = _mm_andnot_ps(signMask, nx);
+				const __m128 ay = _mm_andnot_ps(signMask, ny);
+				const __m128 az = _mm_andnot_ps(signMask, nz);
+				const __m128 inv = _mm_div_ps(vOne, _mm_max_ps(_mm_add_ps(_mm_add_ps(ax, ay), az), vMinLength));
+				__m128 u = _mm_mul_ps(nx, inv);
+				__m128 v = _mm_mul_ps(ny, inv);
+				const __m128 lower = _mm_cmplt_ps(nz, vZero);
+				const __m128 foldedU = CopySign(_mm_sub_ps(vOne, _mm_andnot_ps(signMask, v)), u);
+				const __m128 foldedV = CopySign(_mm_sub_ps(vOne, _mm_andnot_ps(signMask, u)), v);
+				u = _mm_or_ps(_mm_and_ps(lower, foldedU), _mm_andnot_ps(lower, u));
+				v = _mm_or_ps(_mm_and_ps(lower, foldedV), _mm_andnot_ps(lower, v));
+				const __m128i pu = _mm_and_si128(_mm_cvtps_epi32(_mm_mul_ps(u, vNormalScale)), byteMask);
+				const __m128i pv = _mm_and_si128(_mm_cvtps_epi32(_mm_mul_ps(v, vNormalScale)), byteMask);
+				const __m128i qn = _mm_or_si128(pu, _mm_slli_epi32(pv, 8));
+
+				//x | y << 16 and z | n << 16 per lane, then two vertices per store
+				const __m128i xy = _mm_or_si128(qx, _mm_slli_epi32(qy, 16));
+				const __m128i zn = _mm_or_si128(qz, _mm_slli_epi32(qn, 16));
+				__m128i* out = reinterpret_cast<__m128i*>(vertices + i);
+				_mm_stream_si128(out, _mm_unpacklo_epi32(xy, zn));
+				_mm_stream_si128(out + 1, _mm_unpackhi_epi32(xy, zn));
+			}
+		}
+#endif
+		for (; i < end; i++)
+		{
+			QuantizedVertex& v = vertices[i];
+			v.Position[0] = static_cast<uint16_t>(Quantize(m_posX[i], min.x, scale[0]));
+			v.Position[1] = static_cast<uint16_t>(Quantize(m_posY[i], min.y, scale[1]));
+			v.Position[2] = static_cast<uint16_t>(Quantize(m_posZ[i], min.z, scale[2]));
+			v.Normal = static_cast<uint16_t>(PackOctahedral(m_normalX[i], m_normalY[i], m_normalZ[i]));
+		}
+		if (stream)
+			Simd::StreamFence();
+	});
+}
+
+void ClothMesh::ParallelRows(ThreadPool* pool, const ThreadPool::RangeJob& job) const
+{
+	//bands start on multiples of m_rowGrain, which picks their scratch
+	if (pool)
+		pool->ParallelFor(m_height, m_rowGrain, job);
+	else
+		job(0, m_height);
+}
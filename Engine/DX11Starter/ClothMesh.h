@@ -0,0 +1,99 @@
+#pragma once
+#include <stdint.h>
+#include <vector>
+#include "ParticleSystem.h"
+#include "ThreadPool.h"
+#include "Vertex.h"
+
+// --------------------------------------------------------
+// Triangle mesh of a cloth grid, for rendering
+//
+// Every grid quad is split into two triangles along the same
+// diagonal. Update takes the cloth's (interpolated) positions into
+// SoA streams and gives every vertex the normalized sum of the up to
+// six face normals around it.
+//
+// It runs as a single pass over bands of rows on the thread pool.
+// Each row is interpolated, the face normals of the quads above it
+// go into a two-row rolling buffer and the row is gathered from it
+// right away, so faces never go out to memory and positions are
+// still in cache when the faces read them. The rows just outside a
+// band are interpolated into the band's own scratch, so bands never
+// read what another one writes. Faces off the grid are zero, which
+// keeps the gather free of edge cases. The bounding box is gathered
+// per band in the same pass, while each row is still in cache.
+// --------------------------------------------------------
+class ClothMesh
+{
+public:
+	ClothMesh();
+
+	//triangle list for a width x height grid, 6 indices per quad
+	static void BuildIndices(uint32_t width, uint32_t height, std::vector<uint32_t>& indices);
+	//grid uvs, the part of the vertices that never changes
+	static void BuildStaticVertices(uint32_t width, uint32_t height, std::vector<StaticVertex>& vertices);
+
+	//positions between the cloth's last two steps (see GetInterpolatedPos), then
+	//normals; follows the cloth's SIMD setting, both paths give the same results
+	void Update(const ParticleSystem& cloth, float alpha, ThreadPool* pool);
+	//interleave positions and packed normals into GetVertexCount vertices in
+	//one pass; 16 byte aligned memory (a mapped vertex buffer) gets non-temporal
+	//stores, since nothing on the CPU reads it back
+	void WriteVertices(DynamicVertex* vertices, ThreadPool* pool) const;
+	//same, but positions quantized to 16 bits inside GetBounds and octahedral
+	//normals, half the bytes; bounds gets what the vertex shader decodes with
+	void WriteQuantizedVertices(QuantizedVertex* vertices, QuantizationBounds& bounds, ThreadPool* pool) const;
+
+	uint32_t GetVertexCount() const { return m_width * m_height; }
+	const float* GetNormalX() const { return m_normalX.data(); }
+	const float* GetNormalY() const { return m_normalY.data(); }
+	const float* GetNormalZ() const { return m_normalZ.data(); }
+	//box around the positions of the last Update
+	const XMFLOAT3& GetBoundsMin() const { return m_boundsMin; }
+	const XMFLOAT3& GetBoundsMax() const { return m_boundsMax; }
+
+private:
+	//rows of vertices handed to a thread at once, about PARALLEL_GRAIN vertices
+	static const uint32_t PARALLEL_GRAIN = 2048;
+
+	//one row of positions, or of one face normal of a row of quads
+	struct Row
+	{
+		float* x;
+		float* y;
+		float* z;
+	};
+	//both face normals of a row of quads, with a zero quad in front
+	//and behind so the vertices on the sides can gather like the rest
+	struct FaceRow
+	{
+		Row face0;
+		Row face1;
+	};
+
+	uint32_t m_width;
+	uint32_t m_height;
+	uint32_t m_rowGrain;
+	bool m_useSimd;
+	std::vector<float> m_posX;
+	std::vector<float> m_posY;
+	std::vector<float> m_posZ;
+	std::vector<float> m_normalX;
+	std::vector<float> m_normalY;
+	std::vector<float> m_normalZ;
+	//per band: the rows above and below it, then two face rows
+	std::vector<float> m_scratch;
+	//per band: min xyz, max xyz of its own rows
+	std::vector<float> m_bandBounds;
+	XMFLOAT3 m_boundsMin;
+	XMFLOAT3 m_boundsMax;
+
+	void Resize(uint32_t width, uint32_t height);
+	void UpdateRows(const ParticleSystem& cloth, float alpha, uint32_t rowBegin, uint32_t rowEnd);
+	void FaceNormals(const Row& top, const Row& bottom, const FaceRow& faces) const;
+	void ZeroFaces(const FaceRow& faces) const;
+	void RowBounds(const Row& row, float* bounds) const;
+	void VertexNormals(uint32_t row, const FaceRow& above, const FaceRow& below);
+	void ParallelRows(ThreadPool* pool, const ThreadPool::RangeJob& job) const;
+};
+
@@ -0,0 +1,220 @@
+#include "ClothSelfCollision.h"
+#include <math.h>
+
+ClothSelfCollision::ClothSelfCollision()
+{
+	m_thickness = 0.0f;
+	m_skipGridNeighbours = true;
+	m_tableBits = BUCKET_BITS;
+}
+
+void ClothSelfCollision::Run(ThreadPool* pool, uint32_t count, uint32_t grain, const ThreadPool::RangeJob& job)
+{
+	if (pool)
+		pool->ParallelFor(count, grain, job);
+	else
+		job(0, count);
+}
+
+void ClothSelfCollision::CellCoords(float x, float y, float z, int32_t& cx, int32_t& cy, int32_t& cz) const
+{
+	const float invCell = 1.0f / m_thickness;
+	cx = static_cast<int32_t>(floorf(x * invCell));
+	cy = static_cast<int32_t>(floorf(y * invCell));
+	cz = static_cast<int32_t>(floorf(z * invCell));
+}
+
+uint32_t ClothSelfCollision::HashCell(int32_t cx, int32_t cy, int32_t cz) const
+{
+	uint32_t h = (static_cast<uint32_t>(cx) * 92837111u) ^ (static_cast<uint32_t>(cy) * 689287499u) ^ (static_cast<uint32_t>(cz) * 283923481u);
+	return h & ((1u << m_tableBits) - 1);
+}
+
+void ClothSelfCollision::Build(const ParticleStreams& s, uint32_t count, ThreadPool* pool)
+{
+	//table of at least 2n cells keeps the chains short
+	m_tableBits = BUCKET_BITS;
+	while ((1u << m_tableBits) < 2 * count)
+		m_tableBits++;
+	const uint32_t tableSize = 1u << m_tableBits;
+	const uint32_t bucketShift = m_tableBits - BUCKET_BITS;
+	const uint32_t chunks = (count + GRAIN - 1) / GRAIN;
+
+	m_particleCell.resize(count);
+	m_bucketSorted.resize(count);
+	m_sortedIds.resize(count);
+	m_cellStart.resize(tableSize + 1);
+	m_bucketStart.resize(BUCKET_COUNT + 1);
+	m_chunkBucketCounts.assign(chunks * BUCKET_COUNT, 0);
+
+	//hash every particle and count it into its chunk's coarse buckets
+	Run(pool, chunks, 1, [&](uint32_t begin, uint32_t end) {
+		for (uint32_t c = begin; c < end; c++)
+		{
+			uint32_t* counts = &m_chunkBucketCounts[c * BUCKET_COUNT];
+			const uint32_t last = (c + 1) * GRAIN < count ? (c + 1) * GRAIN : count;
+			for (uint32_t i = c * GRAIN; i < last; i++)
+			{
+				int32_t cx, cy, cz;
+				CellCoords(s.posX[i], s.posY[i], s.posZ[i], cx, cy, cz);
+				uint32_t cell = HashCell(cx, cy, cz);
+				m_particleCell[i] = cell;
+				counts[cell >> bucketShift]++;
+			}
+		}
+	});
+
+	//exclusive scan in bucket-major, chunk-minor order, so the scatter is stable
+	uint32_t running = 0;
+	for (uint32_t b = 0; b < BUCKET_COUNT; b++)
+	{
+		m_bucketStart[b] = running;
+		for (uint32_t c = 0; c < chunks; c++)
+		{
+			uint32_t n = m_chunkBucketCounts[c * BUCKET_COUNT + b];
+			m_chunkBucketCounts[c * BUCKET_COUNT + b] = running;
+			running += n;
+		}
+	}
+	m_bucketStart[BUCKET_COUNT] = running;
+
+	Run(pool, chunks, 1, [&](uint32_t begin, uint32_t end) {
+		for (uint32_t c = begin; c < end; c++)
+		{
+			uint32_t* offsets = &m_chunkBucketCounts[c * BUCKET_COUNT];
+			const uint32_t last = (c + 1) * GRAIN < count ? (c + 1) * GRAIN : count;
+			for (uint32_t i = c * GRAIN; i < last; i++)
+			{
+				m_bucketSorted[offsets[m_particleCell[i] >> bucketShift]++] = i;
+			}
+		}
+	});
+
+	//each bucket owns a disjoint run of cells, sort it into them
+	const uint32_t cellsPerBucket = tableSize / BUCKET_COUNT;
+	Run(pool, BUCKET_COUNT, 16, [&](uint32_t begin, uint32_t end) {
+		for (uint32_t b = begin; b < end; b++)
+		{
+			const uint32_t firstCell = b * cellsPerBucket;
+			const uint32_t lastCell = firstCell + cellsPerBucket;
+			for (uint32_t cell = firstCell; cell < lastCell; cell++)
+			{
+				m_cellStart[cell] = 0;
+			}
+			for (uint32_t k = m_bucketStart[b]; k < m_bucketStart[b + 1]; k++)
+			{
+				m_cellStart[m_particleCell[m_bucketSorted[k]]]++;
+			}
+			//inclusive scan gives each cell's end; filling backwards walks it
+			//back down to the cell's start and keeps the order stable
+			uint32_t offset = m_bucketStart[b];
+			for (uint32_t cell = firstCell; cell < lastCell; cell++)
+			{
+				offset += m_cellStart[cell];
+				m_cellStart[cell] = offset;
+			}
+			for (uint32_t k = m_bucketStart[b + 1]; k > m_bucketStart[b]; k--)
+			{
+				uint32_t id = m_bucketSorted[k - 1];
+				m_sortedIds[--m_cellStart[m_particleCell[id]]] = id;
+			}
+		}
+	});
+	m_cellStart[tableSize] = count;
+}
+
+void ClothSelfCollision::Solve(const ParticleStreams& s, const float* invMass, uint32_t count, uint32_t width, ThreadPool* pool)
+{
+	m_deltaX.resize(count);
+	m_deltaY.resize(count);
+	m_deltaZ.resize(count);
+	const float thickness = m_thickness;
+	const float thickness2 = thickness * thickness;
+
+	Run(pool, count, GRAIN, [&](uint32_t begin, uint32_t end) {
+		for (uint32_t i = begin; i < end; i++)
+		{
+			const float wi = invMass[i];
+			if (wi == 0.0f)
+			{
+				m_deltaX[i] = 0.0f;
+				m_deltaY[i] = 0.0f;
+				m_deltaZ[i] = 0.0f;
+				continue;
+			}
+			const float px = s.posX[i];
+			const float py = s.posY[i];
+			const float pz = s.posZ[i];
+			const int32_t gx = static_cast<int32_t>(i % width);
+			const int32_t gz = static_cast<int32_t>(i / width);
+			int32_t cx, cy, cz;
+			CellCoords(px, py, pz, cx, cy, cz);
+
+			float dx = 0.0f;
+			float dy = 0.0f;
+			float dz = 0.0f;
+			//neighbouring cells can hash to the same slot, visit each slot once
+			uint32_t visited[27];
+			uint32_t visitedCount = 0;
+			for (int32_t ox = -1; ox <= 1; ox++)
+			{
+				for (int32_t oy = -1; oy <= 1; oy++)
+				{
+					for (int32_t oz = -1; oz <= 1; oz++)
+					{
+						uint32_t cell = HashCell(cx + ox, cy + oy, cz + oz);
+						bool seen = false;
+						for (uint32_t v = 0; v < visitedCount; v++)
+						{
+							seen = seen || visited[v] == cell;
+						}
+						if (seen)
+							continue;
+						visited[visitedCount++] = cell;
+
+						for (uint32_t k = m_cellStart[cell]; k < m_cellStart[cell + 1]; k++)
+						{
+							uint32_t j = m_sortedIds[k];
+							if (j == i)
+								continue;
+							if (m_skipGridNeighbours)
+							{
+								int32_t ngx = static_cast<int32_t>(j % width) - gx;
+								int32_t ngz = static_cast<int32_t>(j / width) - gz;
+								if (ngx >= -1 && ngx <= 1 && ngz >= -1 && ngz <= 1)
+									continue;
+							}
+
+							float ex = px - s.posX[j];
+							float ey = py - s.posY[j];
+							float ez = pz - s.posZ[j];
+							float dist2 = ex * ex + ey * ey + ez * ez;
+							if (dist2 >= thickness2 || dist2 == 0.0f)
+								continue;
+
+							//each side moves its inverse mass share of the overlap,
+							//so against a pinned or sleeping particle i takes all of it
+							float dist = sqrtf(dist2);
+							float push = wi / (wi + invMass[j]) * (thickness - dist) / dist;
+							dx += ex * push;
+							dy += ey * push;
+							dz += ez * push;
+						}
+					}
+				}
+			}
+			m_deltaX[i] = dx;
+			m_deltaY[i] = dy;
+			m_deltaZ[i] = dz;
+		}
+	});
+
+	Run(pool, count, GRAIN, [&](uint32_t begin, uint32_t end) {
+		for (uint32_t i = begin; i < end; i++)
+		{
+			s.posX[i] += m_deltaX[i];
+			s.posY[i] += m_deltaY[i];
+			s.posZ[i] += m_deltaZ[i];
+		}
+	});
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include <stdint.h>
+#include <vector>
+#include "ClothKernels.h"
+#include "ThreadPool.h"
+
+// --------------------------------------------------------
+// Particle-particle self-collision for one cloth
+//
+// Particles are binned into a uniform grid of cells of size
+// thickness, hashed into a table of at least 2x the particle count,
+// so rebuilding and querying stay O(n). The table is rebuilt every
+// step with a stable two-level counting sort: chunks first scatter
+// into 256 coarse buckets, then every bucket is sorted into its own
+// cells. Both levels run in parallel and give the same order for
+// any thread count.
+//
+// The solve is Jacobi style: each particle sums the pushes from its
+// neighbours into a separate buffer, then all of them are applied,
+// so no two threads ever write the same particle.
+// --------------------------------------------------------
+class ClothSelfCollision
+{
+public:
+	ClothSelfCollision();
+
+	//minimum distance kept between any two particles, also the cell size
+	void SetThickness(float thickness) { m_thickness = thickness; }
+	float GetThickness() const { return m_thickness; }
+	//cheap mode: ignore the 8 grid neighbours, the sticks already hold them apart
+	void SetSkipGridNeighbours(bool skip) { m_skipGridNeighbours = skip; }
+
+	//rebuild the hash grid from the current positions
+	void Build(const ParticleStreams& s, uint32_t count, ThreadPool* pool);
+	//push overlapping particles apart, split by inverse mass so pinned and sleeping
+	//particles (0) hold; width is the cloth's row length
+	void Solve(const ParticleStreams& s, const float* invMass, uint32_t count, uint32_t width, ThreadPool* pool);
+
+private:
+	static const uint32_t BUCKET_BITS = 8;
+	static const uint32_t BUCKET_COUNT = 1 << BUCKET_BITS;
+	//fixed chunking keeps the sort order independent of the thread count
+	static const uint32_t GRAIN = 4096;
+
+	float m_thickness;
+	bool m_skipGridNeighbours;
+	uint32_t m_tableBits;
+
+	std::vector<uint32_t> m_particleCell;
+	std::vector<uint32_t> m_chunkBucketCounts;
+	std::vector<uint32_t> m_bucketStart;
+	std::vector<uint32_t> m_bucketSorted;
+	std::vector<uint32_t> m_cellStart;
+	std::vector<uint32_t> m_sortedIds;
+	std::vector<float> m_deltaX;
+	std::vector<float> m_deltaY;
+	std::vector<float> m_deltaZ;
+
+	uint32_t HashCell(int32_t cx, int32_t cy, int32_t cz) const;
+	void CellCoords(float x, float y, float z, int32_t& cx, int32_t& cy, int32_t& cz) const;
+	static void Run(ThreadPool* pool, uint32_t count, uint32_t grain, const ThreadPool::RangeJob& job);
+};
+
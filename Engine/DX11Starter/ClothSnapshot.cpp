@@ -0,0 +1,227 @@
+#include "ClothSnapshot.h"
+#include <string.h>
+
+namespace
+{
+	const uint32_t SNAPSHOT_MAGIC = 0x4e534c43; //"CLSN"
+	const uint32_t REPLAY_MAGIC = 0x52534c43; //"CLSR"
+	const uint32_t FILE_VERSION = 1;
+	//the record carries a new edge constraint
+	const uint32_t RECORD_EDGE = 1;
+
+	struct FileHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint32_t stateSize;
+	};
+
+	struct RecordHeader
+	{
+		float dt;
+		uint32_t flags;
+	};
+
+	bool WriteState(FILE* file, uint32_t magic, const ParticleSystem& cloth)
+	{
+		std::vector<uint8_t> state;
+		cloth.SaveState(state);
+		FileHeader header;
+		header.magic = magic;
+		header.version = FILE_VERSION;
+		header.stateSize = static_cast<uint32_t>(state.size());
+		return fwrite(&header, sizeof(header), 1, file) == 1 &&
+			fwrite(state.data(), state.size(), 1, file) == 1;
+	}
+
+	//bytes from the read position to the end of the file
+	long RemainingBytes(FILE* file)
+	{
+		const long position = ftell(file);
+		if (position < 0 || fseek(file, 0, SEEK_END) != 0)
+			return -1;
+		const long end = ftell(file);
+		if (fseek(file, position, SEEK_SET) != 0)
+			return -1;
+		return end - position;
+	}
+
+	bool ReadState(FILE* file, uint32_t magic, ParticleSystem& cloth)
+	{
+		FileHeader header;
+		if (fread(&header, sizeof(header), 1, file) != 1 || header.magic != magic || header.version != FILE_VERSION)
+			return false;
+		//a corrupt size must not get to allocate, the blob can't be longer than the file
+		const long remaining = RemainingBytes(file);
+		if (remaining < 0 || header.stateSize > static_cast<unsigned long>(remaining))
+			return false;
+		std::vector<uint8_t> state(header.stateSize);
+		if (fread(state.data(), state.size(), 1, file) != 1)
+			return false;
+		return cloth.RestoreState(state.data(), state.size());
+	}
+}
+
+bool WriteClothSnapshot(const char* path, const ParticleSystem& cloth)
+{
+	FILE* file = fopen(path, "wb");
+	if (!file)
+		return false;
+	bool ok = WriteState(file, SNAPSHOT_MAGIC, cloth);
+	ok = fclose(file) == 0 && ok;
+	return ok;
+}
+
+bool ReadClothSnapshot(const char* path, ParticleSystem& cloth)
+{
+	FILE* file = fopen(path, "rb");
+	if (!file)
+		return false;
+	bool ok = ReadState(file, SNAPSHOT_MAGIC, cloth);
+	fclose(file);
+	return ok;
+}
+
+uint64_t HashClothPositions(const ParticleSystem& cloth)
+{
+	uint64_t hash = 14695981039346656037ull;
+	for (uint32_t i = 0; i < cloth.GetParticleCount(); i++)
+	{
+		XMFLOAT3 p = cloth.GetParticlesPos(i);
+		uint8_t bytes[sizeof(p)];
+		memcpy(bytes, &p, sizeof(p));
+		for (size_t b = 0; b < sizeof(bytes); b++)
+		{
+			hash ^= bytes[b];
+			hash *= 1099511628211ull;
+		}
+	}
+	return hash;
+}
+
+ClothRecorder::ClothRecorder()
+{
+	m_file = nullptr;
+	m_cloth = nullptr;
+	m_steps = 0;
+}
+
+ClothRecorder::~ClothRecorder()
+{
+	Close();
+}
+
+bool ClothRecorder::Open(const char* path, ParticleSystem& cloth)
+{
+	Close();
+	m_file = fopen(path, "wb");
+	if (!m_file)
+		return false;
+	if (!WriteState(m_file, REPLAY_MAGIC, cloth))
+	{
+		Close();
+		return false;
+	}
+	m_cloth = &cloth;
+	m_lastEdge.clear();
+	m_steps = 0;
+	cloth.SetRecorder(this);
+	return true;
+}
+
+void ClothRecorder::Close()
+{
+	if (m_cloth)
+		m_cloth->SetRecorder(nullptr);
+	m_cloth = nullptr;
+	if (m_file)
+		fclose(m_file);
+	m_file = nullptr;
+}
+
+void ClothRecorder::BeginStep(const ParticleSystem& cloth, float dt)
+{
+	//the edge is the only input that changes between steps, and mostly it doesn't
+	const XMFLOAT3* edge = cloth.GetEdge();
+	const size_t edgeBytes = sizeof(XMFLOAT3) * cloth.GetEdgeCount();
+	RecordHeader record;
+	record.dt = dt;
+	record.flags = 0;
+	if (m_lastEdge.size() != cloth.GetEdgeCount() || memcmp(m_lastEdge.data(), edge, edgeBytes) != 0)
+	{
+		m_lastEdge.assign(edge, edge + cloth.GetEdgeCount());
+		record.flags |= RECORD_EDGE;
+	}
+	fwrite(&record, sizeof(record), 1, m_file);
+	if (record.flags & RECORD_EDGE)
+		fwrite(edge, edgeBytes, 1, m_file);
+}
+
+void ClothRecorder::EndStep(const ParticleSystem& cloth)
+{
+	uint64_t hash = HashClothPositions(cloth);
+	fwrite(&hash, sizeof(hash), 1, m_file);
+	//every whole record reaches the file, so a crash can only cut the step in flight
+	fflush(m_file);
+	m_steps++;
+}
+
+ClothReplay::ClothReplay()
+{
+	m_file = nullptr;
+	m_steps = 0;
+	m_firstMismatch = NO_MISMATCH;
+}
+
+ClothReplay::~ClothReplay()
+{
+	Close();
+}
+
+bool ClothReplay::Open(const char* path, ParticleSystem& cloth)
+{
+	Close();
+	m_file = fopen(path, "rb");
+	if (!m_file)
+		return false;
+	if (!ReadState(m_file, REPLAY_MAGIC, cloth))
+	{
+		Close();
+		return false;
+	}
+	m_edge.resize(cloth.GetEdgeCount());
+	m_steps = 0;
+	m_firstMismatch = NO_MISMATCH;
+	return true;
+}
+
+void ClothReplay::Close()
+{
+	if (m_file)
+		fclose(m_file);
+	m_file = nullptr;
+}
+
+bool ClothReplay::Step(ParticleSystem& cloth)
+{
+	if (!m_file)
+		return false;
+
+	//a partial record at the end is a stream cut short, stop before it
+	RecordHeader record;
+	uint64_t hash;
+	if (fread(&record, sizeof(record), 1, m_file) != 1)
+		return false;
+	if ((record.flags & RECORD_EDGE) && fread(m_edge.data(), sizeof(XMFLOAT3) * m_edge.size(), 1, m_file) != 1)
+		return false;
+	if (fread(&hash, sizeof(hash), 1, m_file) != 1)
+		return false;
+
+	if (record.flags & RECORD_EDGE)
+		memcpy(cloth.GetEdge(), m_edge.data(), sizeof(XMFLOAT3) * m_edge.size());
+	cloth.Update(record.dt);
+	if (m_firstMismatch == NO_MISMATCH && HashClothPositions(cloth) != hash)
+		m_firstMismatch = m_steps;
+	m_steps++;
+	return true;
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+#include "ParticleSystem.h"
+
+// --------------------------------------------------------
+// Cloth state files and replay streams
+//
+// A snapshot file holds one ParticleSystem::SaveState blob, so a
+// cloth can start from a settled pose instead of simulating its way
+// there on every launch.
+//
+// A replay stream starts with the same blob and then appends one
+// record per Update: the step length, the edge constraint whenever
+// it changed, and a hash of the positions the step produced. Played
+// back on a cloth set up the same way (size, solver, colliders, pool
+// settings) it re-runs the exact same steps and reports the first
+// one whose result differs, so simulation regressions can be
+// bisected offline. A stream cut short by a crash stays readable up
+// to its last whole record.
+//
+// Everything is written in the host's byte order.
+// --------------------------------------------------------
+
+bool WriteClothSnapshot(const char* path, const ParticleSystem& cloth);
+//false (and the cloth untouched) when the file is missing or doesn't fit the cloth
+bool ReadClothSnapshot(const char* path, ParticleSystem& cloth);
+//FNV-1a over the bit patterns of every particle position
+uint64_t HashClothPositions(const ParticleSystem& cloth);
+
+class ClothRecorder
+{
+public:
+	ClothRecorder();
+	~ClothRecorder();
+
+	//start a new stream from the cloth's current state and record its Updates
+	//until Close, which has to happen before the cloth is destroyed
+	bool Open(const char* path, ParticleSystem& cloth);
+	void Close();
+	bool IsOpen() const { return m_file != nullptr; }
+	uint32_t GetStepCount() const { return m_steps; }
+
+	//called by ParticleSystem::Update around every step
+	void BeginStep(const ParticleSystem& cloth, float dt);
+	void EndStep(const ParticleSystem& cloth);
+
+private:
+	FILE* m_file;
+	ParticleSystem* m_cloth;
+	std::vector<XMFLOAT3> m_lastEdge;
+	uint32_t m_steps;
+
+	ClothRecorder(const ClothRecorder&);
+	ClothRecorder& operator=(const ClothRecorder&);
+};
+
+class ClothReplay
+{
+public:
+	static const uint32_t NO_MISMATCH = UINT32_MAX;
+
+	ClothReplay();
+	~ClothReplay();
+
+	//load the stream's starting state into the cloth
+	bool Open(const char* path, ParticleSystem& cloth);
+	void Close();
+	bool IsOpen() const { return m_file != nullptr; }
+	//apply the next recorded edge and Update the cloth; false at the end of the stream
+	bool Step(ParticleSystem& cloth);
+	uint32_t GetStepCount() const { return m_steps; }
+	//first step whose positions differ from the recording
+	uint32_t GetFirstMismatch() const { return m_firstMismatch; }
+
+private:
+	FILE* m_file;
+	std::vector<XMFLOAT3> m_edge;
+	uint32_t m_steps;
+	uint32_t m_firstMismatch;
+
+	ClothReplay(const ClothReplay&);
+	ClothReplay& operator=(const ClothReplay&);
+};
+
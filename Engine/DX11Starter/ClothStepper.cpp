@@ -0,0 +1,114 @@
+#include "ClothStepper.h"
+
+ClothStepper::ClothStepper(ClothWorld* world)
+{
+	m_world = world;
+	m_back = 0;
+	m_front = 1;
+	m_ready = 2;
+	m_newest = 2;
+	m_published = 0;
+	m_pendingDt = 0.0f;
+	m_hasWork = false;
+	m_busy = false;
+	m_quit = false;
+	m_thread = std::thread(&ClothStepper::WorkerMain, this);
+}
+
+ClothStepper::~ClothStepper()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+		m_quit = true;
+	}
+	m_wake.notify_all();
+	m_thread.join();
+}
+
+uint32_t ClothStepper::Track(ClothHandle handle)
+{
+	//the worker reads the list while it runs a frame
+	Wait();
+	m_handles.push_back(handle);
+	return static_cast<uint32_t>(m_handles.size()) - 1;
+}
+
+void ClothStepper::Submit(float dt, const InputJob& job)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+		m_pendingDt += dt;
+		m_pendingJob = job;
+		m_hasWork = true;
+	}
+	m_wake.notify_one();
+}
+
+const ClothFrame* ClothStepper::Acquire()
+{
+	//hand our frame back for the worker to reuse and take the newest one
+	if (m_ready.load(std::memory_order_acquire) & FRESH)
+		m_front = m_ready.exchange(m_front, std::memory_order_acq_rel) & SLOT_MASK;
+	const ClothFrame& frame = m_frames[m_front];
+	return frame.sequence > 0 ? &frame : nullptr;
+}
+
+void ClothStepper::Wait()
+{
+	std::unique_lock<std::mutex> lock(m_lock);
+	m_idle.wait(lock, [this] { return !m_hasWork && !m_busy; });
+}
+
+void ClothStepper::WorkerMain()
+{
+	while (true)
+	{
+		float dt;
+		InputJob job;
+		{
+			std::unique_lock<std::mutex> lock(m_lock);
+			m_wake.wait(lock, [this] { return m_quit || m_hasWork; });
+			if (m_quit)
+				return;
+			dt = m_pendingDt;
+			job.swap(m_pendingJob);
+			m_pendingDt = 0.0f;
+			m_hasWork = false;
+			m_busy = true;
+		}
+
+		RunFrame(dt, job);
+
+		{
+			std::lock_guard<std::mutex> lock(m_lock);
+			m_busy = false;
+		}
+		m_idle.notify_all();
+	}
+}
+
+void ClothStepper::RunFrame(float dt, const InputJob& job)
+{
+	if (job)
+		job(dt);
+	ClothFrame& frame = m_frames[m_back];
+	frame.steps = m_world->Advance(dt);
+
+	const float alpha = m_world->GetInterpolationAlpha();
+	const ClothFrame& newest = m_frames[m_newest];
+	frame.meshes.resize(m_handles.size());
+	for (size_t i = 0; i < m_handles.size(); i++)
+	{
+		//a destroyed cloth keeps its last mesh: the back frame holds the one from
+		//three frames ago, so it is copied over from the newest frame instead
+		const ParticleSystem* cloth = m_world->GetCloth(m_handles[i]);
+		if (cloth)
+			frame.meshes[i].Update(*cloth, alpha, m_world->GetThreadPool());
+		else if (m_published > 0 && i < newest.meshes.size())
+			frame.meshes[i] = newest.meshes[i];
+	}
+	frame.sequence = ++m_published;
+
+	m_newest = m_back;
+	m_back = m_ready.exchange(m_back | FRESH, std::memory_order_acq_rel) & SLOT_MASK;
+}
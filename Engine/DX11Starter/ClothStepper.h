@@ -0,0 +1,90 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "ClothMesh.h"
+#include "ClothWorld.h"
+
+//what the render thread gets to draw: the tracked cloths as of one finished frame
+struct ClothFrame
+{
+	ClothFrame() : sequence(0), steps(0) {}
+	//render meshes in ClothStepper::Track order
+	std::vector<ClothMesh> meshes;
+	//frames published so far, this one included
+	uint64_t sequence;
+	//simulation steps run for this frame
+	uint32_t steps;
+};
+
+// --------------------------------------------------------
+// Steps a ClothWorld on its own thread, a frame ahead of rendering
+//
+// Submit hands the frame time to the worker, which runs the input
+// job (moving pinned edges, colliders) and then Advances the world,
+// so nothing else touches the cloths while they step. It then builds
+// the render mesh of every tracked cloth into the back one of three
+// frames and publishes it with a single atomic exchange. Acquire
+// swaps the newest published frame to the front the same way and
+// never blocks, so the render thread draws frame N while the worker
+// steps N + 1, and frame time is the longer of the two instead of
+// their sum. Submitting while the worker is still busy adds the time
+// to the next frame it runs, and only the latest input job runs.
+// --------------------------------------------------------
+class ClothStepper
+{
+public:
+	//runs on the worker with the time the frame advances by
+	typedef std::function<void(float dt)> InputJob;
+
+	//the world belongs to the worker from now on; only touch it after Wait
+	ClothStepper(ClothWorld* world);
+	~ClothStepper();
+
+	//add a cloth to every frame from now on, returns its index in ClothFrame::meshes
+	uint32_t Track(ClothHandle handle);
+	void Submit(float dt, const InputJob& job);
+	//newest finished frame, nullptr before the first one; stays valid and
+	//unchanged until the next Acquire
+	const ClothFrame* Acquire();
+	//block until the worker has run everything submitted so far
+	void Wait();
+
+private:
+	//frame index in the low bits, set once the worker published it
+	static const uint32_t SLOT_MASK = 3;
+	static const uint32_t FRESH = 4;
+
+	ClothWorld* m_world;
+	std::vector<ClothHandle> m_handles;
+	ClothFrame m_frames[3];
+	//owned by the worker, the reader and neither, in that order
+	uint32_t m_back;
+	uint32_t m_front;
+	std::atomic<uint32_t> m_ready;
+	//the frame the worker published last, only written by the worker; nobody
+	//writes to it until it comes back as m_back
+	uint32_t m_newest;
+	uint64_t m_published;
+
+	std::mutex m_lock;
+	std::condition_variable m_wake;
+	std::condition_variable m_idle;
+	float m_pendingDt;
+	InputJob m_pendingJob;
+	bool m_hasWork;
+	bool m_busy;
+	bool m_quit;
+	std::thread m_thread;
+
+	void WorkerMain();
+	void RunFrame(float dt, const InputJob& job);
+
+	ClothStepper(const ClothStepper&);
+	ClothStepper& operator=(const ClothStepper&);
+};
+
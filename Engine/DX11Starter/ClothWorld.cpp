@@ -0,0 +1,264 @@
+#include "ClothWorld.h"
+#include <algorithm>
+#include <math.h>
+#include <new>
+
+const float ClothWorld::DEFAULT_FIXED_STEP = 1.0f / 60.0f;
+
+ClothWorld::ClothWorld(ThreadPool* threadPool)
+{
+	m_threadPool = threadPool;
+	m_liveCount = 0;
+	m_liveParticles = 0;
+	m_pool = nullptr;
+	m_poolCapacity = 0;
+	m_poolUsed = 0;
+	m_groupsDirty = true;
+	m_fixedStep = DEFAULT_FIXED_STEP;
+	m_maxSteps = DEFAULT_MAX_STEPS;
+	m_accumulator = 0.0f;
+}
+
+ClothWorld::~ClothWorld()
+{
+	for (size_t i = 0; i < m_slots.size(); i++)
+	{
+		if (m_slots[i].cloth) delete m_slots[i].cloth;
+	}
+	if (m_pool) Simd::AlignedFree(m_pool);
+}
+
+ClothHandle ClothWorld::CreateCloth(uint32_t width, uint32_t height, uint32_t iterations)
+{
+	size_t offset = Allocate(ParticleSystem::GetStorageSize(width, height));
+	return AddCloth(new ParticleSystem(width, height, iterations, m_pool + offset), offset);
+}
+
+void ClothWorld::DestroyCloth(ClothHandle handle)
+{
+	ParticleSystem* cloth = GetCloth(handle);
+	if (!cloth)
+		return;
+
+	Slot& slot = m_slots[handle.index];
+	m_liveCount--;
+	m_liveParticles -= cloth->GetParticleCount();
+	delete cloth;
+	slot.cloth = nullptr;
+	slot.generation++;
+	slot.storageSize = 0;
+	m_freeSlots.push_back(handle.index);
+	m_groupsDirty = true;
+}
+
+ParticleSystem* ClothWorld::GetCloth(ClothHandle handle) const
+{
+	if (handle.index >= m_slots.size())
+		return nullptr;
+	const Slot& slot = m_slots[handle.index];
+	return slot.generation == handle.generation ? slot.cloth : nullptr;
+}
+
+void ClothWorld::Update(float dt)
+{
+	Step(dt, true);
+}
+
+void ClothWorld::SetFixedTimestep(float step, uint32_t maxSteps)
+{
+	m_fixedStep = step;
+	m_maxSteps = maxSteps > 0 ? maxSteps : 1;
+	m_accumulator = 0.0f;
+}
+
+// --------------------------------------------------------
+// Fixed-step scheduler. Every step has the same length, so the
+// Verlet integration behaves the same at any frame rate, and a
+// frame may run no step at all when the sim rate is below the
+// render rate. After a spike at most m_maxSteps are run and the
+// rest of the backlog is dropped, so one slow frame can't snowball
+// into ever longer ones.
+// --------------------------------------------------------
+uint32_t ClothWorld::Advance(float frameDt)
+{
+	m_accumulator += frameDt;
+	uint32_t steps = static_cast<uint32_t>(m_accumulator / m_fixedStep);
+	if (steps > m_maxSteps)
+	{
+		steps = m_maxSteps;
+		m_accumulator = fmodf(m_accumulator, m_fixedStep);
+	}
+	else
+	{
+		m_accumulator -= steps * m_fixedStep;
+	}
+	if (m_accumulator < 0.0f)
+		m_accumulator = 0.0f;
+
+	//only the last step's start is needed for interpolation
+	for (uint32_t i = 0; i < steps; i++)
+	{
+		Step(m_fixedStep, i + 1 == steps);
+	}
+	return steps;
+}
+
+// --------------------------------------------------------
+// Steps every cloth. Each task runs one group of cloths back to
+// back; a cloth big enough to be split uses the pool itself, and
+// ParallelFor nests, so idle workers steal its chunks.
+// --------------------------------------------------------
+void ClothWorld::Step(float dt, bool saveStepStart)
+{
+	if (m_groupsDirty)
+		RebuildGroups();
+	m_colliders.Update();
+
+	const uint32_t groupCount = static_cast<uint32_t>(m_groups.size()) - 1;
+	ThreadPool::RangeJob job = [this, dt, saveStepStart](uint32_t begin, uint32_t end) {
+		for (uint32_t g = begin; g < end; g++)
+		{
+			for (uint32_t i = m_groups[g]; i < m_groups[g + 1]; i++)
+			{
+				ParticleSystem* cloth = m_slots[m_order[i]].cloth;
+				if (saveStepStart)
+					cloth->SaveStepStart();
+				cloth->Update(dt);
+			}
+		}
+	};
+
+	if (m_threadPool)
+		m_threadPool->ParallelFor(groupCount, 1, job);
+	else
+		job(0, groupCount);
+}
+
+// --------------------------------------------------------
+// Reserves floats in the shared pool and returns their offset.
+// Offsets stay multiples of 8 floats, so every block is 32 byte
+// aligned like the pool itself.
+// --------------------------------------------------------
+size_t ClothWorld::Allocate(size_t floats)
+{
+	floats = (floats + 7) & ~static_cast<size_t>(7);
+	if (m_poolUsed + floats > m_poolCapacity)
+	{
+		//compact the live cloths, and only grow (geometrically) when that isn't
+		//enough, so create/destroy churn over a steady live set stays put
+		size_t live = 0;
+		for (size_t i = 0; i < m_slots.size(); i++)
+		{
+			live += m_slots[i].storageSize;
+		}
+		size_t capacity = m_poolCapacity;
+		if (capacity < live + floats)
+			capacity = std::max(m_poolCapacity * 2, live + floats);
+		Repack(capacity);
+	}
+
+	size_t offset = m_poolUsed;
+	m_poolUsed += floats;
+	return offset;
+}
+
+// --------------------------------------------------------
+// Packs every live cloth front to back in their current memory
+// order, into a new pool of the given capacity or, when that is
+// the current one, in place (blocks only ever move down)
+// --------------------------------------------------------
+void ClothWorld::Repack(size_t capacity)
+{
+	const bool inPlace = m_pool && capacity == m_poolCapacity;
+	float* pool = inPlace ? m_pool : static_cast<float*>(Simd::AlignedAlloc(sizeof(float) * capacity));
+	if (!pool)
+		throw std::bad_alloc();
+
+	std::vector<uint32_t> order;
+	for (uint32_t i = 0; i < m_slots.size(); i++)
+	{
+		if (m_slots[i].cloth) order.push_back(i);
+	}
+	std::sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+		return m_slots[a].storageOffset < m_slots[b].storageOffset;
+	});
+
+	size_t used = 0;
+	for (size_t i = 0; i < order.size(); i++)
+	{
+		Slot& slot = m_slots[order[i]];
+		slot.cloth->RelocateStorage(pool + used);
+		slot.storageOffset = used;
+		used += slot.storageSize;
+	}
+
+	if (m_pool && !inPlace) Simd::AlignedFree(m_pool);
+	m_pool = pool;
+	m_poolCapacity = capacity;
+	m_poolUsed = used;
+	m_groupsDirty = true;
+}
+
+ClothHandle ClothWorld::AddCloth(ParticleSystem* cloth, size_t storageOffset)
+{
+	cloth->SetThreadPool(m_threadPool);
+	cloth->SetColliders(&m_colliders);
+	cloth->Init();
+
+	uint32_t index;
+	if (!m_freeSlots.empty())
+	{
+		index = m_freeSlots.back();
+		m_freeSlots.pop_back();
+	}
+	else
+	{
+		index = static_cast<uint32_t>(m_slots.size());
+		Slot slot;
+		slot.generation = 0;
+		m_slots.push_back(slot);
+	}
+
+	Slot& slot = m_slots[index];
+	slot.cloth = cloth;
+	slot.storageOffset = storageOffset;
+	slot.storageSize = (ParticleSystem::GetStorageSize(cloth->GetWidth(), cloth->GetHeight()) + 7) & ~static_cast<size_t>(7);
+	m_liveCount++;
+	m_liveParticles += cloth->GetParticleCount();
+	m_groupsDirty = true;
+	return ClothHandle(index, slot.generation);
+}
+
+// --------------------------------------------------------
+// Walks the live cloths in memory order and cuts them into groups
+// of about GROUP_PARTICLES particles. A large cloth gets a group to
+// itself.
+// --------------------------------------------------------
+void ClothWorld::RebuildGroups()
+{
+	m_order.clear();
+	for (uint32_t i = 0; i < m_slots.size(); i++)
+	{
+		if (m_slots[i].cloth) m_order.push_back(i);
+	}
+	std::sort(m_order.begin(), m_order.end(), [this](uint32_t a, uint32_t b) {
+		return m_slots[a].storageOffset < m_slots[b].storageOffset;
+	});
+
+	m_groups.clear();
+	m_groups.push_back(0);
+	uint32_t groupParticles = 0;
+	for (uint32_t i = 0; i < m_order.size(); i++)
+	{
+		uint32_t particles = m_slots[m_order[i]].cloth->GetParticleCount();
+		if (groupParticles > 0 && groupParticles + particles > GROUP_PARTICLES)
+		{
+			m_groups.push_back(i);
+			groupParticles = 0;
+		}
+		groupParticles += particles;
+	}
+	if (m_groups.back() != m_order.size())
+		m_groups.push_back(static_cast<uint32_t>(m_order.size()));
+	m_groupsDirty = false;
+}
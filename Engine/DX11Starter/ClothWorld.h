@@ -0,0 +1,116 @@
+#pragma once
+#include <stdint.h>
+#include <vector>
+#include "ParticleSystem.h"
+#include "ThreadPool.h"
+#include "Colliders.h"
+
+// --------------------------------------------------------
+// Handle to a cloth owned by a ClothWorld
+//
+// The generation is bumped every time a slot is reused, so a
+// handle to a destroyed cloth resolves to nullptr instead of
+// to whatever took its place.
+// --------------------------------------------------------
+struct ClothHandle
+{
+	uint32_t index;
+	uint32_t generation;
+
+	ClothHandle() : index(UINT32_MAX), generation(0) {}
+	ClothHandle(uint32_t Index, uint32_t Generation) : index(Index), generation(Generation) {}
+	bool IsValid() const { return index != UINT32_MAX; }
+};
+
+// --------------------------------------------------------
+// Owns and steps every cloth in the scene
+//
+// All particle streams are carved out of one shared aligned pool,
+// so many small cloths sit next to each other in memory. Update
+// steps every cloth in one go: small cloths are packed into groups
+// of roughly GROUP_PARTICLES particles and the groups are spread
+// over the thread pool, while big cloths additionally split their
+// own work across it.
+// --------------------------------------------------------
+class ClothWorld
+{
+public:
+	//target particle count per task when packing small cloths together
+	static const uint32_t GROUP_PARTICLES = 4096;
+	static const float DEFAULT_FIXED_STEP;
+	static const uint32_t DEFAULT_MAX_STEPS = 4;
+
+	ClothWorld(ThreadPool* threadPool = nullptr);
+	~ClothWorld();
+
+	ClothHandle CreateCloth(uint32_t width, uint32_t height, uint32_t iterations = ParticleSystem::DEFAULT_ITERATIONS);
+	//compile-time sized cloth, see FixedParticleSystem
+	template<uint32_t W, uint32_t H, uint32_t Iterations>
+	ClothHandle CreateFixedCloth()
+	{
+		size_t offset = Allocate(ParticleSystem::GetStorageSize(W, H));
+		return AddCloth(new FixedParticleSystem<W, H, Iterations>(m_pool + offset), offset);
+	}
+	void DestroyCloth(ClothHandle handle);
+
+	//nullptr for stale or invalid handles
+	ParticleSystem* GetCloth(ClothHandle handle) const;
+	//colliders every cloth in the world collides with
+	ColliderSet& GetColliders() { return m_colliders; }
+	//pool the cloths run on, nullptr when they run on the calling thread
+	ThreadPool* GetThreadPool() const { return m_threadPool; }
+
+	//one step of dt, however long it is
+	void Update(float dt);
+	//fixed-step mode: Advance runs as many steps of step seconds as the
+	//elapsed time calls for, but never more than maxSteps per call
+	void SetFixedTimestep(float step, uint32_t maxSteps = DEFAULT_MAX_STEPS);
+	float GetFixedTimestep() const { return m_fixedStep; }
+	//add frameDt to the accumulator and step it down, returns the steps run
+	uint32_t Advance(float frameDt);
+	//how far render time is past the last step, 0..1, for GetInterpolatedPos
+	float GetInterpolationAlpha() const { return m_accumulator / m_fixedStep; }
+
+	uint32_t GetClothCount() const { return m_liveCount; }
+	uint32_t GetParticleCount() const { return m_liveParticles; }
+
+private:
+	struct Slot
+	{
+		ParticleSystem* cloth;
+		uint32_t generation;
+		size_t storageOffset;
+		size_t storageSize;
+	};
+
+	ThreadPool* m_threadPool;
+	ColliderSet m_colliders;
+	std::vector<Slot> m_slots;
+	std::vector<uint32_t> m_freeSlots;
+	uint32_t m_liveCount;
+	uint32_t m_liveParticles;
+
+	//shared particle storage, sub-allocated front to back
+	float* m_pool;
+	size_t m_poolCapacity;
+	size_t m_poolUsed;
+
+	//[begin, end) ranges of m_order handed to one task each
+	std::vector<uint32_t> m_order;
+	std::vector<uint32_t> m_groups;
+	bool m_groupsDirty;
+
+	float m_fixedStep;
+	uint32_t m_maxSteps;
+	float m_accumulator;
+
+	size_t Allocate(size_t floats);
+	void Repack(size_t capacity);
+	ClothHandle AddCloth(ParticleSystem* cloth, size_t storageOffset);
+	void RebuildGroups();
+	void Step(float dt, bool saveStepStart);
+
+	ClothWorld(const ClothWorld&);
+	ClothWorld& operator=(const ClothWorld&);
+};
+
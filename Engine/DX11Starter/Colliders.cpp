@@ -0,0 +1,349 @@
+#include "Colliders.h"
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+namespace
+{
+	//P * M, row-vector convention
+	XMFLOAT3 TransformPoint(const XMFLOAT4X4& m, const XMFLOAT3& p)
+	{
+		return XMFLOAT3(
+			p.x * m.m[0][0] + p.y * m.m[1][0] + p.z * m.m[2][0] + m.m[3][0],
+			p.x * m.m[0][1] + p.y * m.m[1][1] + p.z * m.m[2][1] + m.m[3][1],
+			p.x * m.m[0][2] + p.y * m.m[1][2] + p.z * m.m[2][2] + m.m[3][2]);
+	}
+
+	XMFLOAT3 TransformVector(const XMFLOAT4X4& m, const XMFLOAT3& v)
+	{
+		return XMFLOAT3(
+			v.x * m.m[0][0] + v.y * m.m[1][0] + v.z * m.m[2][0],
+			v.x * m.m[0][1] + v.y * m.m[1][1] + v.z * m.m[2][1],
+			v.x * m.m[0][2] + v.y * m.m[1][2] + v.z * m.m[2][2]);
+	}
+
+	//v rotated by the unit quaternion q
+	XMFLOAT3 Rotate(const XMFLOAT4& q, const XMFLOAT3& v)
+	{
+		//t = 2 * cross(q.xyz, v), v' = v + q.w * t + cross(q.xyz, t)
+		const float tx = 2.0f * (q.y * v.z - q.z * v.y);
+		const float ty = 2.0f * (q.z * v.x - q.x * v.z);
+		const float tz = 2.0f * (q.x * v.y - q.y * v.x);
+		return XMFLOAT3(
+			v.x + q.w * tx + (q.y * tz - q.z * ty),
+			v.y + q.w * ty + (q.z * tx - q.x * tz),
+			v.z + q.w * tz + (q.x * ty - q.y * tx));
+	}
+
+	float Length(const XMFLOAT3& v)
+	{
+		return sqrtf(v.x * v.x + v.y * v.y + v.z * v.z);
+	}
+
+	float MaxScale(const XMFLOAT4X4& m)
+	{
+		float sx = Length(XMFLOAT3(m.m[0][0], m.m[0][1], m.m[0][2]));
+		float sy = Length(XMFLOAT3(m.m[1][0], m.m[1][1], m.m[1][2]));
+		float sz = Length(XMFLOAT3(m.m[2][0], m.m[2][1], m.m[2][2]));
+		return fmaxf(sx, fmaxf(sy, sz));
+	}
+
+	XMFLOAT4X4 Identity()
+	{
+		XMFLOAT4X4 m;
+		for (int r = 0; r < 4; r++)
+		{
+			for (int c = 0; c < 4; c++)
+			{
+				m.m[r][c] = r == c ? 1.0f : 0.0f;
+			}
+		}
+		return m;
+	}
+}
+
+ColliderSet::ColliderSet()
+{
+	m_bias = 0.010f;
+}
+
+uint32_t ColliderSet::AddSphere(const XMFLOAT3& center, float radius)
+{
+	Shape shape = {};
+	shape.type = ColliderType::Sphere;
+	shape.center = center;
+	shape.radius = radius;
+	return AddShape(shape);
+}
+
+uint32_t ColliderSet::AddCapsule(const XMFLOAT3& a, const XMFLOAT3& b, float radius)
+{
+	Shape shape = {};
+	shape.type = ColliderType::Capsule;
+	shape.center = a;
+	shape.end = b;
+	shape.radius = radius;
+	return AddShape(shape);
+}
+
+uint32_t ColliderSet::AddPlane(const XMFLOAT3& normal, float offset)
+{
+	Shape shape = {};
+	shape.type = ColliderType::Plane;
+	float length = Length(normal);
+	shape.normal = XMFLOAT3(normal.x / length, normal.y / length, normal.z / length);
+	shape.radius = offset;
+	return AddShape(shape);
+}
+
+uint32_t ColliderSet::AddBox(const XMFLOAT3& center, const XMFLOAT3& halfExtents, const XMFLOAT4& rotation)
+{
+	Shape shape = {};
+	shape.type = ColliderType::Box;
+	shape.center = center;
+	shape.halfExtents = halfExtents;
+	shape.rotation = rotation;
+	return AddShape(shape);
+}
+
+uint32_t ColliderSet::AddShape(const Shape& shape)
+{
+	Shape added = shape;
+	added.active = true;
+	added.transform = Identity();
+	added.dirty = true;
+	added.baked = false;
+
+	uint32_t id;
+	if (!m_freeIds.empty())
+	{
+		id = m_freeIds.back();
+		m_freeIds.pop_back();
+		m_shapes[id] = added;
+	}
+	else
+	{
+		id = static_cast<uint32_t>(m_shapes.size());
+		m_shapes.push_back(added);
+	}
+	return id;
+}
+
+void ColliderSet::RemoveCollider(uint32_t id)
+{
+	if (id >= m_shapes.size() || !m_shapes[id].active)
+		return;
+	m_shapes[id].active = false;
+	if (m_shapes[id].baked)
+		m_removedBounds.push_back(m_shapes[id].bakedBounds);
+	m_freeIds.push_back(id);
+}
+
+void ColliderSet::Clear()
+{
+	for (size_t i = 0; i < m_shapes.size(); i++)
+	{
+		if (m_shapes[i].active && m_shapes[i].baked)
+			m_removedBounds.push_back(m_shapes[i].bakedBounds);
+	}
+	m_shapes.clear();
+	m_freeIds.clear();
+	m_bounded.clear();
+	m_planes.clear();
+}
+
+void ColliderSet::SetTransform(uint32_t id, const XMFLOAT4X4& world)
+{
+	//entities push their transform every frame, only a real change counts as a move
+	Shape& shape = m_shapes[id];
+	if (memcmp(&shape.transform, &world, sizeof(XMFLOAT4X4)) == 0)
+		return;
+	shape.transform = world;
+	shape.dirty = true;
+}
+
+void ColliderSet::Update()
+{
+	m_bounded.clear();
+	m_planes.clear();
+	m_movedBounds.swap(m_removedBounds);
+	m_removedBounds.clear();
+	for (size_t i = 0; i < m_shapes.size(); i++)
+	{
+		Shape& source = m_shapes[i];
+		if (!source.active)
+			continue;
+		WorldShape shape;
+		Bake(source, shape);
+		if (source.dirty)
+		{
+			if (source.baked)
+				m_movedBounds.push_back(source.bakedBounds);
+			source.bakedBounds.min = shape.boundsMin;
+			source.bakedBounds.max = shape.boundsMax;
+			source.baked = true;
+			source.dirty = false;
+			m_movedBounds.push_back(source.bakedBounds);
+		}
+		if (shape.type == ColliderType::Plane)
+			m_planes.push_back(shape);
+		else
+			m_bounded.push_back(shape);
+	}
+}
+
+// --------------------------------------------------------
+// Moves a shape into world space, folds the bias into its size
+// and computes its world bounds
+// --------------------------------------------------------
+void ColliderSet::Bake(const Shape& shape, WorldShape& out) const
+{
+	const XMFLOAT4X4& m = shape.transform;
+	out.type = shape.type;
+	out.invLength2 = 0.0f;
+
+	switch (shape.type)
+	{
+	case ColliderType::Sphere:
+	case ColliderType::Capsule:
+	{
+		out.center = TransformPoint(m, shape.center);
+		out.end = shape.type == ColliderType::Capsule ? TransformPoint(m, shape.end) : out.center;
+		out.radius = shape.radius * MaxScale(m) + m_bias;
+		const XMFLOAT3 ab(out.end.x - out.center.x, out.end.y - out.center.y, out.end.z - out.center.z);
+		const float length2 = ab.x * ab.x + ab.y * ab.y + ab.z * ab.z;
+		//a zero length capsule is a sphere, t then stays 0
+		out.invLength2 = length2 > 0.0f ? 1.0f / length2 : 0.0f;
+		out.boundsMin = XMFLOAT3(fminf(out.center.x, out.end.x) - out.radius, fminf(out.center.y, out.end.y) - out.radius, fminf(out.center.z, out.end.z) - out.radius);
+		out.boundsMax = XMFLOAT3(fmaxf(out.center.x, out.end.x) + out.radius, fmaxf(out.center.y, out.end.y) + out.radius, fmaxf(out.center.z, out.end.z) + out.radius);
+		break;
+	}
+	case ColliderType::Plane:
+	{
+		XMFLOAT3 normal = TransformVector(m, shape.normal);
+		float length = Length(normal);
+		out.axes[0] = XMFLOAT3(normal.x / length, normal.y / length, normal.z / length);
+		const XMFLOAT3 point = TransformPoint(m, XMFLOAT3(shape.normal.x * shape.radius, shape.normal.y * shape.radius, shape.normal.z * shape.radius));
+		//the bias moves the plane out along its normal
+		out.radius = point.x * out.axes[0].x + point.y * out.axes[0].y + point.z * out.axes[0].z + m_bias;
+		out.boundsMin = XMFLOAT3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+		out.boundsMax = XMFLOAT3(FLT_MAX, FLT_MAX, FLT_MAX);
+		break;
+	}
+	case ColliderType::Box:
+	{
+		out.center = TransformPoint(m, shape.center);
+		const float he[3] = { shape.halfExtents.x, shape.halfExtents.y, shape.halfExtents.z };
+		const XMFLOAT3 unit[3] = { XMFLOAT3(1.0f, 0.0f, 0.0f), XMFLOAT3(0.0f, 1.0f, 0.0f), XMFLOAT3(0.0f, 0.0f, 1.0f) };
+		float worldHe[3];
+		for (int k = 0; k < 3; k++)
+		{
+			XMFLOAT3 axis = TransformVector(m, Rotate(shape.rotation, unit[k]));
+			float length = Length(axis);
+			out.axes[k] = XMFLOAT3(axis.x / length, axis.y / length, axis.z / length);
+			worldHe[k] = he[k] * length + m_bias;
+		}
+		out.halfExtents = XMFLOAT3(worldHe[0], worldHe[1], worldHe[2]);
+		//extent along each world axis of the rotated box
+		float extent[3];
+		for (int c = 0; c < 3; c++)
+		{
+			extent[c] = 0.0f;
+			for (int k = 0; k < 3; k++)
+			{
+				const float* axis = &out.axes[k].x;
+				extent[c] += fabsf(axis[c]) * worldHe[k];
+			}
+		}
+		out.boundsMin = XMFLOAT3(out.center.x - extent[0], out.center.y - extent[1], out.center.z - extent[2]);
+		out.boundsMax = XMFLOAT3(out.center.x + extent[0], out.center.y + extent[1], out.center.z + extent[2]);
+		break;
+	}
+	}
+}
+
+void ColliderSet::CollideShape(const WorldShape& shape, const ParticleStreams& s, uint32_t begin, uint32_t end, bool useSimd)
+{
+	switch (shape.type)
+	{
+	case ColliderType::Sphere:
+		ClothKernels::SphereConstraint(s, begin, end, shape.center, shape.radius, useSimd);
+		break;
+	case ColliderType::Capsule:
+		ClothKernels::CapsuleConstraint(s, begin, end, shape.center, shape.end, shape.invLength2, shape.radius, useSimd);
+		break;
+	case ColliderType::Plane:
+		ClothKernels::PlaneConstraint(s, begin, end, shape.axes[0], shape.radius, useSimd);
+		break;
+	case ColliderType::Box:
+		ClothKernels::BoxConstraint(s, begin, end, shape.center, shape.axes, shape.halfExtents);
+		break;
+	}
+}
+
+// --------------------------------------------------------
+// Broadphase and narrowphase over [begin, end)
+//
+// A shape only moves particles onto its own surface, which lies in
+// its bounds, so after a hit the block's bounds are grown by the
+// shape's bounds instead of being measured again. The result is the
+// same as testing every particle against every shape, just without
+// the shapes the block never comes near.
+// --------------------------------------------------------
+void ColliderSet::Collide(const ParticleStreams& s, uint32_t begin, uint32_t end, bool useSimd) const
+{
+	for (uint32_t blockBegin = begin; blockBegin < end; blockBegin += BLOCK_SIZE)
+	{
+		const uint32_t blockEnd = end - blockBegin > BLOCK_SIZE ? blockBegin + BLOCK_SIZE : end;
+
+		if (!m_bounded.empty())
+		{
+			float minX = FLT_MAX, minY = FLT_MAX, minZ = FLT_MAX;
+			float maxX = -FLT_MAX, maxY = -FLT_MAX, maxZ = -FLT_MAX;
+			uint32_t i = blockBegin;
+			if (useSimd)
+			{
+				Simd::Float vMinX = Simd::Set1(FLT_MAX), vMinY = Simd::Set1(FLT_MAX), vMinZ = Simd::Set1(FLT_MAX);
+				Simd::Float vMaxX = Simd::Set1(-FLT_MAX), vMaxY = Simd::Set1(-FLT_MAX), vMaxZ = Simd::Set1(-FLT_MAX);
+				const uint32_t simdEnd = blockBegin + Simd::AlignDown(blockEnd - blockBegin);
+				for (; i < simdEnd; i += Simd::WIDTH)
+				{
+					Simd::Float px = Simd::LoadU(s.posX + i);
+					Simd::Float py = Simd::LoadU(s.posY + i);
+					Simd::Float pz = Simd::LoadU(s.posZ + i);
+					vMinX = Simd::Min(vMinX, px); vMaxX = Simd::Max(vMaxX, px);
+					vMinY = Simd::Min(vMinY, py); vMaxY = Simd::Max(vMaxY, py);
+					vMinZ = Simd::Min(vMinZ, pz); vMaxZ = Simd::Max(vMaxZ, pz);
+				}
+				minX = Simd::ReduceMin(vMinX); maxX = Simd::ReduceMax(vMaxX);
+				minY = Simd::ReduceMin(vMinY); maxY = Simd::ReduceMax(vMaxY);
+				minZ = Simd::ReduceMin(vMinZ); maxZ = Simd::ReduceMax(vMaxZ);
+			}
+			for (; i < blockEnd; i++)
+			{
+				minX = fminf(minX, s.posX[i]); maxX = fmaxf(maxX, s.posX[i]);
+				minY = fminf(minY, s.posY[i]); maxY = fmaxf(maxY, s.posY[i]);
+				minZ = fminf(minZ, s.posZ[i]); maxZ = fmaxf(maxZ, s.posZ[i]);
+			}
+
+			for (size_t k = 0; k < m_bounded.size(); k++)
+			{
+				const WorldShape& shape = m_bounded[k];
+				if (shape.boundsMin.x > maxX || shape.boundsMax.x < minX ||
+					shape.boundsMin.y > maxY || shape.boundsMax.y < minY ||
+					shape.boundsMin.z > maxZ || shape.boundsMax.z < minZ)
+					continue;
+
+				CollideShape(shape, s, blockBegin, blockEnd, useSimd);
+				minX = fminf(minX, shape.boundsMin.x); maxX = fmaxf(maxX, shape.boundsMax.x);
+				minY = fminf(minY, shape.boundsMin.y); maxY = fmaxf(maxY, shape.boundsMax.y);
+				minZ = fminf(minZ, shape.boundsMin.z); maxZ = fmaxf(maxZ, shape.boundsMax.z);
+			}
+		}
+
+		for (size_t k = 0; k < m_planes.size(); k++)
+		{
+			CollideShape(m_planes[k], s, blockBegin, blockEnd, useSimd);
+		}
+	}
+}
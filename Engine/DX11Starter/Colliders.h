@@ -0,0 +1,122 @@
+#pragma once
+#include <DirectXMath.h>
+#include <stdint.h>
+#include <vector>
+#include "ClothKernels.h"
+
+using namespace DirectX;
+
+enum class ColliderType
+{
+	Sphere,
+	Capsule,
+	//infinite half space, particles are kept on the side the normal points to
+	Plane,
+	//oriented box
+	Box
+};
+
+// --------------------------------------------------------
+// Set of collision shapes the cloths are kept out of
+//
+// Shapes are described in local space and placed in the world by
+// an optional transform (e.g. an Entities world matrix), so they
+// can follow moving objects. Update bakes every shape into world
+// space and bounds once per frame; Collide then walks the particles
+// in blocks of BLOCK_SIZE, tests the block's bounds against every
+// shape's bounds and only runs the narrowphase for the shapes the
+// block touches. Planes have no bounds and are applied to every
+// block after the bounded shapes.
+// --------------------------------------------------------
+class ColliderSet
+{
+public:
+	//particles per broadphase block
+	static const uint32_t BLOCK_SIZE = 64;
+
+	struct Bounds
+	{
+		XMFLOAT3 min;
+		XMFLOAT3 max;
+	};
+
+	ColliderSet();
+
+	uint32_t AddSphere(const XMFLOAT3& center, float radius);
+	uint32_t AddCapsule(const XMFLOAT3& a, const XMFLOAT3& b, float radius);
+	//half space dot(P, normal) >= offset
+	uint32_t AddPlane(const XMFLOAT3& normal, float offset);
+	//rotation is a unit quaternion
+	uint32_t AddBox(const XMFLOAT3& center, const XMFLOAT3& halfExtents, const XMFLOAT4& rotation = XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f));
+	//ids of removed colliders are reused by later Adds
+	void RemoveCollider(uint32_t id);
+	void Clear();
+
+	//local to world transform in DirectXMath row-vector layout (not transposed
+	//for HLSL); scale is assumed uniform for spheres, capsules and planes
+	void SetTransform(uint32_t id, const XMFLOAT4X4& world);
+	//extra distance kept from every surface
+	void SetBias(float bias) { m_bias = bias; }
+	float GetBias() const { return m_bias; }
+	uint32_t GetColliderCount() const { return static_cast<uint32_t>(m_shapes.size() - m_freeIds.size()); }
+
+	//bake the world-space shapes and bounds, call once after moving colliders
+	void Update();
+	//push particles [begin, end) out of every collider
+	void Collide(const ParticleStreams& s, uint32_t begin, uint32_t end, bool useSimd) const;
+	//space swept by colliders that were added, moved or removed since the
+	//previous Update, old and new bounds each; used to wake sleeping cloth
+	const std::vector<Bounds>& GetMovedBounds() const { return m_movedBounds; }
+
+private:
+	//shape as it was added
+	struct Shape
+	{
+		ColliderType type;
+		bool active;
+		//sphere/box centre, capsule end a
+		XMFLOAT3 center;
+		//capsule end b
+		XMFLOAT3 end;
+		//plane normal
+		XMFLOAT3 normal;
+		XMFLOAT3 halfExtents;
+		XMFLOAT4 rotation;
+		//sphere/capsule radius, plane offset
+		float radius;
+		XMFLOAT4X4 transform;
+		//changed since the last Update
+		bool dirty;
+		//bounds of the last bake, invalid until the first one
+		bool baked;
+		Bounds bakedBounds;
+	};
+	//shape baked into world space with the bias applied
+	struct WorldShape
+	{
+		ColliderType type;
+		XMFLOAT3 center;
+		XMFLOAT3 end;
+		//box axes, plane normal in axes[0]
+		XMFLOAT3 axes[3];
+		XMFLOAT3 halfExtents;
+		//sphere/capsule radius, plane offset
+		float radius;
+		float invLength2;
+		XMFLOAT3 boundsMin;
+		XMFLOAT3 boundsMax;
+	};
+
+	float m_bias;
+	std::vector<Shape> m_shapes;
+	std::vector<uint32_t> m_freeIds;
+	std::vector<WorldShape> m_bounded;
+	std::vector<WorldShape> m_planes;
+	std::vector<Bounds> m_movedBounds;
+	std::vector<Bounds> m_removedBounds;
+
+	uint32_t AddShape(const Shape& shape);
+	void Bake(const Shape& shape, WorldShape& out) const;
+	static void CollideShape(const WorldShape& shape, const ParticleStreams& s, uint32_t begin, uint32_t end, bool useSimd);
+};
+
@@ -0,0 +1,171 @@
+#include "EmitterWorld.h"
+#include <algorithm>
+
+EmitterWorld::EmitterWorld(ThreadPool* threadPool)
+{
+	m_threadPool = threadPool;
+	m_seed = 1;
+	m_sorter.SetThreadPool(threadPool);
+}
+
+EmitterWorld::~EmitterWorld()
+{
+	for (size_t i = 0; i < m_slots.size(); i++)
+	{
+		if (m_slots[i].emitter) delete m_slots[i].emitter;
+	}
+}
+
+EmitterHandle EmitterWorld::CreateEmitter(uint32_t capacity, const EmitterSettings& settings)
+{
+	//every emitter gets its own random sequence, the same from run to run
+	ParticleEmitter* emitter = new ParticleEmitter(capacity, settings, m_seed++ * 2654435761u);
+	emitter->SetThreadPool(m_threadPool);
+
+	uint32_t index;
+	if (!m_freeSlots.empty())
+	{
+		index = m_freeSlots.back();
+		m_freeSlots.pop_back();
+	}
+	else
+	{
+		index = static_cast<uint32_t>(m_slots.size());
+		Slot slot;
+		slot.generation = 0;
+		m_slots.push_back(slot);
+	}
+
+	Slot& slot = m_slots[index];
+	slot.emitter = emitter;
+	m_live.push_back(emitter);
+	return EmitterHandle(index, slot.generation);
+}
+
+void EmitterWorld::DestroyEmitter(EmitterHandle handle)
+{
+	ParticleEmitter* emitter = GetEmitter(handle);
+	if (!emitter)
+		return;
+
+	Slot& slot = m_slots[handle.index];
+	m_live.erase(std::find(m_live.begin(), m_live.end(), emitter));
+	delete emitter;
+	slot.emitter = nullptr;
+	slot.generation++;
+	m_freeSlots.push_back(handle.index);
+}
+
+ParticleEmitter* EmitterWorld::GetEmitter(EmitterHandle handle) const
+{
+	if (handle.index >= m_slots.size())
+		return nullptr;
+	const Slot& slot = m_slots[handle.index];
+	return slot.generation == handle.generation ? slot.emitter : nullptr;
+}
+
+void EmitterWorld::Update(float dt)
+{
+	ParallelEmitters([this, dt](uint32_t begin, uint32_t end) {
+		for (uint32_t e = begin; e < end; e++)
+		{
+			m_live[e]->Update(dt);
+		}
+	});
+}
+
+uint32_t EmitterWorld::WriteBillboards(BillboardVertex* vertices, uint32_t maxParticles, const XMFLOAT3& right, const XMFLOAT3& up) const
+{
+	//4 vertices are 64 bytes, so every emitter starts as aligned as the buffer does
+	std::vector<uint32_t> offsets;
+	const uint32_t written = PackEmitters(maxParticles, offsets);
+	ParallelEmitters([this, vertices, &offsets, &right, &up](uint32_t begin, uint32_t end) {
+		for (uint32_t e = begin; e < end; e++)
+		{
+			if (offsets[e] != UINT32_MAX)
+				m_live[e]->WriteBillboards(vertices + 4 * static_cast<size_t>(offsets[e]), right, up);
+		}
+	});
+	return written;
+}
+
+uint32_t EmitterWorld::WriteSortedIndices(uint32_t* indices, uint32_t maxParticles, const XMFLOAT4X4& view)
+{
+	std::vector<uint32_t> offsets;
+	const uint32_t written = PackEmitters(maxParticles, offsets);
+	m_sortKeys.resize(written);
+	m_sortQuads.resize(written);
+	uint32_t* keys = m_sortKeys.data();
+	uint32_t* quads = m_sortQuads.data();
+	ParallelEmitters([this, keys, quads, &offsets, &view](uint32_t begin, uint32_t end) {
+		for (uint32_t e = begin; e < end; e++)
+		{
+			if (offsets[e] != UINT32_MAX)
+				m_live[e]->WriteDepthKeys(view, offsets[e], keys + offsets[e], quads + offsets[e]);
+		}
+	});
+	m_sorter.Sort(keys, quads, written);
+
+	//corners as in BillboardVertex, both triangles wound the same way
+	ThreadPool::RangeJob writeQuads = [indices, quads](uint32_t begin, uint32_t end) {
+		for (uint32_t j = begin; j < end; j++)
+		{
+			const uint32_t v = 4 * quads[j];
+			uint32_t* q = indices + 6 * static_cast<size_t>(j);
+			q[0] = v;
+			q[1] = v + 2;
+			q[2] = v + 1;
+			q[3] = v + 1;
+			q[4] = v + 2;
+			q[5] = v + 3;
+		}
+	};
+	if (m_threadPool)
+		m_threadPool->ParallelFor(written, ParticleEmitter::PARALLEL_GRAIN, writeQuads);
+	else if (written > 0)
+		writeQuads(0, written);
+	return written;
+}
+
+uint32_t EmitterWorld::GetParticleCount() const
+{
+	uint32_t count = 0;
+	for (size_t e = 0; e < m_live.size(); e++)
+	{
+		count += m_live[e]->GetCount();
+	}
+	return count;
+}
+
+uint32_t EmitterWorld::GetCapacity() const
+{
+	uint32_t capacity = 0;
+	for (size_t e = 0; e < m_live.size(); e++)
+	{
+		capacity += m_live[e]->GetCapacity();
+	}
+	return capacity;
+}
+
+uint32_t EmitterWorld::PackEmitters(uint32_t maxParticles, std::vector<uint32_t>& offsets) const
+{
+	offsets.resize(m_live.size());
+	uint32_t packed = 0;
+	for (size_t e = 0; e < m_live.size(); e++)
+	{
+		const uint32_t count = m_live[e]->GetCount();
+		offsets[e] = count <= maxParticles - packed ? packed : UINT32_MAX;
+		if (offsets[e] != UINT32_MAX)
+			packed += count;
+	}
+	return packed;
+}
+
+void EmitterWorld::ParallelEmitters(const ThreadPool::RangeJob& job) const
+{
+	const uint32_t count = static_cast<uint32_t>(m_live.size());
+	if (m_threadPool && count > 1)
+		m_threadPool->ParallelFor(count, 1, job);
+	else if (count > 0)
+		job(0, count);
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include <stdint.h>
+#include <vector>
+#include "ParticleEmitter.h"
+#include "RadixSort.h"
+#include "ThreadPool.h"
+
+// --------------------------------------------------------
+// Handle to an emitter owned by an EmitterWorld, see ClothHandle
+// --------------------------------------------------------
+struct EmitterHandle
+{
+	uint32_t index;
+	uint32_t generation;
+
+	EmitterHandle() : index(UINT32_MAX), generation(0) {}
+	EmitterHandle(uint32_t Index, uint32_t Generation) : index(Index), generation(Generation) {}
+	bool IsValid() const { return index != UINT32_MAX; }
+};
+
+// --------------------------------------------------------
+// Owns and updates every particle emitter in the scene
+//
+// Update runs one task per emitter on the thread pool; an emitter
+// with more than ParticleEmitter::PARALLEL_GRAIN particles splits
+// its own kernels across the pool too, and ParallelFor nests, so
+// one big emitter and many small ones both keep every core busy.
+// WriteBillboards packs the quads of all emitters back to back
+// into one vertex buffer the same way. For blending that isn't
+// additive, WriteSortedIndices then orders the quads of every
+// emitter together back to front with a radix sort on depth, so
+// only the index buffer is reordered and not the vertices.
+// --------------------------------------------------------
+class EmitterWorld
+{
+public:
+	EmitterWorld(ThreadPool* threadPool = nullptr);
+	~EmitterWorld();
+
+	EmitterHandle CreateEmitter(uint32_t capacity, const EmitterSettings& settings);
+	void DestroyEmitter(EmitterHandle handle);
+	//nullptr for stale or invalid handles
+	ParticleEmitter* GetEmitter(EmitterHandle handle) const;
+	ThreadPool* GetThreadPool() const { return m_threadPool; }
+
+	void Update(float dt);
+	//billboards of every emitter, 4 vertices per particle; emitters that don't
+	//fit in maxParticles are left out, returns the particles written
+	uint32_t WriteBillboards(BillboardVertex* vertices, uint32_t maxParticles, const XMFLOAT3& right, const XMFLOAT3& up) const;
+	//6 indices per particle, two triangles per quad, drawing the quads WriteBillboards
+	//wrote back to front for the camera with the given view matrix; returns the particles
+	uint32_t WriteSortedIndices(uint32_t* indices, uint32_t maxParticles, const XMFLOAT4X4& view);
+
+	uint32_t GetEmitterCount() const { return static_cast<uint32_t>(m_live.size()); }
+	//live particles over all emitters
+	uint32_t GetParticleCount() const;
+	//sum of the emitters' capacities, enough for any WriteBillboards
+	uint32_t GetCapacity() const;
+
+private:
+	struct Slot
+	{
+		ParticleEmitter* emitter;
+		uint32_t generation;
+	};
+
+	ThreadPool* m_threadPool;
+	std::vector<Slot> m_slots;
+	std::vector<uint32_t> m_freeSlots;
+	//live emitters in creation order, the order they are written out in
+	std::vector<ParticleEmitter*> m_live;
+	uint32_t m_seed;
+	RadixSorter m_sorter;
+	std::vector<uint32_t> m_sortKeys;
+	//quad index of each sorted key
+	std::vector<uint32_t> m_sortQuads;
+
+	//where each emitter's quads start in the buffer, UINT32_MAX for those that
+	//don't fit in maxParticles; returns the quads packed
+	uint32_t PackEmitters(uint32_t maxParticles, std::vector<uint32_t>& offsets) const;
+	void ParallelEmitters(const ThreadPool::RangeJob& job) const;
+
+	EmitterWorld(const EmitterWorld&);
+	EmitterWorld& operator=(const EmitterWorld&);
+};
@@ -9,6 +9,11 @@ Entities::Entities(Mesh * Mesh, Material* Material)
 	position = { 1, 1, 0 };
 	scale = { 1, 1, 1 };
 	rotation = { 0, 0, 0 };
+	clothWorld = nullptr;
+	clothAnimation = 0.0f;
+	clothBounds.Min = { 0, 0, 0 };
+	clothBounds.Step = { 0, 0, 0 };
+	colliderSet = nullptr;
 }
 
 void Entities::SetTranslation(float x, float y, float z)
@@ -36,15 +41,17 @@ XMFLOAT4X4 Entities::GetWorldMatrix()
 	return worldMatrix;
 }
 
-void Entities::Draw(ID3D11DeviceContext * context, DXGI_FORMAT format, UINT strideSize)
+void Entities::Draw(ID3D11DeviceContext * context)
 {
-	//UINT stride = sizeof(VertexPosColor);
-	UINT offset = 0;
-
-	ID3D11Buffer* vertexBuffer = mesh->GetVertexBuffer();
-	context->IASetVertexBuffers(0, 1, &vertexBuffer, &strideSize, &offset);
-	context->IASetIndexBuffer(mesh->GetIndexBuffer(), format, 0);
-	//context->IASetIndexBuffer(mesh->GetIndexBuffer(), DXGI_FORMAT_R16_UINT, 0);
+	UINT offsets[2] = { 0, 0 };
+
+	//every stream of the mesh, each with its own stride
+	context->IASetVertexBuffers(0, mesh->GetStreamCount(), mesh->GetVertexBuffers(), mesh->GetStrides(), offsets);
+	//after the material, whose shader set the default layout
+	if (mesh->GetInputLayout())
+		context->IASetInputLayout(mesh->GetInputLayout());
+	//16 or 32 bit, whichever the mesh picked
+	context->IASetIndexBuffer(mesh->GetIndexBuffer(), mesh->GetIndexFormat(), 0);
 	//draw
 	context->DrawIndexed(
 		mesh->GetIndexCount(),
@@ -68,6 +75,12 @@ void Entities::PerpareMaterial(XMFLOAT4X4 view, XMFLOAT4X4 projection)
 	material->GetVertexShader()->SetMatrix4x4("view", view);
 	material->GetVertexShader()->SetMatrix4x4("projection", projection);
 	material->GetVertexShader()->SetMatrix4x4("world", GetWorldMatrix());
+	//decodes the bounds relative positions of the last UpdateCloth
+	if (mesh->IsQuantized())
+	{
+		material->GetVertexShader()->SetFloat3("positionMin", clothBounds.Min);
+		material->GetVertexShader()->SetFloat3("positionStep", clothBounds.Step);
+	}
 	material->GetVertexShader()->SetShader();
 	material->GetVertexShader()->CopyAllBufferData();
 	//set pixel shader
@@ -77,42 +90,69 @@ void Entities::PerpareMaterial(XMFLOAT4X4 view, XMFLOAT4X4 projection)
 	material->GetPixelShader()->SetShader();
 }
 
-void Entities::UpdateCloth(float timer, ID3D11DeviceContext* device, VertexPosColor* vertices)
+void Entities::AnimateCloth(float timer)
 {
+	ParticleSystem* particleSystem = clothWorld ? clothWorld->GetCloth(clothHandle) : nullptr;
+	if (!particleSystem)
+		return;
+
+	//swing the pinned edge, the world steps the cloth afterwards
 	XMFLOAT3* pEdge = particleSystem->GetEdge();
-	static float animationCounter = .0f;
-	for (int32_t ii = 0; ii < 32; ii++)
+	for (uint32_t ii = 0; ii < particleSystem->GetEdgeCount(); ii++)
 	{
-		pEdge[ii].z = 1.f * sinf(animationCounter);
+		pEdge[ii].z = 1.f * sinf(clothAnimation);
 	}
-	animationCounter += .125f * timer;
+	clothAnimation += .125f * timer;
+}
 
-	particleSystem->Update(timer);
+void Entities::UpdateCloth(ID3D11DeviceContext* device, const ClothMesh& clothMesh)
+{
+	if (!clothWorld)
+		return;
 
-	//copy particles pos to vertex pos
 	D3D11_MAPPED_SUBRESOURCE mappedResource;
 	ZeroMemory(&mappedResource, sizeof(D3D11_MAPPED_SUBRESOURCE));
 
 	//disable gpu access to the vertex buffer data
-	device->Map(mesh->GetVertexBuffer(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
+	if (FAILED(device->Map(mesh->GetVertexBuffer(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource)))
+		return;
 
-	uint32_t ii = 0;
-	for (uint32_t zz = 0; zz < 32; zz++) 
-	{
-		for (uint32_t xx = 0; xx < 32; xx++) 
-		{
-			vertices[ii].pos = particleSystem->GetParticlesPos(ii);
-			ii++;
-		}
-	}
-	memcpy(mappedResource.pData, mesh->GetClothVertices(), mesh->GetClothVerticesSize());
+	//straight into the buffer, no staging copy; the pool takes calls from
+	//any thread, so this can share it with the stepping cloth
+	if (mesh->IsQuantized())
+		clothMesh.WriteQuantizedVertices(static_cast<QuantizedVertex*>(mappedResource.pData), clothBounds, clothWorld->GetThreadPool());
+	else
+		clothMesh.WriteVertices(static_cast<DynamicVertex*>(mappedResource.pData), clothWorld->GetThreadPool());
 
 	//reenable GPU access to the vertex buffer data
 	device->Unmap(mesh->GetVertexBuffer(), 0);
 }
 
-void Entities::SetParticleSystem(ParticleSystem * p_System)
+void Entities::SetCloth(ClothWorld* world, ClothHandle handle)
+{
+	clothWorld = world;
+	clothHandle = handle;
+}
+
+void Entities::AttachCollider(ColliderSet* set, uint32_t id)
 {
-	particleSystem = p_System;
+	colliderSet = set;
+	colliderIds.push_back(id);
 }
 
+void Entities::UpdateColliders()
+{
+	if (!colliderSet)
+		return;
+
+	//same matrix as GetWorldMatrix, but not transposed for HLSL
+	XMMATRIX tr = XMMatrixTranslation(position.x, position.y, position.z);
+	XMMATRIX ro = XMMatrixRotationRollPitchYaw(rotation.x, rotation.y, rotation.z);
+	XMMATRIX sc = XMMatrixScaling(scale.x, scale.y, scale.z);
+	XMFLOAT4X4 world;
+	XMStoreFloat4x4(&world, sc * ro * tr);
+	for (size_t i = 0; i < colliderIds.size(); i++)
+	{
+		colliderSet->SetTransform(colliderIds[i], world);
+	}
+}
\ No newline at end of file
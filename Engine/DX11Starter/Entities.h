@@ -4,7 +4,8 @@
 #include "SimpleShader.h"
 #include <DirectXMath.h>
 #include "Material.h"
-#include "ParticleSystem.h"
+#include "ClothWorld.h"
+#include "ClothMesh.h"
 
 using namespace DirectX;
 
@@ -16,13 +17,26 @@ public:
 	void SetRotation(float x, float y, float z);
 	void SetScale(float x, float y, float z);
 	XMFLOAT4X4 GetWorldMatrix();
-	void Draw(ID3D11DeviceContext* context, DXGI_FORMAT format, UINT strideSize);
+	//binds all of the mesh's vertex streams; call after PerpareMaterial
+	void Draw(ID3D11DeviceContext* context);
 	void Move(float totalTime);
 	void PerpareMaterial(XMFLOAT4X4 view, XMFLOAT4X4 projection);
-	void UpdateCloth(float timer, ID3D11DeviceContext* device, VertexPosColor* vertices);
-	void SetParticleSystem(ParticleSystem* p_System);
+	void AnimateCloth(float timer);
+	//upload a finished render mesh of the cloth, see ClothStepper
+	void UpdateCloth(ID3D11DeviceContext* device, const ClothMesh& clothMesh);
+	void SetCloth(ClothWorld* world, ClothHandle handle);
+	//collider that follows this entity's transform
+	void AttachCollider(ColliderSet* set, uint32_t id);
+	//push the current transform to the attached colliders
+	void UpdateColliders();
 private:
-	ParticleSystem* particleSystem;
+	ClothWorld* clothWorld;
+	ClothHandle clothHandle;
+	float clothAnimation;
+	//what the quantized cloth positions were written relative to
+	QuantizationBounds clothBounds;
+	ColliderSet* colliderSet;
+	std::vector<uint32_t> colliderIds;
 	Material* material;
 	Mesh* mesh;
 	XMFLOAT4X4 worldMatrix;
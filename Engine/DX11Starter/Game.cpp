@@ -1,4 +1,5 @@
 #include "Game.h"
+#include <stddef.h>
 #include "Vertex.h"
 #include "WICTextureLoader.h"
 
@@ -25,7 +26,22 @@ Game::Game(HINSTANCE hInstance)
 	vertexBuffer = 0;
 	indexBuffer = 0;
 	vertexShader = 0;
+	quantizedVertexShader = 0;
 	pixelShader = 0;
+	//false uploads full float positions for the cloth
+	quantizeCloth = true;
+	particleVertexShader = 0;
+	particlePixelShader = 0;
+	emitterWorld = 0;
+	particleVertexBuffer = 0;
+	particleIndexBuffer = 0;
+	particleInputLayout = 0;
+	particleBlendState = 0;
+	particleDepthState = 0;
+	particleCount = 0;
+	clothRasterizerState = 0;
+	clothInputLayout = 0;
+	clothStepper = 0;
 
 #if defined(DEBUG) || defined(_DEBUG)
 	// Do we want a console window?  Probably only in debug mode
@@ -47,16 +63,25 @@ Game::~Game()
 	if (vertexBuffer) { vertexBuffer->Release(); }
 	if (indexBuffer) { indexBuffer->Release(); }
 	if (sphere) { delete sphere;  }
+	//the stepper's input job uses the entities and the world, so it stops first
+	if (clothStepper) delete clothStepper;
 	if (cloth) { delete cloth; }
-	if (clothVertices) delete clothVertices;
-	if (clothIndices) delete clothIndices;
-	if (m_particleSystem) delete m_particleSystem;
+	if (clothWorld) delete clothWorld;
+	if (emitterWorld) delete emitterWorld;
+	if (threadPool) delete threadPool;
+	if (particleVertexBuffer) { particleVertexBuffer->Release(); }
+	if (particleIndexBuffer) { particleIndexBuffer->Release(); }
+	if (particleInputLayout) { particleInputLayout->Release(); }
+	if (particleBlendState) { particleBlendState->Release(); }
+	if (particleDepthState) { particleDepthState->Release(); }
 	//release entities 
 	for (int i = 0; i < entityList.size(); i++) {
 		delete entityList[i];
 	}
 	//release texture
 	if (samplerState) { samplerState->Release(); samplerState = 0; }
+	if (clothRasterizerState) { clothRasterizerState->Release(); clothRasterizerState = 0; }
+	if (clothInputLayout) { clothInputLayout->Release(); clothInputLayout = 0; }
 	if (clothTexture) { clothTexture->Release(); clothTexture = 0; }
 	if (wickTexture) { wickTexture->Release(); wickTexture = 0; }
 
@@ -68,7 +93,10 @@ Game::~Game()
 	// Delete our simple shader objects, which
 	// will clean up their own internal DirectX stuff
 	delete vertexShader;
+	delete quantizedVertexShader;
 	delete pixelShader;
+	delete particleVertexShader;
+	delete particlePixelShader;
 }
 
 // --------------------------------------------------------
@@ -83,6 +111,7 @@ void Game::Init()
 	LoadShaders();
 	CreateMatrices();
 	CreateBasicGeometry();
+	CreateParticles();
 	//intialize light
 	light.AmbientColor = XMFLOAT4(.50f, 0.0f, 0.0f, 1.0f);
 	light.DiffuseColor = XMFLOAT4(.50f, 0.0f, 0.0f, 1.0f);
@@ -108,16 +137,28 @@ void Game::Init()
 	samplerDesc.MaxLOD = D3D11_FLOAT32_MAX;
 
 	device->CreateSamplerState(&samplerDesc, &samplerState);
+	//no culling for the cloth, it folds over and shows its back
+	D3D11_RASTERIZER_DESC rasterizerDesc = {};
+	rasterizerDesc.FillMode = D3D11_FILL_SOLID;
+	rasterizerDesc.CullMode = D3D11_CULL_NONE;
+	rasterizerDesc.DepthClipEnable = true;
+	device->CreateRasterizerState(&rasterizerDesc, &clothRasterizerState);
 
 	//intialize materials
 	material = new Material(vertexShader, pixelShader, clothTexture, samplerState);
-	wickMaterial = new Material(vertexShader, pixelShader, wickTexture, samplerState);
+	wickMaterial = new Material(quantizeCloth ? quantizedVertexShader : vertexShader, pixelShader, wickTexture, samplerState);
 	//intialize entities
 	entityList.push_back(new Entities(sphere, material));
 	entityList.push_back(new Entities(cloth, wickMaterial));
 	entityList[0]->SetTranslation(0, 0, 0);
 	entityList[1]->SetTranslation(0, 0, 0);
-	entityList[1]->SetParticleSystem(m_particleSystem);
+	entityList[1]->SetCloth(clothWorld, clothHandle);
+	//the cloth drapes over a collider that follows the sphere entity
+	ColliderSet& colliders = clothWorld->GetColliders();
+	entityList[0]->AttachCollider(&colliders, colliders.AddSphere(XMFLOAT3(0.f, 0.f, 0.f), 0.20f));
+	//from here on the world belongs to the simulation thread
+	clothStepper = new ClothStepper(clothWorld);
+	clothStepper->Track(clothHandle);
 }
 
 // --------------------------------------------------------
@@ -133,6 +174,57 @@ void Game::LoadShaders()
 
 	pixelShader = new SimplePixelShader(device, context);
 	pixelShader->LoadShaderFile(L"PixelShader.cso");
+
+	particleVertexShader = new SimpleVertexShader(device, context);
+	particleVertexShader->LoadShaderFile(L"ParticleVertexShader.cso");
+
+	particlePixelShader = new SimplePixelShader(device, context);
+	particlePixelShader->LoadShaderFile(L"ParticlePixelShader.cso");
+
+	//SV_VertexID isn't a vertex attribute, so the particle layout is built
+	//here instead of from the shader's reflection
+	D3D11_INPUT_ELEMENT_DESC particleLayout[] =
+	{
+		{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, offsetof(BillboardVertex, Position), D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{ "FADE", 0, DXGI_FORMAT_R32_FLOAT, 0, offsetof(BillboardVertex, Fade), D3D11_INPUT_PER_VERTEX_DATA, 0 },
+	};
+	ID3DBlob* particleBlob = 0;
+	if (SUCCEEDED(D3DReadFileToBlob(L"ParticleVertexShader.cso", &particleBlob)))
+	{
+		device->CreateInputLayout(particleLayout, ARRAYSIZE(particleLayout),
+			particleBlob->GetBufferPointer(), particleBlob->GetBufferSize(), &particleInputLayout);
+		particleBlob->Release();
+	}
+
+	//decodes QuantizedVertex positions and normals for the cloth
+	quantizedVertexShader = new SimpleVertexShader(device, context);
+	quantizedVertexShader->LoadShaderFile(L"QuantizedVertexShader.cso");
+
+	//the cloth is fed from two streams: positions and packed normals
+	//rewritten every frame, uvs uploaded once
+	D3D11_INPUT_ELEMENT_DESC clothLayout[] =
+	{
+		{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, offsetof(DynamicVertex, Position), D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{ "NORMAL", 0, DXGI_FORMAT_R8G8B8A8_SNORM, 0, offsetof(DynamicVertex, Normal), D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 1, offsetof(StaticVertex, UV), D3D11_INPUT_PER_VERTEX_DATA, 0 },
+	};
+	//the quantized shader takes position and normal as one uint4
+	D3D11_INPUT_ELEMENT_DESC quantizedClothLayout[] =
+	{
+		{ "POSITION", 0, DXGI_FORMAT_R16G16B16A16_UINT, 0, offsetof(QuantizedVertex, Position), D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 1, offsetof(StaticVertex, UV), D3D11_INPUT_PER_VERTEX_DATA, 0 },
+	};
+	ID3DBlob* shaderBlob = 0;
+	if (SUCCEEDED(D3DReadFileToBlob(quantizeCloth ? L"QuantizedVertexShader.cso" : L"VertexShader.cso", &shaderBlob)))
+	{
+		if (quantizeCloth)
+			device->CreateInputLayout(quantizedClothLayout, ARRAYSIZE(quantizedClothLayout),
+				shaderBlob->GetBufferPointer(), shaderBlob->GetBufferSize(), &clothInputLayout);
+		else
+			device->CreateInputLayout(clothLayout, ARRAYSIZE(clothLayout),
+				shaderBlob->GetBufferPointer(), shaderBlob->GetBufferSize(), &clothInputLayout);
+		shaderBlob->Release();
+	}
 }
 
 
@@ -185,58 +277,99 @@ void Game::CreateMatrices()
 // --------------------------------------------------------
 void Game::CreateBasicGeometry()
 {
-	size_t clothVerticesSize;
-	int clothIndexCount;
-
-	m_particleSystem = new ParticleSystem;
-	m_particleSystem->Init();
+	threadPool = new ThreadPool();
+	clothWorld = new ClothWorld(threadPool);
+	//32x32 is the hot size, so it gets the compile-time specialization;
+	//any other size can use clothWorld->CreateCloth(width, height)
+	clothHandle = clothWorld->CreateFixedCloth<32, 32, ParticleSystem::DEFAULT_ITERATIONS>();
+	ParticleSystem* particleSystem = clothWorld->GetCloth(clothHandle);
 	
-	//const float length = 1.0f;
-	const uint32_t PARTICLE_DIM = 32;
-	//const float size = length / (static_cast<float>(PARTICLE_DIM - 1.0f));
-	clothVertices = new VertexPosColor[PARTICLE_DIM * PARTICLE_DIM];
-	clothVerticesSize = sizeof(VertexPosColor) * (PARTICLE_DIM * PARTICLE_DIM);
-
-	//vertex buffer for cloth
-	uint32_t ii = 0;
-	for (uint32_t zz = 0; zz < PARTICLE_DIM; ++zz) {
-		for (uint32_t xx = 0; xx < PARTICLE_DIM; ++xx) {
-			clothVertices[ii].pos = m_particleSystem->GetParticlesPos(ii);
-			clothVertices[ii].color = XMFLOAT3(1.0f, 1.0f, 1.0f);
-			ii++;
-
-		}
-	}
-	//index buffer for cloth 
-	clothIndexCount = (PARTICLE_DIM - 1) * 2 * (PARTICLE_DIM) * 2;
-	clothIndices = new unsigned short[clothIndexCount];
-	UINT clothIndicesSize = clothIndexCount * sizeof(unsigned short);
-	//index buffer for cloth 
-	//horizontal lines
-	ii = 0;
-	for (uint32_t zz = 0; zz < PARTICLE_DIM; ++zz) {
-		for (uint32_t xx = 0; xx < PARTICLE_DIM - 1; ++xx) {
-			clothIndices[ii++] = xx + zz * PARTICLE_DIM;
-			clothIndices[ii++] = (xx + 1) + zz * PARTICLE_DIM;
-		}
+	const uint32_t clothWidth = particleSystem->GetWidth();
+	const uint32_t clothHeight = particleSystem->GetHeight();
+	const uint32_t clothVertexCount = particleSystem->GetParticleCount();
+	std::vector<StaticVertex> clothStaticVertices;
+	ClothMesh::BuildStaticVertices(clothWidth, clothHeight, clothStaticVertices);
+	//index buffer for cloth, a triangle list, 32 bit so large sheets fit
+	std::vector<uint32_t> triangles;
+	ClothMesh::BuildIndices(clothWidth, clothHeight, triangles);
+	const int clothIndexCount = static_cast<int>(triangles.size());
+
+	//initial contents of the cloth's dynamic stream, it's rewritten in place every frame after
+	ClothMesh clothMesh;
+	clothMesh.Update(*particleSystem, 1.0f, threadPool);
+	if (quantizeCloth)
+	{
+		//the bounds come with every frame the entity uploads
+		std::vector<QuantizedVertex> clothVertices(clothVertexCount);
+		QuantizationBounds bounds;
+		clothMesh.WriteQuantizedVertices(clothVertices.data(), bounds, threadPool);
+		cloth = new Mesh(clothVertices.data(), clothStaticVertices.data(), clothVertexCount, triangles.data(), clothIndexCount, device);
 	}
-	//veritcal lines 
-	for (uint32_t xx = 0; xx < PARTICLE_DIM; ++xx) {
-		for (uint32_t zz = 0; zz < PARTICLE_DIM - 1; ++zz) {
-			clothIndices[ii++] = xx + zz * PARTICLE_DIM;
-			clothIndices[ii++] = xx + (zz + 1) * PARTICLE_DIM;
-		}
+	else
+	{
+		std::vector<DynamicVertex> clothVertices(clothVertexCount);
+		clothMesh.WriteVertices(clothVertices.data(), threadPool);
+		cloth = new Mesh(clothVertices.data(), clothStaticVertices.data(), clothVertexCount, triangles.data(), clothIndexCount, device);
 	}
+	cloth->SetInputLayout(clothInputLayout);
+	sphere = new Mesh("Models/sphere.obj", device, threadPool);
+}
 
-	/*for (int i = 0; i < clothIndexCount; i++){
-		printf("%d ", clothIndices[i]);
-	}*/
 
-	cloth = new Mesh(clothVertices, clothVerticesSize, clothIndices, clothIndicesSize, device);
-	sphere = new Mesh("Models/sphere.obj", device);
+// --------------------------------------------------------
+// Creates the spark emitter, a dynamic vertex buffer with room
+// for all of its billboards and the index buffer for them
+// --------------------------------------------------------
+void Game::CreateParticles()
+{
+	const uint32_t sparkCapacity = 16384;
+
+	emitterWorld = new EmitterWorld(threadPool);
+	EmitterSettings sparks;
+	sparks.position = XMFLOAT3(0.0f, 0.3f, 0.0f);
+	sparks.velocity = XMFLOAT3(0.0f, 2.0f, 0.0f);
+	sparks.spread = 0.8f;
+	sparks.rate = 4000.0f;
+	sparks.minLifetime = 1.0f;
+	sparks.maxLifetime = 2.5f;
+	sparks.drag = 0.5f;
+	sparkHandle = emitterWorld->CreateEmitter(sparkCapacity, sparks);
+
+	D3D11_BUFFER_DESC vbd = {};
+	vbd.Usage = D3D11_USAGE_DYNAMIC;
+	vbd.ByteWidth = sizeof(BillboardVertex) * 4 * sparkCapacity;
+	vbd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+	vbd.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	device->CreateBuffer(&vbd, 0, &particleVertexBuffer);
+
+	//rewritten every frame in back to front order
+	D3D11_BUFFER_DESC ibd = {};
+	ibd.Usage = D3D11_USAGE_DYNAMIC;
+	ibd.ByteWidth = sizeof(uint32_t) * 6 * sparkCapacity;
+	ibd.BindFlags = D3D11_BIND_INDEX_BUFFER;
+	ibd.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	device->CreateBuffer(&ibd, 0, &particleIndexBuffer);
+
+	//premultiplied alpha over what's behind, which is why the quads are sorted;
+	//they don't write depth
+	D3D11_BLEND_DESC blendDesc = {};
+	blendDesc.RenderTarget[0].BlendEnable = TRUE;
+	blendDesc.RenderTarget[0].SrcBlend = D3D11_BLEND_ONE;
+	blendDesc.RenderTarget[0].DestBlend = D3D11_BLEND_INV_SRC_ALPHA;
+	blendDesc.RenderTarget[0].BlendOp = D3D11_BLEND_OP_ADD;
+	blendDesc.RenderTarget[0].SrcBlendAlpha = D3D11_BLEND_ONE;
+	blendDesc.RenderTarget[0].DestBlendAlpha = D3D11_BLEND_INV_SRC_ALPHA;
+	blendDesc.RenderTarget[0].BlendOpAlpha = D3D11_BLEND_OP_ADD;
+	blendDesc.RenderTarget[0].RenderTargetWriteMask = D3D11_COLOR_WRITE_ENABLE_ALL;
+	device->CreateBlendState(&blendDesc, &particleBlendState);
+
+	D3D11_DEPTH_STENCIL_DESC depthDesc = {};
+	depthDesc.DepthEnable = TRUE;
+	depthDesc.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ZERO;
+	depthDesc.DepthFunc = D3D11_COMPARISON_LESS;
+	device->CreateDepthStencilState(&depthDesc, &particleDepthState);
 }
 
-
 // --------------------------------------------------------
 // Handle resizing DirectX "stuff" to match the new window size.
 // For instance, updating our projection matrix's aspect ratio.
@@ -269,8 +402,39 @@ void Game::Update(float deltaTime, float totalTime)
 	/*for (int i = 0; i < entityList.size(); i++) {
 		entityList[i]->Move(totalTime + i);
 	}*/
-	entityList[1]->UpdateCloth(deltaTime, context, clothVertices);
+	//the input runs on the simulation thread right before the fixed steps
+	//it advances by; nothing moves the sphere while the game runs
+	clothStepper->Submit(deltaTime, [this](float dt) {
+		entityList[1]->AnimateCloth(dt);
+		entityList[0]->UpdateColliders();
+	});
+	//draw the newest finished frame while the next one steps
+	const ClothFrame* clothFrame = clothStepper->Acquire();
+	if (clothFrame)
+		entityList[1]->UpdateCloth(context, clothFrame->meshes[0]);
 	camera->Update(deltaTime);
+
+	//the pool takes calls from any thread, so the sparks share it with the cloth
+	emitterWorld->Update(deltaTime);
+	//the view matrix is stored transposed, its first two rows are the
+	//camera's right and up axes
+	const XMFLOAT4X4 view = camera->GetViewMatrix();
+	const XMFLOAT3 right(view._11, view._12, view._13);
+	const XMFLOAT3 up(view._21, view._22, view._23);
+	D3D11_MAPPED_SUBRESOURCE mappedResource;
+	particleCount = 0;
+	if (SUCCEEDED(context->Map(particleVertexBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource)))
+	{
+		particleCount = emitterWorld->WriteBillboards(static_cast<BillboardVertex*>(mappedResource.pData),
+			emitterWorld->GetCapacity(), right, up);
+		context->Unmap(particleVertexBuffer, 0);
+	}
+	if (particleCount > 0 && SUCCEEDED(context->Map(particleIndexBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource)))
+	{
+		particleCount = emitterWorld->WriteSortedIndices(static_cast<uint32_t*>(mappedResource.pData),
+			emitterWorld->GetCapacity(), view);
+		context->Unmap(particleIndexBuffer, 0);
+	}
 }
 
 // --------------------------------------------------------
@@ -293,11 +457,37 @@ void Game::Draw(float deltaTime, float totalTime)
 	//sphere
 	context->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 	entityList[0]->PerpareMaterial(camera->GetViewMatrix(), camera->GetProjectionMatrix());
-	entityList[0]->Draw(context, DXGI_FORMAT_R32_UINT, sizeof(Vertex));
+	entityList[0]->Draw(context);
 	//cloth
-	context->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_LINELIST);
+	context->RSSetState(clothRasterizerState);
 	entityList[1]->PerpareMaterial(camera->GetViewMatrix(), camera->GetProjectionMatrix());
-	entityList[1]->Draw(context, DXGI_FORMAT_R16_UINT, sizeof(VertexPosColor));
+	entityList[1]->Draw(context);
+	context->RSSetState(0);
+	//sparks, after everything opaque
+	if (particleCount > 0)
+	{
+		const float blendFactor[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		const XMFLOAT4 sparkColor(1.0f, 0.6f, 0.2f, 1.0f);
+		UINT stride = sizeof(BillboardVertex);
+		UINT offset = 0;
+		particleVertexShader->SetMatrix4x4("view", camera->GetViewMatrix());
+		particleVertexShader->SetMatrix4x4("projection", camera->GetProjectionMatrix());
+		particleVertexShader->SetShader();
+		particleVertexShader->CopyAllBufferData();
+		particlePixelShader->SetFloat4("color", sparkColor);
+		particlePixelShader->SetShader();
+		particlePixelShader->CopyAllBufferData();
+		context->IASetInputLayout(particleInputLayout);
+		context->IASetVertexBuffers(0, 1, &particleVertexBuffer, &stride, &offset);
+		context->IASetIndexBuffer(particleIndexBuffer, DXGI_FORMAT_R32_UINT, 0);
+		context->OMSetBlendState(particleBlendState, blendFactor, 0xffffffff);
+		context->OMSetDepthStencilState(particleDepthState, 0);
+		context->RSSetState(clothRasterizerState);
+		context->DrawIndexed(6 * particleCount, 0, 0);
+		context->RSSetState(0);
+		context->OMSetDepthStencilState(0, 0);
+		context->OMSetBlendState(0, blendFactor, 0xffffffff);
+	}
 
 	pixelShader->SetData("light", &light, sizeof(DirectionalLight));
 	pixelShader->SetData("lightTwo", &lightTwo, sizeof(DirectionalLight));
@@ -7,7 +7,9 @@
 #include "Entities.h"
 #include "Camera.h"
 #include "LIghts.h"
-#include "ParticleSystem.h"
+#include "ClothWorld.h"
+#include "ClothStepper.h"
+#include "EmitterWorld.h"
 
 class Game 
 	: public DXCore
@@ -30,8 +32,6 @@ public:
 	void OnMouseMove (WPARAM buttonState, int x, int y);
 	void OnMouseWheel(float wheelDelta,   int x, int y);
 private:
-	VertexPosColor* clothVertices;
-	unsigned short* clothIndices;
 	//lights
 	DirectionalLight light;
 	DirectionalLight lightTwo;
@@ -49,14 +49,36 @@ private:
 	ID3D11ShaderResourceView* clothTexture;
 	ID3D11ShaderResourceView* wickTexture;
 	ID3D11SamplerState* samplerState;
-	//particle system 
-	ParticleSystem* m_particleSystem;
+	//both sides of the cloth are visible
+	ID3D11RasterizerState* clothRasterizerState;
+	//the cloth's split vertex streams, see Mesh
+	ID3D11InputLayout* clothInputLayout;
+	//upload the cloth as QuantizedVertex, half the bytes of DynamicVertex
+	bool quantizeCloth;
+	//every cloth in the scene lives in the cloth world
+	ClothWorld* clothWorld;
+	ClothHandle clothHandle;
+	//steps the cloth world on its own thread once Init is done
+	ClothStepper* clothStepper;
+	//worker threads shared by the simulation
+	ThreadPool* threadPool;
+	//sparks, expanded into billboards on the cpu every frame
+	EmitterWorld* emitterWorld;
+	EmitterHandle sparkHandle;
+	ID3D11Buffer* particleVertexBuffer;
+	ID3D11Buffer* particleIndexBuffer;
+	ID3D11InputLayout* particleInputLayout;
+	ID3D11BlendState* particleBlendState;
+	ID3D11DepthStencilState* particleDepthState;
+	//particles written by the last Update
+	uint32_t particleCount;
 
 	
 	// Initialization helper methods - feel free to customize, combine, etc.
 	void LoadShaders(); 
 	void CreateMatrices();
 	void CreateBasicGeometry();
+	void CreateParticles();
 
 	// Buffers to hold actual geometry data
 	ID3D11Buffer* vertexBuffer;
@@ -64,7 +86,10 @@ private:
 
 	// Wrappers for DirectX shaders to provide simplified functionality
 	SimpleVertexShader* vertexShader;
+	SimpleVertexShader* quantizedVertexShader;
 	SimplePixelShader* pixelShader;
+	SimpleVertexShader* particleVertexShader;
+	SimplePixelShader* particlePixelShader;
 
 	// The matrices to go from model space to screen space
 	DirectX::XMFLOAT4X4 worldMatrix;
@@ -0,0 +1,113 @@
+#include "MappedFile.h"
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile()
+{
+	m_data = nullptr;
+	m_size = 0;
+	m_modified = 0;
+	m_open = false;
+#if defined(_WIN32)
+	m_file = INVALID_HANDLE_VALUE;
+	m_mapping = nullptr;
+#else
+	m_file = -1;
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+bool MappedFile::Open(const char* path)
+{
+	Close();
+#if defined(_WIN32)
+	m_file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (m_file == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER size;
+	FILETIME written;
+	if (!GetFileSizeEx(m_file, &size) || !GetFileTime(m_file, nullptr, nullptr, &written))
+	{
+		Close();
+		return false;
+	}
+	m_size = static_cast<size_t>(size.QuadPart);
+	m_modified = (static_cast<uint64_t>(written.dwHighDateTime) << 32) | written.dwLowDateTime;
+	//a zero length file can't be mapped
+	if (m_size > 0)
+	{
+		m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (m_mapping)
+			m_data = static_cast<const char*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+		if (!m_data)
+		{
+			Close();
+			return false;
+		}
+	}
+#else
+	m_file = open(path, O_RDONLY);
+	if (m_file < 0)
+		return false;
+	struct stat info;
+	if (fstat(m_file, &info) != 0)
+	{
+		Close();
+		return false;
+	}
+	m_size = static_cast<size_t>(info.st_size);
+	m_modified = static_cast<uint64_t>(info.st_mtime);
+	if (m_size > 0)
+	{
+		void* view = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, m_file, 0);
+		if (view == MAP_FAILED)
+		{
+			Close();
+			return false;
+		}
+		//parsers read it front to back
+		madvise(view, m_size, MADV_SEQUENTIAL);
+		m_data = static_cast<const char*>(view);
+	}
+#endif
+	m_open = true;
+	return true;
+}
+
+void MappedFile::Close()
+{
+#if defined(_WIN32)
+	if (m_data)
+		UnmapViewOfFile(m_data);
+	if (m_mapping)
+		CloseHandle(m_mapping);
+	if (m_file != INVALID_HANDLE_VALUE)
+		CloseHandle(m_file);
+	m_mapping = nullptr;
+	m_file = INVALID_HANDLE_VALUE;
+#else
+	if (m_data)
+		munmap(const_cast<char*>(m_data), m_size);
+	if (m_file >= 0)
+		close(m_file);
+	m_file = -1;
+#endif
+	m_data = nullptr;
+	m_size = 0;
+	m_modified = 0;
+	m_open = false;
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// --------------------------------------------------------
+// Read-only view of a whole file mapped into memory
+//
+// The pages are read in by the OS as they are touched, so a big
+// asset can be parsed straight out of the page cache, from any
+// number of threads, without being copied into a buffer first.
+// An empty file opens fine with a null GetData.
+// GetModifiedTime is the last write time in the platform's own
+// units (100 ns ticks on Windows, seconds elsewhere), only good
+// for comparing with another time read the same way.
+// --------------------------------------------------------
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+
+	bool Open(const char* path);
+	void Close();
+	bool IsOpen() const { return m_open; }
+
+	const char* GetData() const { return m_data; }
+	size_t GetSize() const { return m_size; }
+	uint64_t GetModifiedTime() const { return m_modified; }
+
+private:
+	const char* m_data;
+	size_t m_size;
+	uint64_t m_modified;
+	bool m_open;
+#if defined(_WIN32)
+	void* m_file;
+	void* m_mapping;
+#else
+	int m_file;
+#endif
+
+	MappedFile(const MappedFile&);
+	MappedFile& operator=(const MappedFile&);
+};
@@ -1,158 +1,69 @@
 #include "Mesh.h"
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
+#include "ObjLoader.h"
 
 Mesh::Mesh(
-	VertexPosColor vertices[], 
+	DynamicVertex dynamicVertices[], 
+	StaticVertex staticVertices[], 
 	int vertexCount, 
-	unsigned short indices[], 
+	unsigned int indices[], 
+	int indexCount, 
+	ID3D11Device* device)
+{
+	ResetStreams();
+	CreateDeformingBuffers(dynamicVertices, sizeof(DynamicVertex), staticVertices, vertexCount, indices, indexCount, device);
+}
+
+Mesh::Mesh(
+	QuantizedVertex dynamicVertices[], 
+	StaticVertex staticVertices[], 
+	int vertexCount, 
+	unsigned int indices[], 
 	int indexCount, 
 	ID3D11Device* device)
 {
-	clothVertices = vertices;
-	clothVerticesSize = vertexCount;
-	CreateClothBuffers(clothVertices, clothVerticesSize, indices, indexCount, device);
+	ResetStreams();
+	quantized = true;
+	CreateDeformingBuffers(dynamicVertices, sizeof(QuantizedVertex), staticVertices, vertexCount, indices, indexCount, device);
 }
 
-Mesh::Mesh(char * fileName, ID3D11Device* device)
+Mesh::Mesh(const char* fileName, ID3D11Device* device, ThreadPool* pool)
 {
-	//file input stream
-	ifstream obj(fileName);
+	ResetStreams();
 
-	//check for sucessful open 
-	if (!obj.is_open())
+	//the binary cache next to the file, while the file is unchanged; its
+	//blobs go to the device straight out of the mapping
+	MeshSourceStamp stamp;
+	if (!ReadMeshSourceStamp(fileName, stamp, pool))
+		return;
+	const std::string cachePath = GetMeshCachePath(fileName);
+	MeshCache cache;
+	if (cache.Open(cachePath.c_str(), stamp) && cache.GetHeader().vertexCount > 0)
+	{
+		const MeshCacheHeader& header = cache.GetHeader();
+		CreateVertexBuffer(cache.GetVertices(), header.vertexCount, device);
+		CreateIndexBuffer(cache.GetIndices(), header.indexCount,
+			header.indexSize == sizeof(uint16_t) ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT, device);
 		return;
-
-	//variables for reading file
-	std::vector<XMFLOAT3> positions;  
-	std::vector<XMFLOAT3> normals;
-	std::vector<XMFLOAT2> uvs;
-	std::vector<Vertex> verts; //verts we're assembling 
-	std::vector<UINT> indices; //indices of these verts
-	unsigned int vertCounter = 0; //count of vertices/indices
-	char chars[100];
-
-	while (obj.good()) {
-		//get the line (100 charcthers should be more then enough)
-		obj.getline(chars, 100);
-
-		//check the type of line
-		if (chars[0] == 'v' && chars[1] == 'n') {
-			//reads the 3 numbers directly into XMFLOAT3
-			XMFLOAT3 norm;
-			sscanf_s(chars, "vn %f %f %f", &norm.x, &norm.y, &norm.z);
-
-			//add to the list of normals 
-			normals.push_back(norm);
-		}
-		else if (chars[0] == 'v' && chars[1] == 't') {
-			//reads the 2 numbers directly into an XMFLOAT2
-			XMFLOAT2 uv;
-			sscanf_s(chars, "vt %f %f", &uv.x, &uv.y);
-			//add to the list of uvs 
-			uvs.push_back(uv);
-		}
-		else if (chars[0] == 'v') {
-			//reads the 3 numbers directly into an XMFLOAT3
-			XMFLOAT3 pos;
-			sscanf_s(chars, "v %f %f %f", &pos.x, &pos.y, &pos.z);
-			//add to list
-			positions.push_back(pos);
-		}
-		else if (chars[0] == 'f') {
-			//reads the face indices into an array 
-			unsigned int i[12];
-			int facesRead = sscanf_s(
-				chars, 
-				"f %d/%d/%d %d/%d/%d %d/%d/%d %d/%d/%d",
-				&i[0], &i[1], &i[2],
-				&i[3], &i[4], &i[5],
-				&i[6], &i[7], &i[8],
-				&i[9], &i[10], &i[11]);
-
-
-			//create the verts by looking up corresponding 
-			//data from vectors 
-			//-OBJ file indces are 1-based, so they need to be 
-			//adjusted
-			Vertex v1;
-			v1.Position = positions[i[0] - 1];
-			v1.UV = uvs[i[1] - 1];
-			v1.Normal = normals[i[2] - 1];
-
-			Vertex v2;
-			v2.Position = positions[i[3] - 1];
-			v2.UV = uvs[i[4] - 1];
-			v2.Normal = normals[i[5] - 1];
-
-			Vertex v3;
-			v3.Position = positions[i[6] - 1];
-			v3.UV = uvs[i[7] - 1];
-			v3.Normal = normals[i[8] - 1];
-
-			//the model is most likely in a right-handed space
-			//especially if it came from maya. we want to convert
-			//to left-handed space form directX. this means we need
-			//to: 
-			//-invert the z pos
-			//-invert the normal's z
-			//-flip the winding order 
-
-			//flips uvs
-			v1.UV.y = 1.0f - v1.UV.y;
-			v2.UV.y = 1.0f - v2.UV.y;
-			v3.UV.y = 1.0f - v3.UV.y;
-			//flip z
-			v1.Position.z *= -1.0f;
-			v2.Position.z *= -1.0f;
-			v3.Position.z *= -1.0f;
-			//flip normal z
-			v1.Normal.z *= -1.0f;
-			v2.Normal.z *= -1.0f;
-			v3.Normal.z *= -1.0f;
-
-			//add the verts back
-			verts.push_back(v1);
-			verts.push_back(v2);
-			verts.push_back(v3);
-
-			//add three more indices
-			indices.push_back(vertCounter); vertCounter++;
-			indices.push_back(vertCounter); vertCounter++;
-			indices.push_back(vertCounter); vertCounter++;
-
-			//was there a 4th face
-			if (facesRead == 12) {
-
-				//make the last vertex
-				Vertex v4;
-				v4.Position = positions[i[9] - 1];
-				v4.UV = uvs[i[10] - 1];
-				v4.Normal = normals[i[11] - 1];
-
-				//flip the uv, z pos and normal
-				v4.UV.y = 1.0f - v4.UV.y;
-				v4.Position.z *= -1.0f;
-				v4.Normal.z *= -1.0f;
-
-				//add the whole triagnle 
-				verts.push_back(v1);
-				verts.push_back(v4);
-				verts.push_back(v3);
-
-				//add three more indices
-				indices.push_back(vertCounter); vertCounter++;
-				indices.push_back(vertCounter); vertCounter++;
-				indices.push_back(vertCounter); vertCounter++;
-			}
-			
-		}
 	}
-	obj.close();
-	CreateBuffers(&verts[0], vertCounter, &indices[0], vertCounter, device);
+
+	//verts and indices, converted to left handed by the loader
+	std::vector<Vertex> verts;
+	std::vector<uint32_t> indices;
+	if (!LoadObj(fileName, verts, indices, pool) || verts.empty())
+		return;
+	//triangle order for the vertex cache and overdraw, vertex order for fetching
+	OptimizeMesh(verts, indices);
+	//a read-only folder just means parsing again next time
+	WriteMeshCache(cachePath.c_str(), stamp, verts, indices);
+
+	CreateBuffers(&verts[0], static_cast<int>(verts.size()), &indices[0], static_cast<int>(indices.size()), device);
 }
 
 ID3D11Buffer * Mesh::GetVertexBuffer()
 {
-	return vertexBuffer;
+	return vertexBuffers[0];
 }
 
 ID3D11Buffer * Mesh::GetIndexBuffer()
@@ -160,14 +71,34 @@ ID3D11Buffer * Mesh::GetIndexBuffer()
 	return indexBuffer;
 }
 
-VertexPosColor * Mesh::GetClothVertices()
+int Mesh::GetStreamCount()
 {
-	return clothVertices;
+	return streamCount;
 }
 
-int Mesh::GetClothVerticesSize()
+ID3D11Buffer* const* Mesh::GetVertexBuffers()
 {
-	return clothVerticesSize;
+	return vertexBuffers;
+}
+
+const UINT* Mesh::GetStrides()
+{
+	return strides;
+}
+
+void Mesh::SetInputLayout(ID3D11InputLayout* layout)
+{
+	inputLayout = layout;
+}
+
+ID3D11InputLayout* Mesh::GetInputLayout()
+{
+	return inputLayout;
+}
+
+bool Mesh::IsQuantized()
+{
+	return quantized;
 }
 
 int Mesh::GetIndexCount()
@@ -175,6 +106,11 @@ int Mesh::GetIndexCount()
 	return indexBufferCount;
 }
 
+DXGI_FORMAT Mesh::GetIndexFormat()
+{
+	return indexFormat;
+}
+
 void Mesh::CreateBuffers(
 	Vertex vertices[], 
 	int vertexCount, 
@@ -182,7 +118,14 @@ void Mesh::CreateBuffers(
 	int indexCount, 
 	ID3D11Device * device)
 {
-	indexBufferCount = indexCount;
+	CreateVertexBuffer(vertices, vertexCount, device);
+	CreateIndexBuffer(indices, indexCount, vertexCount, device);
+}
+
+void Mesh::CreateVertexBuffer(const Vertex* vertices, int vertexCount, ID3D11Device* device)
+{
+	streamCount = 1;
+	strides[0] = sizeof(Vertex);
 	// Create the VERTEX BUFFER description -----------------------------------
 	// - The description is created on the stack because we only need
 	//    it to create the buffer.  The description is then useless.
@@ -201,38 +144,20 @@ void Mesh::CreateBuffers(
 
 	// Actually create the buffer with the initial data
 	// - Once we do this, we'll NEVER CHANGE THE BUFFER AGAIN
-	device->CreateBuffer(&vbd, &initialVertexData, &vertexBuffer);
-
-	// Create the INDEX BUFFER description ------------------------------------
-	// - The description is created on the stack because we only need
-	//    it to create the buffer.  The description is then useless.
-	D3D11_BUFFER_DESC ibd;
-	ibd.Usage = D3D11_USAGE_IMMUTABLE;
-	ibd.ByteWidth = sizeof(int) * indexCount;         // 3 = number of indices in the buffer
-	ibd.BindFlags = D3D11_BIND_INDEX_BUFFER; // Tells DirectX this is an index buffer
-	ibd.CPUAccessFlags = 0;
-	ibd.MiscFlags = 0;
-	ibd.StructureByteStride = 0;
-
-	// Create the proper struct to hold the initial index data
-	// - This is how we put the initial data into the buffer
-	D3D11_SUBRESOURCE_DATA initialIndexData;
-	initialIndexData.pSysMem = indices;
-
-	// Actually create the buffer with the initial data
-	// - Once we do this, we'll NEVER CHANGE THE BUFFER AGAIN
-	device->CreateBuffer(&ibd, &initialIndexData, &indexBuffer);
+	device->CreateBuffer(&vbd, &initialVertexData, &vertexBuffers[0]);
 }
 
-void Mesh::CreateClothBuffers(VertexPosColor vertices[], int vertexCount, unsigned short indices[], int indexCount, ID3D11Device * device)
+void Mesh::CreateDeformingBuffers(const void* dynamicVertices, UINT dynamicStride, StaticVertex staticVertices[], int vertexCount, unsigned int indices[], int indexCount, ID3D11Device * device)
 {
-	indexBufferCount = indexCount;
-	// Create the VERTEX BUFFER description -----------------------------------
-	// - The description is created on the stack because we only need
-	//    it to create the buffer.  The description is then useless.
+	streamCount = 2;
+	strides[0] = dynamicStride;
+	strides[1] = sizeof(StaticVertex);
+	// Create the DYNAMIC VERTEX BUFFER description ---------------------------
+	// - Only what changes every frame goes in here, so that is all
+	//    the cpu has to upload
 	D3D11_BUFFER_DESC vbd;
 	vbd.Usage = D3D11_USAGE_DYNAMIC;
-	vbd.ByteWidth = vertexCount;       // 3 = number of vertices in the buffer
+	vbd.ByteWidth = dynamicStride * vertexCount;
 	vbd.BindFlags = D3D11_BIND_VERTEX_BUFFER; // Tells DirectX this is a vertex buffer
 	vbd.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
 	vbd.MiscFlags = 0;
@@ -241,20 +166,57 @@ void Mesh::CreateClothBuffers(VertexPosColor vertices[], int vertexCount, unsign
 	// Create the proper struct to hold the initial vertex data
 	// - This is how we put the initial data into the buffer
 	D3D11_SUBRESOURCE_DATA initialVertexData;
-	initialVertexData.pSysMem = vertices;
+	initialVertexData.pSysMem = dynamicVertices;
 	initialVertexData.SysMemPitch = 0;
 	initialVertexData.SysMemSlicePitch = 0;
 
+	device->CreateBuffer(&vbd, &initialVertexData, &vertexBuffers[0]);
+
+	// Create the STATIC VERTEX BUFFER description ----------------------------
+	// - The attributes that never change, uploaded once
+	D3D11_BUFFER_DESC sbd;
+	sbd.Usage = D3D11_USAGE_IMMUTABLE;
+	sbd.ByteWidth = sizeof(StaticVertex) * vertexCount;
+	sbd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+	sbd.CPUAccessFlags = 0;
+	sbd.MiscFlags = 0;
+	sbd.StructureByteStride = 0;
+
+	D3D11_SUBRESOURCE_DATA initialStaticData;
+	initialStaticData.pSysMem = staticVertices;
+	initialStaticData.SysMemPitch = 0;
+	initialStaticData.SysMemSlicePitch = 0;
+
 	// Actually create the buffer with the initial data
 	// - Once we do this, we'll NEVER CHANGE THE BUFFER AGAIN
-	device->CreateBuffer(&vbd, &initialVertexData, &vertexBuffer);
+	device->CreateBuffer(&sbd, &initialStaticData, &vertexBuffers[1]);
+
+	CreateIndexBuffer(indices, indexCount, vertexCount, device);
+}
+
+void Mesh::CreateIndexBuffer(unsigned int indices[], int indexCount, int vertexCount, ID3D11Device * device)
+{
+	// - 16 bit indices whenever every vertex can be addressed with
+	//    them, which halves the buffer and the bandwidth to read it
+	if (static_cast<uint32_t>(vertexCount) <= MAX_SHORT_INDEX_VERTICES)
+	{
+		std::vector<uint16_t> shortIndices(indices, indices + indexCount);
+		CreateIndexBuffer(shortIndices.data(), indexCount, DXGI_FORMAT_R16_UINT, device);
+	}
+	else
+		CreateIndexBuffer(indices, indexCount, DXGI_FORMAT_R32_UINT, device);
+}
+
+void Mesh::CreateIndexBuffer(const void* indexData, int indexCount, DXGI_FORMAT format, ID3D11Device* device)
+{
+	indexBufferCount = indexCount;
+	indexFormat = format;
+	const UINT indexSize = format == DXGI_FORMAT_R16_UINT ? sizeof(uint16_t) : sizeof(uint32_t);
 
 	// Create the INDEX BUFFER description ------------------------------------
-	// - The description is created on the stack because we only need
-	//    it to create the buffer.  The description is then useless.
 	D3D11_BUFFER_DESC ibd;
 	ibd.Usage = D3D11_USAGE_IMMUTABLE;
-	ibd.ByteWidth = indexCount;         // 3 = number of indices in the buffer
+	ibd.ByteWidth = indexSize * indexCount;
 	ibd.BindFlags = D3D11_BIND_INDEX_BUFFER; // Tells DirectX this is an index buffer
 	ibd.CPUAccessFlags = 0;
 	ibd.MiscFlags = 0;
@@ -263,7 +225,7 @@ void Mesh::CreateClothBuffers(VertexPosColor vertices[], int vertexCount, unsign
 	// Create the proper struct to hold the initial index data
 	// - This is how we put the initial data into the buffer
 	D3D11_SUBRESOURCE_DATA initialIndexData;
-	initialIndexData.pSysMem = indices;
+	initialIndexData.pSysMem = indexData;
 	initialIndexData.SysMemPitch = 0;
 	initialIndexData.SysMemSlicePitch = 0;
 
@@ -272,9 +234,26 @@ void Mesh::CreateClothBuffers(VertexPosColor vertices[], int vertexCount, unsign
 	device->CreateBuffer(&ibd, &initialIndexData, &indexBuffer);
 }
 
+void Mesh::ResetStreams()
+{
+	indexBuffer = 0;
+	streamCount = 0;
+	inputLayout = 0;
+	quantized = false;
+	indexBufferCount = 0;
+	indexFormat = DXGI_FORMAT_R32_UINT;
+	for (int i = 0; i < MAX_STREAMS; i++)
+	{
+		vertexBuffers[i] = 0;
+		strides[i] = 0;
+	}
+}
 
 Mesh::~Mesh()
 {
-	if (vertexBuffer) { vertexBuffer->Release(); }
+	for (int i = 0; i < streamCount; i++)
+	{
+		if (vertexBuffers[i]) { vertexBuffers[i]->Release(); }
+	}
 	if (indexBuffer) { indexBuffer->Release(); }
 }
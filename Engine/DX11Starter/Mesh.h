@@ -3,6 +3,7 @@
 #include "SimpleShader.h"
 #include <DirectXMath.h>
 #include "Vertex.h"
+#include "ThreadPool.h"
 #include <iostream>
 #include <fstream>
 
@@ -12,38 +13,74 @@ using namespace DirectX;
 class Mesh
 {
 public:
-	Mesh(char* fileName, ID3D11Device* device);
-	Mesh(VertexPosColor vertices[],
+	//OBJ file, parsed in parallel on pool when there is one, or its binary
+	//cache when that is up to date (see MeshCache)
+	Mesh(const char* fileName, ID3D11Device* device, ThreadPool* pool = nullptr);
+	//deforming mesh: positions and normals in a dynamic buffer rewritten
+	//every frame (stream 0), everything else in an immutable one (stream 1)
+	Mesh(DynamicVertex dynamicVertices[],
+		StaticVertex staticVertices[],
 		int vertexCount,
-		unsigned short indices[], 
+		unsigned int indices[], 
+		int indexCount, 
+		ID3D11Device* device);
+	//same with the compressed dynamic stream, see QuantizedVertex
+	Mesh(QuantizedVertex dynamicVertices[],
+		StaticVertex staticVertices[],
+		int vertexCount,
+		unsigned int indices[], 
 		int indexCount, 
 		ID3D11Device* device);
 
+	//stream 0, the one a deforming mesh maps every frame
 	ID3D11Buffer* GetVertexBuffer();
 	ID3D11Buffer* GetIndexBuffer();
-	VertexPosColor* GetClothVertices();
-	int GetClothVerticesSize();
+	//every vertex buffer and its stride, bound together starting at slot 0
+	int GetStreamCount();
+	ID3D11Buffer* const* GetVertexBuffers();
+	const UINT* GetStrides();
+	//layout matching the streams, null for the default Vertex layout; not owned
+	void SetInputLayout(ID3D11InputLayout* layout);
+	ID3D11InputLayout* GetInputLayout();
+	//stream 0 holds QuantizedVertex and needs its bounds to draw
+	bool IsQuantized();
 
 	int GetIndexCount();
+	//R16_UINT when the mesh has few enough vertices, R32_UINT otherwise
+	DXGI_FORMAT GetIndexFormat();
 	void CreateBuffers(
 		Vertex vertices[],
 		int vertexCount, 
 		unsigned int indices[], 
 		int indexCount, 
 		ID3D11Device* device);
-	void CreateClothBuffers(
-		VertexPosColor vertices[],
+	void CreateDeformingBuffers(
+		const void* dynamicVertices,
+		UINT dynamicStride,
+		StaticVertex staticVertices[],
 		int vertexCount,
-		unsigned short indices[],
+		unsigned int indices[],
 		int indexCount,
 		ID3D11Device* device);
 	~Mesh();
 private:
+	static const int MAX_STREAMS = 2;
+
 	ID3D11Buffer* indexBuffer;
-	ID3D11Buffer* vertexBuffer;
-	VertexPosColor* clothVertices;
-	int clothVerticesSize;
+	ID3D11Buffer* vertexBuffers[MAX_STREAMS];
+	UINT strides[MAX_STREAMS];
+	int streamCount;
+	ID3D11InputLayout* inputLayout;
+	bool quantized;
 	int indexBufferCount;
+	DXGI_FORMAT indexFormat;
+
+	void CreateVertexBuffer(const Vertex* vertices, int vertexCount, ID3D11Device* device);
+	//picks the format from the vertex count
+	void CreateIndexBuffer(unsigned int indices[], int indexCount, int vertexCount, ID3D11Device* device);
+	//indexData already in format
+	void CreateIndexBuffer(const void* indexData, int indexCount, DXGI_FORMAT format, ID3D11Device* device);
+	void ResetStreams();
 };
 
 
@@ -0,0 +1,218 @@
+#include "MeshCache.h"
+#include <float.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+namespace
+{
+	//bytes per task when hashing a source
+	const size_t HASH_CHUNK_SIZE = 1 << 20;
+	const uint64_t HASH_MULTIPLIER = 0x9E3779B97F4A7C15ull;
+
+	static_assert(sizeof(MeshCacheHeader) == 88, "MeshCacheHeader layout changed, bump MESH_CACHE_VERSION");
+
+	inline uint64_t Mix(uint64_t h, uint64_t word)
+	{
+		h = (h ^ word) * HASH_MULTIPLIER;
+		return h ^ (h >> 29);
+	}
+
+	//four independent lanes so the multiplies overlap, then the tail
+	uint64_t HashBytes(const char* data, size_t size)
+	{
+		uint64_t lanes[4] = { size, size + 1, size + 2, size + 3 };
+		size_t i = 0;
+		for (; i + 32 <= size; i += 32)
+		{
+			uint64_t words[4];
+			memcpy(words, data + i, sizeof(words));
+			for (int k = 0; k < 4; k++)
+			{
+				lanes[k] = Mix(lanes[k], words[k]);
+			}
+		}
+		uint64_t h = Mix(Mix(Mix(lanes[0], lanes[1]), lanes[2]), lanes[3]);
+		for (; i < size; i += 8)
+		{
+			uint64_t word = 0;
+			memcpy(&word, data + i, std::min<size_t>(8, size - i));
+			h = Mix(h, word);
+		}
+		return h;
+	}
+
+	inline uint64_t AlignUp(uint64_t offset)
+	{
+		return (offset + MESH_CACHE_ALIGNMENT - 1) / MESH_CACHE_ALIGNMENT * MESH_CACHE_ALIGNMENT;
+	}
+
+	bool WritePadding(FILE* file, uint64_t from, uint64_t to)
+	{
+		static const char zeros[MESH_CACHE_ALIGNMENT] = {};
+		return to == from || fwrite(zeros, 1, static_cast<size_t>(to - from), file) == to - from;
+	}
+}
+
+MeshCache::MeshCache()
+{
+	m_header = nullptr;
+}
+
+bool MeshCache::Open(const char* path, const MeshSourceStamp& stamp)
+{
+	Close();
+	if (!m_file.Open(path) || m_file.GetSize() < sizeof(MeshCacheHeader))
+	{
+		m_file.Close();
+		return false;
+	}
+
+	//the mapping is page aligned, so the header and the blobs are too
+	const MeshCacheHeader* header = reinterpret_cast<const MeshCacheHeader*>(m_file.GetData());
+	const uint64_t size = m_file.GetSize();
+	const uint64_t vertexBytes = static_cast<uint64_t>(header->vertexCount) * sizeof(Vertex);
+	const uint64_t indexBytes = static_cast<uint64_t>(header->indexCount) * header->indexSize;
+	const bool valid =
+		header->magic == MESH_CACHE_MAGIC && header->version == MESH_CACHE_VERSION &&
+		header->sourceSize == stamp.size && header->sourceTime == stamp.time && header->sourceHash == stamp.hash &&
+		header->vertexStride == sizeof(Vertex) &&
+		(header->indexSize == sizeof(uint16_t) || header->indexSize == sizeof(uint32_t)) &&
+		header->indexCount % 3 == 0 &&
+		header->vertexOffset % MESH_CACHE_ALIGNMENT == 0 && header->indexOffset % MESH_CACHE_ALIGNMENT == 0 &&
+		header->vertexOffset >= sizeof(MeshCacheHeader) && header->vertexOffset <= size &&
+		vertexBytes <= size - header->vertexOffset &&
+		header->indexOffset >= sizeof(MeshCacheHeader) && header->indexOffset <= size &&
+		indexBytes <= size - header->indexOffset;
+	if (!valid)
+	{
+		m_file.Close();
+		return false;
+	}
+	m_header = header;
+	return true;
+}
+
+void MeshCache::Close()
+{
+	m_file.Close();
+	m_header = nullptr;
+}
+
+const Vertex* MeshCache::GetVertices() const
+{
+	return reinterpret_cast<const Vertex*>(m_file.GetData() + m_header->vertexOffset);
+}
+
+const void* MeshCache::GetIndices() const
+{
+	return m_file.GetData() + m_header->indexOffset;
+}
+
+bool ReadMeshSourceStamp(const char* path, MeshSourceStamp& stamp, ThreadPool* pool)
+{
+	MappedFile file;
+	if (!file.Open(path))
+		return false;
+
+	//hashed in fixed chunks so the result doesn't depend on the pool
+	const char* data = file.GetData();
+	const size_t size = file.GetSize();
+	const uint32_t chunkCount = static_cast<uint32_t>((size + HASH_CHUNK_SIZE - 1) / HASH_CHUNK_SIZE);
+	std::vector<uint64_t> chunkHashes(chunkCount);
+	uint64_t* hashData = chunkHashes.data();
+	ThreadPool::RangeJob hashChunks = [data, size, hashData](uint32_t first, uint32_t last) {
+		for (uint32_t c = first; c < last; c++)
+		{
+			const size_t begin = c * HASH_CHUNK_SIZE;
+			hashData[c] = HashBytes(data + begin, std::min(HASH_CHUNK_SIZE, size - begin));
+		}
+	};
+	if (pool)
+		pool->ParallelFor(chunkCount, 1, hashChunks);
+	else if (chunkCount > 0)
+		hashChunks(0, chunkCount);
+
+	uint64_t hash = size;
+	for (uint32_t c = 0; c < chunkCount; c++)
+	{
+		hash = Mix(hash, chunkHashes[c]);
+	}
+	stamp.size = size;
+	stamp.time = file.GetModifiedTime();
+	stamp.hash = hash;
+	return true;
+}
+
+std::string GetMeshCachePath(const char* sourcePath)
+{
+	return std::string(sourcePath) + ".cache";
+}
+
+bool WriteMeshCache(const char* path, const MeshSourceStamp& stamp, const std::vector<Vertex>& vertices,
+	const std::vector<uint32_t>& indices)
+{
+	if (vertices.size() > UINT32_MAX || indices.size() > UINT32_MAX || indices.size() % 3 != 0)
+		return false;
+
+	MeshCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic = MESH_CACHE_MAGIC;
+	header.version = MESH_CACHE_VERSION;
+	header.sourceSize = stamp.size;
+	header.sourceTime = stamp.time;
+	header.sourceHash = stamp.hash;
+	header.vertexStride = sizeof(Vertex);
+	header.vertexCount = static_cast<uint32_t>(vertices.size());
+	//same rule as Mesh, so the blob is the index buffer as is
+	header.indexSize = vertices.size() <= MAX_SHORT_INDEX_VERTICES ? sizeof(uint16_t) : sizeof(uint32_t);
+	header.indexCount = static_cast<uint32_t>(indices.size());
+	header.vertexOffset = AlignUp(sizeof(MeshCacheHeader));
+	header.indexOffset = AlignUp(header.vertexOffset + vertices.size() * sizeof(Vertex));
+	for (int i = 0; i < 3; i++)
+	{
+		header.boundsMin[i] = vertices.empty() ? 0.0f : FLT_MAX;
+		header.boundsMax[i] = vertices.empty() ? 0.0f : -FLT_MAX;
+	}
+	for (size_t v = 0; v < vertices.size(); v++)
+	{
+		const float p[3] = { vertices[v].Position.x, vertices[v].Position.y, vertices[v].Position.z };
+		for (int i = 0; i < 3; i++)
+		{
+			header.boundsMin[i] = std::min(header.boundsMin[i], p[i]);
+			header.boundsMax[i] = std::max(header.boundsMax[i], p[i]);
+		}
+	}
+
+	const std::string temporary = std::string(path) + ".tmp";
+	FILE* file = fopen(temporary.c_str(), "wb");
+	if (!file)
+		return false;
+	bool written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+		WritePadding(file, sizeof(header), header.vertexOffset) &&
+		fwrite(vertices.data(), sizeof(Vertex), vertices.size(), file) == vertices.size() &&
+		WritePadding(file, header.vertexOffset + vertices.size() * sizeof(Vertex), header.indexOffset);
+	if (written && header.indexSize == sizeof(uint16_t))
+	{
+		std::vector<uint16_t> shortIndices(indices.begin(), indices.end());
+		written = fwrite(shortIndices.data(), sizeof(uint16_t), shortIndices.size(), file) == shortIndices.size();
+	}
+	else if (written)
+	{
+		written = fwrite(indices.data(), sizeof(uint32_t), indices.size(), file) == indices.size();
+	}
+	if (fclose(file) != 0 || !written)
+	{
+		remove(temporary.c_str());
+		return false;
+	}
+
+	//rename doesn't replace an existing file on Windows
+	remove(path);
+	if (rename(temporary.c_str(), path) != 0)
+	{
+		remove(temporary.c_str());
+		return false;
+	}
+	return true;
+}
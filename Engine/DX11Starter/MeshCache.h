@@ -0,0 +1,90 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "MappedFile.h"
+#include "ThreadPool.h"
+#include "Vertex.h"
+
+// --------------------------------------------------------
+// Binary cache of an imported mesh
+//
+// Parsing and optimizing a big OBJ file takes seconds; the result
+// is written next to it once (see GetMeshCachePath) and later
+// loads map that file instead. The vertex and index blobs sit at
+// aligned offsets in the exact layout the buffers are created
+// with, so they are handed to the device straight out of the
+// mapping without being copied. A cache is only used while its
+// version, the Vertex layout and the stamp of the source (size,
+// last write time and a hash of its bytes) all still match.
+// --------------------------------------------------------
+
+//'MSHC' read as a little endian uint32_t
+const uint32_t MESH_CACHE_MAGIC = 0x4348534D;
+//bump whenever the layout or the import steps change
+const uint32_t MESH_CACHE_VERSION = 1;
+//alignment of the blobs from the start of the file
+const uint32_t MESH_CACHE_ALIGNMENT = 64;
+
+//identifies the contents of a source file
+struct MeshSourceStamp
+{
+	MeshSourceStamp() : size(0), time(0), hash(0) {}
+	uint64_t size;
+	//see MappedFile::GetModifiedTime
+	uint64_t time;
+	uint64_t hash;
+};
+
+//what the cache file starts with; the blobs follow at their offsets
+struct MeshCacheHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t sourceSize;
+	uint64_t sourceTime;
+	uint64_t sourceHash;
+	//sizeof(Vertex) when it was written
+	uint32_t vertexStride;
+	uint32_t vertexCount;
+	//2 when every vertex fits 16 bit indices, 4 otherwise
+	uint32_t indexSize;
+	uint32_t indexCount;
+	uint64_t vertexOffset;
+	uint64_t indexOffset;
+	//of the positions
+	float boundsMin[3];
+	float boundsMax[3];
+};
+
+// --------------------------------------------------------
+// Read-only view of a cache file, valid while it is open
+// --------------------------------------------------------
+class MeshCache
+{
+public:
+	MeshCache();
+
+	//false unless path holds a well formed cache of this version built from stamp's source
+	bool Open(const char* path, const MeshSourceStamp& stamp);
+	void Close();
+	bool IsOpen() const { return m_header != nullptr; }
+
+	const MeshCacheHeader& GetHeader() const { return *m_header; }
+	const Vertex* GetVertices() const;
+	//GetHeader().indexSize bytes each
+	const void* GetIndices() const;
+
+private:
+	MappedFile m_file;
+	const MeshCacheHeader* m_header;
+};
+
+//false when path can't be read; the hash is computed on pool when there is one
+bool ReadMeshSourceStamp(const char* path, MeshSourceStamp& stamp, ThreadPool* pool = nullptr);
+//sourcePath with ".cache" appended
+std::string GetMeshCachePath(const char* sourcePath);
+//writes a new file and swaps it in, so a reader never sees a partial cache
+bool WriteMeshCache(const char* path, const MeshSourceStamp& stamp, const std::vector<Vertex>& vertices,
+	const std::vector<uint32_t>& indices);
@@ -0,0 +1,403 @@
+#include "MeshOptimizer.h"
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+namespace
+{
+	//vertices per task when hashing
+	const uint32_t HASH_GRAIN = 65536;
+	//marks a free slot of the weld table
+	const uint32_t EMPTY_SLOT = UINT32_MAX;
+
+	static_assert(sizeof(Vertex) == 8 * sizeof(uint32_t), "Vertex layout changed");
+
+	//64 bit multiply and xor-shift over the bit patterns of the vertex
+	inline uint32_t HashVertex(const Vertex& v)
+	{
+		uint32_t words[8];
+		memcpy(words, &v, sizeof(words));
+		uint64_t h = 0;
+		for (int i = 0; i < 8; i++)
+		{
+			h = (h ^ words[i]) * 0x9E3779B97F4A7C15ull;
+			h ^= h >> 29;
+		}
+		return static_cast<uint32_t>(h ^ (h >> 32));
+	}
+
+	struct WeldSlot
+	{
+		uint32_t hash;
+		uint32_t vertex;
+	};
+
+	//no vertex left to fan around
+	const uint32_t NO_VERTEX = UINT32_MAX;
+
+	// --------------------------------------------------------
+	// FIFO cache simulation: a vertex is cached while fewer than
+	// size misses happened since it was loaded. Advancing time by
+	// more than size flushes it.
+	// --------------------------------------------------------
+	struct CacheSimulation
+	{
+		CacheSimulation(size_t vertexCount, uint32_t cacheSize) : stamps(vertexCount, 0), time(cacheSize + 1), size(cacheSize) {}
+
+		//1 if loading v missed
+		uint32_t Load(uint32_t v)
+		{
+			if (time - stamps[v] <= size)
+				return 0;
+			stamps[v] = time++;
+			return 1;
+		}
+
+		uint32_t LoadTriangle(const uint32_t* triangle)
+		{
+			return Load(triangle[0]) + Load(triangle[1]) + Load(triangle[2]);
+		}
+
+		void Flush()
+		{
+			time += size + 1;
+		}
+
+		std::vector<uint32_t> stamps;
+		uint32_t time;
+		uint32_t size;
+	};
+
+	//sum of (p2 - p0) x (p1 - p0) over the triangles, the outward normal scaled by
+	//twice the area (see LoadObj), and of the centroids weighted by that area
+	struct ClusterShape
+	{
+		ClusterShape() : area(0.0f) { normal[0] = normal[1] = normal[2] = 0.0f; centroid[0] = centroid[1] = centroid[2] = 0.0f; }
+
+		void Add(const uint32_t* triangle, const Vertex* vertices)
+		{
+			const DirectX::XMFLOAT3& p0 = vertices[triangle[0]].Position;
+			const DirectX::XMFLOAT3& p1 = vertices[triangle[1]].Position;
+			const DirectX::XMFLOAT3& p2 = vertices[triangle[2]].Position;
+			const float a[3] = { p2.x - p0.x, p2.y - p0.y, p2.z - p0.z };
+			const float b[3] = { p1.x - p0.x, p1.y - p0.y, p1.z - p0.z };
+			const float n[3] = { a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0] };
+			const float weight = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+			normal[0] += n[0];
+			normal[1] += n[1];
+			normal[2] += n[2];
+			centroid[0] += (p0.x + p1.x + p2.x) * weight;
+			centroid[1] += (p0.y + p1.y + p2.y) * weight;
+			centroid[2] += (p0.z + p1.z + p2.z) * weight;
+			area += weight;
+		}
+
+		//centroid / area is three times the real centroid, which scales every key alike
+		float SortKey(const ClusterShape& mesh) const
+		{
+			const float length = sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+			if (area <= 0.0f || mesh.area <= 0.0f || length <= 0.0f)
+				return 0.0f;
+			float key = 0.0f;
+			for (int i = 0; i < 3; i++)
+			{
+				key += (centroid[i] / area - mesh.centroid[i] / mesh.area) * normal[i];
+			}
+			return key / length;
+		}
+
+		float normal[3];
+		float centroid[3];
+		float area;
+	};
+}
+
+void WeldVertices(const Vertex* input, size_t count, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices,
+	ThreadPool* pool)
+{
+	vertices.clear();
+	indices.resize(count);
+	if (count == 0)
+		return;
+
+	std::vector<uint32_t> hashes(count);
+	uint32_t* hashData = hashes.data();
+	ThreadPool::RangeJob hashVertices = [input, hashData](uint32_t begin, uint32_t end) {
+		for (uint32_t i = begin; i < end; i++)
+		{
+			hashData[i] = HashVertex(input[i]);
+		}
+	};
+	if (pool)
+		pool->ParallelFor(static_cast<uint32_t>(count), HASH_GRAIN, hashVertices);
+	else
+		hashVertices(0, static_cast<uint32_t>(count));
+
+	//at most 3/4 full even if nothing welds
+	size_t capacity = 16;
+	while (capacity * 3 < count * 4)
+		capacity *= 2;
+	const size_t mask = capacity - 1;
+	WeldSlot empty = { 0, EMPTY_SLOT };
+	std::vector<WeldSlot> table(capacity, empty);
+
+	//inserting in input order keeps the result independent of the pool
+	for (size_t i = 0; i < count; i++)
+	{
+		const uint32_t hash = hashes[i];
+		size_t slot = hash & mask;
+		while (true)
+		{
+			WeldSlot& entry = table[slot];
+			if (entry.vertex == EMPTY_SLOT)
+			{
+				entry.hash = hash;
+				entry.vertex = static_cast<uint32_t>(vertices.size());
+				vertices.push_back(input[i]);
+				break;
+			}
+			if (entry.hash == hash && !memcmp(&vertices[entry.vertex], &input[i], sizeof(Vertex)))
+				break;
+			slot = (slot + 1) & mask;
+		}
+		indices[i] = table[slot].vertex;
+	}
+}
+
+float ComputeAcmr(const uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize)
+{
+	const size_t triangleCount = indexCount / 3;
+	if (triangleCount == 0)
+		return 0.0f;
+
+	CacheSimulation cache(vertexCount, cacheSize);
+	size_t misses = 0;
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		misses += cache.LoadTriangle(indices + 3 * t);
+	}
+	return static_cast<float>(misses) / static_cast<float>(triangleCount);
+}
+
+void OptimizeVertexCache(uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize)
+{
+	const size_t triangleCount = indexCount / 3;
+	if (triangleCount == 0)
+		return;
+
+	//triangles around every vertex, as rows of one array
+	std::vector<uint32_t> offsets(vertexCount + 1, 0);
+	for (size_t i = 0; i < 3 * triangleCount; i++)
+	{
+		offsets[indices[i] + 1]++;
+	}
+	for (size_t v = 0; v < vertexCount; v++)
+	{
+		offsets[v + 1] += offsets[v];
+	}
+	std::vector<uint32_t> adjacency(3 * triangleCount);
+	std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+	for (size_t i = 0; i < 3 * triangleCount; i++)
+	{
+		adjacency[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+	}
+
+	//corners of triangles not emitted yet, per vertex
+	std::vector<uint32_t> live(vertexCount);
+	for (size_t v = 0; v < vertexCount; v++)
+	{
+		live[v] = offsets[v + 1] - offsets[v];
+	}
+	std::vector<char> emitted(triangleCount, 0);
+	std::vector<uint32_t> deadEnds;
+	std::vector<uint32_t> candidates;
+	std::vector<uint32_t> output;
+	deadEnds.reserve(3 * triangleCount);
+	output.reserve(3 * triangleCount);
+	CacheSimulation cache(vertexCount, cacheSize);
+
+	//most recent corner with triangles left, else the lowest vertex with any
+	uint32_t cursor = 0;
+	auto skipDeadEnd = [&]() {
+		while (!deadEnds.empty())
+		{
+			const uint32_t v = deadEnds.back();
+			deadEnds.pop_back();
+			if (live[v] > 0)
+				return v;
+		}
+		while (cursor < vertexCount)
+		{
+			if (live[cursor] > 0)
+				return cursor;
+			cursor++;
+		}
+		return NO_VERTEX;
+	};
+
+	uint32_t fan = skipDeadEnd();
+	while (fan != NO_VERTEX)
+	{
+		candidates.clear();
+		for (uint32_t k = offsets[fan]; k < offsets[fan + 1]; k++)
+		{
+			const uint32_t t = adjacency[k];
+			if (emitted[t])
+				continue;
+			emitted[t] = 1;
+			for (int c = 0; c < 3; c++)
+			{
+				const uint32_t v = indices[3 * static_cast<size_t>(t) + c];
+				output.push_back(v);
+				deadEnds.push_back(v);
+				candidates.push_back(v);
+				live[v]--;
+				cache.Load(v);
+			}
+		}
+
+		//the oldest candidate that is still cached after emitting its triangles,
+		//any candidate with triangles left if none is
+		fan = NO_VERTEX;
+		int64_t best = -1;
+		for (size_t i = 0; i < candidates.size(); i++)
+		{
+			const uint32_t v = candidates[i];
+			if (live[v] == 0)
+				continue;
+			const uint32_t age = cache.time - cache.stamps[v];
+			const int64_t priority = age + 2 * static_cast<uint64_t>(live[v]) <= cacheSize ? age : 0;
+			if (priority > best)
+			{
+				best = priority;
+				fan = v;
+			}
+		}
+		if (fan == NO_VERTEX)
+			fan = skipDeadEnd();
+	}
+	memcpy(indices, output.data(), output.size() * sizeof(uint32_t));
+}
+
+uint32_t OptimizeOverdraw(uint32_t* indices, size_t indexCount, const Vertex* vertices, size_t vertexCount,
+	float threshold, uint32_t cacheSize)
+{
+	const size_t triangleCount = indexCount / 3;
+	if (triangleCount == 0)
+		return 0;
+
+	//hard boundaries: the cache order jumps to an unrelated part of the mesh
+	std::vector<uint32_t> hard;
+	CacheSimulation cache(vertexCount, cacheSize);
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		if (cache.LoadTriangle(indices + 3 * t) == 3 || t == 0)
+			hard.push_back(static_cast<uint32_t>(t));
+	}
+	hard.push_back(static_cast<uint32_t>(triangleCount));
+
+	//soft boundaries: splitting where a cluster is about as good as it will get
+	//costs at most threshold times its misses
+	std::vector<uint32_t> starts;
+	for (size_t h = 0; h + 1 < hard.size(); h++)
+	{
+		const uint32_t first = hard[h];
+		const uint32_t last = hard[h + 1];
+		cache.Flush();
+		uint32_t misses = 0;
+		for (uint32_t t = first; t < last; t++)
+		{
+			misses += cache.LoadTriangle(indices + 3 * static_cast<size_t>(t));
+		}
+		const float limit = threshold * misses / (last - first);
+
+		cache.Flush();
+		starts.push_back(first);
+		uint32_t start = first;
+		misses = 0;
+		for (uint32_t t = first; t < last; t++)
+		{
+			misses += cache.LoadTriangle(indices + 3 * static_cast<size_t>(t));
+			if (t + 1 < last && misses <= limit * (t + 1 - start))
+			{
+				cache.Flush();
+				starts.push_back(t + 1);
+				start = t + 1;
+				misses = 0;
+			}
+		}
+	}
+	starts.push_back(static_cast<uint32_t>(triangleCount));
+	const uint32_t clusterCount = static_cast<uint32_t>(starts.size() - 1);
+
+	std::vector<ClusterShape> shapes(clusterCount);
+	ClusterShape mesh;
+	for (uint32_t c = 0; c < clusterCount; c++)
+	{
+		ClusterShape& cluster = shapes[c];
+		for (uint32_t t = starts[c]; t < starts[c + 1]; t++)
+		{
+			cluster.Add(indices + 3 * static_cast<size_t>(t), vertices);
+		}
+		for (int i = 0; i < 3; i++)
+		{
+			mesh.centroid[i] += cluster.centroid[i];
+		}
+		mesh.area += cluster.area;
+	}
+
+	//outermost first; stable so equal keys keep the cache order
+	std::vector<float> keys(clusterCount);
+	std::vector<uint32_t> order(clusterCount);
+	for (uint32_t c = 0; c < clusterCount; c++)
+	{
+		keys[c] = shapes[c].SortKey(mesh);
+		order[c] = c;
+	}
+	std::stable_sort(order.begin(), order.end(), [&keys](uint32_t a, uint32_t b) { return keys[a] > keys[b]; });
+
+	std::vector<uint32_t> sorted;
+	sorted.reserve(3 * triangleCount);
+	for (uint32_t c = 0; c < clusterCount; c++)
+	{
+		const uint32_t cluster = order[c];
+		sorted.insert(sorted.end(), indices + 3 * static_cast<size_t>(starts[cluster]),
+			indices + 3 * static_cast<size_t>(starts[cluster + 1]));
+	}
+	memcpy(indices, sorted.data(), sorted.size() * sizeof(uint32_t));
+	return clusterCount;
+}
+
+void OptimizeVertexFetch(std::vector<Vertex>& vertices, uint32_t* indices, size_t indexCount)
+{
+	std::vector<uint32_t> remap(vertices.size(), NO_VERTEX);
+	std::vector<Vertex> ordered;
+	ordered.reserve(vertices.size());
+	for (size_t i = 0; i < indexCount; i++)
+	{
+		uint32_t& index = remap[indices[i]];
+		if (index == NO_VERTEX)
+		{
+			index = static_cast<uint32_t>(ordered.size());
+			ordered.push_back(vertices[indices[i]]);
+		}
+		indices[i] = index;
+	}
+	vertices.swap(ordered);
+}
+
+void OptimizeMesh(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, MeshOptimizeStats* stats)
+{
+	MeshOptimizeStats local;
+	MeshOptimizeStats& s = stats ? *stats : local;
+	uint32_t* data = indices.data();
+	const size_t count = indices.size();
+
+	s.inputAcmr = ComputeAcmr(data, count, vertices.size());
+	OptimizeVertexCache(data, count, vertices.size());
+	s.vertexCacheAcmr = ComputeAcmr(data, count, vertices.size());
+	s.clusters = OptimizeOverdraw(data, count, vertices.data(), vertices.size());
+	s.overdrawAcmr = ComputeAcmr(data, count, vertices.size());
+	OptimizeVertexFetch(vertices, data, count);
+	s.vertexFetchAcmr = ComputeAcmr(data, count, vertices.size());
+}
@@ -0,0 +1,84 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "ThreadPool.h"
+#include "Vertex.h"
+
+// --------------------------------------------------------
+// Index buffer and vertex buffer clean up for imported meshes
+//
+// Everything here runs on the CPU at import time and works on
+// triangle lists, three indices per triangle.
+// --------------------------------------------------------
+
+//entries of the FIFO post transform cache the optimizations target and ComputeAcmr simulates
+const uint32_t VERTEX_CACHE_SIZE = 16;
+//how much worse than its cluster's ACMR a split cluster may get, see OptimizeOverdraw
+const float OVERDRAW_THRESHOLD = 1.05f;
+
+//average cache miss ratio of the index buffer going into and after each step of OptimizeMesh
+struct MeshOptimizeStats
+{
+	MeshOptimizeStats() : inputAcmr(0.0f), vertexCacheAcmr(0.0f), overdrawAcmr(0.0f), vertexFetchAcmr(0.0f), clusters(0) {}
+	float inputAcmr;
+	float vertexCacheAcmr;
+	float overdrawAcmr;
+	float vertexFetchAcmr;
+	//clusters OptimizeOverdraw sorted
+	uint32_t clusters;
+};
+
+// --------------------------------------------------------
+// Merges vertices whose position, normal and uv are bitwise equal
+//
+// Every input vertex is looked up in an open addressing table
+// (linear probing, hashes computed on the pool); unique ones are
+// appended to vertices in the order they first appear and indices
+// gets one entry per input vertex, so an unindexed triangle list
+// becomes an indexed one with the same triangles.
+// --------------------------------------------------------
+void WeldVertices(const Vertex* input, size_t count, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices,
+	ThreadPool* pool = nullptr);
+
+// --------------------------------------------------------
+// Average cache miss ratio: vertex shader invocations per triangle
+// with a FIFO post transform cache of cacheSize entries. 3 is the
+// worst case, about 0.5 the best a big closed mesh can do.
+// --------------------------------------------------------
+float ComputeAcmr(const uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize = VERTEX_CACHE_SIZE);
+
+// --------------------------------------------------------
+// Reorders triangles for the post transform cache (Tipsify)
+//
+// Fans around one vertex at a time, emitting all of its triangles
+// that are left. The next vertex is the one of the last fans that
+// has triangles left and stays in the cache longest while they are
+// emitted; when there is none, the most recent corner with triangles
+// left, else the lowest such vertex. Linear in the triangle count.
+// --------------------------------------------------------
+void OptimizeVertexCache(uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize = VERTEX_CACHE_SIZE);
+
+// --------------------------------------------------------
+// Reorders clusters of triangles so that outer ones draw first
+//
+// Takes a cache optimized order and cuts it into clusters where the
+// cache simulation starts over (a triangle with three misses), and
+// again inside those wherever the cluster so far has an ACMR within
+// threshold of the whole cluster's, so the cache efficiency barely
+// changes. Clusters are then sorted by how far out they lie along
+// their own normal, measured from the mesh's centroid, so the
+// parts likely to hide others are drawn before them. Returns the
+// number of clusters.
+// --------------------------------------------------------
+uint32_t OptimizeOverdraw(uint32_t* indices, size_t indexCount, const Vertex* vertices, size_t vertexCount,
+	float threshold = OVERDRAW_THRESHOLD, uint32_t cacheSize = VERTEX_CACHE_SIZE);
+
+// --------------------------------------------------------
+// Renumbers vertices in the order the indices first use them, so
+// vertex fetches walk through the buffer. Unused vertices are dropped.
+// --------------------------------------------------------
+void OptimizeVertexFetch(std::vector<Vertex>& vertices, uint32_t* indices, size_t indexCount);
+
+//the three steps above in order, for a welded mesh
+void OptimizeMesh(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, MeshOptimizeStats* stats = nullptr);
@@ -0,0 +1,540 @@
+#include "ObjLoader.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include "MappedFile.h"
+#include "MeshOptimizer.h"
+
+namespace
+{
+	//smallest chunk worth a task of its own
+	const size_t MIN_CHUNK_SIZE = 1 << 20;
+	//triangles per task when building the vertices
+	const uint32_t TRIANGLE_GRAIN = 65536;
+	//longest number handed to strtod
+	const size_t MAX_NUMBER_LENGTH = 64;
+	//2^53, above which a mantissa isn't exact in a double
+	const uint64_t MAX_EXACT_MANTISSA = 9007199254740992ull;
+	//powers of ten that are exact in a double
+	const double POW10[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+	const int MAX_EXACT_POW10 = 22;
+
+	enum LineType
+	{
+		LINE_OTHER,
+		LINE_POSITION,
+		LINE_UV,
+		LINE_NORMAL,
+		LINE_FACE,
+	};
+
+	//uv or normal of a face that has none; relative indices resolve to at least -INT32_MAX
+	const int32_t NO_INDEX = INT32_MIN;
+
+	//one face corner, 0 based
+	struct Corner
+	{
+		int32_t position;
+		int32_t uv;
+		int32_t normal;
+	};
+
+	struct Chunk
+	{
+		const char* begin;
+		const char* end;
+		//what the chunk holds, from the counting pass
+		uint32_t positions;
+		uint32_t uvs;
+		uint32_t normals;
+		uint32_t triangles;
+		//where it goes in the merged arrays
+		uint32_t positionBase;
+		uint32_t uvBase;
+		uint32_t normalBase;
+		uint32_t triangleBase;
+		bool failed;
+	};
+
+	inline bool IsSpace(char c)
+	{
+		return c == ' ' || c == '\t' || c == '\r';
+	}
+
+	inline bool IsDigit(char c)
+	{
+		return static_cast<unsigned char>(c - '0') < 10;
+	}
+
+	inline const char* SkipSpaces(const char* p, const char* end)
+	{
+		while (p < end && IsSpace(*p))
+			p++;
+		return p;
+	}
+
+	//end of the line at p, a comment ends it too
+	inline const char* LineEnd(const char* p, const char* end)
+	{
+		const char* newline = static_cast<const char*>(memchr(p, '\n', end - p));
+		const char* lineEnd = newline ? newline : end;
+		const char* comment = static_cast<const char*>(memchr(p, '#', lineEnd - p));
+		return comment ? comment : lineEnd;
+	}
+
+	inline const char* NextLine(const char* p, const char* end)
+	{
+		const char* newline = static_cast<const char*>(memchr(p, '\n', end - p));
+		return newline ? newline + 1 : end;
+	}
+
+	//what the line is, and p moved past its keyword
+	LineType Classify(const char*& p, const char* end)
+	{
+		p = SkipSpaces(p, end);
+		if (end - p < 2)
+			return LINE_OTHER;
+		if (p[0] == 'f' && IsSpace(p[1]))
+		{
+			p += 2;
+			return LINE_FACE;
+		}
+		if (p[0] != 'v')
+			return LINE_OTHER;
+		if (IsSpace(p[1]))
+		{
+			p += 2;
+			return LINE_POSITION;
+		}
+		if (end - p < 3 || !IsSpace(p[2]))
+			return LINE_OTHER;
+		p += 3;
+		if (p[-2] == 't')
+			return LINE_UV;
+		if (p[-2] == 'n')
+			return LINE_NORMAL;
+		return LINE_OTHER;
+	}
+
+	inline uint32_t CountTokens(const char* p, const char* end)
+	{
+		uint32_t tokens = 0;
+		while (true)
+		{
+			p = SkipSpaces(p, end);
+			if (p >= end)
+				return tokens;
+			tokens++;
+			while (p < end && !IsSpace(*p))
+				p++;
+		}
+	}
+
+	//a 1 based or negative OBJ index, 0 isn't one
+	inline const char* ParseIndex(const char* p, const char* end, int32_t& index)
+	{
+		const bool negative = p < end && *p == '-';
+		if (negative)
+			p++;
+		int64_t value = 0;
+		const char* digits = p;
+		while (p < end && IsDigit(*p) && value <= INT32_MAX)
+		{
+			value = value * 10 + (*p - '0');
+			p++;
+		}
+		if (p == digits || value == 0 || value > INT32_MAX)
+			return nullptr;
+		index = static_cast<int32_t>(negative ? -value : value);
+		return p;
+	}
+
+	//0 based, relative indices counted back from count, the elements defined so far
+	inline int32_t Resolve(int32_t index, uint32_t count)
+	{
+		return index < 0 ? static_cast<int32_t>(count) + index : index - 1;
+	}
+
+	// --------------------------------------------------------
+	// Counts what a chunk holds without parsing any numbers
+	// --------------------------------------------------------
+	void CountChunk(Chunk& chunk)
+	{
+		const char* end = chunk.end;
+		for (const char* line = chunk.begin; line < end; line = NextLine(line, end))
+		{
+			const char* p = line;
+			switch (Classify(p, end))
+			{
+			case LINE_POSITION: chunk.positions++; break;
+			case LINE_UV: chunk.uvs++; break;
+			case LINE_NORMAL: chunk.normals++; break;
+			case LINE_FACE:
+			{
+				const uint32_t corners = CountTokens(p, LineEnd(p, end));
+				if (corners >= 3)
+					chunk.triangles += corners - 2;
+				break;
+			}
+			default: break;
+			}
+		}
+	}
+
+	//count floats of a v, vt or vn line into out, the first required ones must be there
+	bool ParseFloats(const char* p, const char* end, float* out, int count, int required)
+	{
+		for (int i = 0; i < count; i++)
+		{
+			p = SkipSpaces(p, end);
+			const char* next = p < end ? ParseObjFloat(p, end, out[i]) : nullptr;
+			if (!next)
+			{
+				if (i < required)
+					return false;
+				out[i] = 0.0f;
+				continue;
+			}
+			p = next;
+		}
+		return true;
+	}
+
+	// --------------------------------------------------------
+	// Parses a chunk into its ranges of the merged arrays, the
+	// faces fanned into triangles of resolved corners
+	// --------------------------------------------------------
+	void ParseChunk(Chunk& chunk, XMFLOAT3* positions, XMFLOAT2* uvs, XMFLOAT3* normals, Corner* corners)
+	{
+		uint32_t positionCount = chunk.positionBase;
+		uint32_t uvCount = chunk.uvBase;
+		uint32_t normalCount = chunk.normalBase;
+		Corner* out = corners + 3 * static_cast<size_t>(chunk.triangleBase);
+		const char* end = chunk.end;
+		for (const char* line = chunk.begin; line < end; line = NextLine(line, end))
+		{
+			const char* p = line;
+			const LineType type = Classify(p, end);
+			if (type == LINE_OTHER)
+				continue;
+
+			const char* lineEnd = LineEnd(p, end);
+			bool parsed = true;
+			if (type == LINE_POSITION)
+				parsed = ParseFloats(p, lineEnd, &positions[positionCount++].x, 3, 3);
+			else if (type == LINE_UV)
+				parsed = ParseFloats(p, lineEnd, &uvs[uvCount++].x, 2, 1);
+			else if (type == LINE_NORMAL)
+				parsed = ParseFloats(p, lineEnd, &normals[normalCount++].x, 3, 3);
+			else
+			{
+				Corner first = {};
+				Corner previous = {};
+				uint32_t cornerCount = 0;
+				while (parsed)
+				{
+					p = SkipSpaces(p, lineEnd);
+					if (p >= lineEnd)
+						break;
+
+					//v, v/vt, v//vn or v/vt/vn
+					int32_t index = 0;
+					Corner corner;
+					corner.uv = NO_INDEX;
+					corner.normal = NO_INDEX;
+					p = ParseIndex(p, lineEnd, index);
+					parsed = p != nullptr;
+					if (parsed)
+						corner.position = Resolve(index, positionCount);
+					if (parsed && p < lineEnd && *p == '/')
+					{
+						p++;
+						if (p < lineEnd && *p != '/')
+						{
+							p = ParseIndex(p, lineEnd, index);
+							parsed = p != nullptr;
+							if (parsed)
+								corner.uv = Resolve(index, uvCount);
+						}
+						if (parsed && p < lineEnd && *p == '/')
+						{
+							p = ParseIndex(p + 1, lineEnd, index);
+							parsed = p != nullptr;
+							if (parsed)
+								corner.normal = Resolve(index, normalCount);
+						}
+					}
+					if (parsed && p < lineEnd && !IsSpace(*p))
+						parsed = false;
+					if (!parsed)
+						break;
+
+					if (cornerCount == 0)
+						first = corner;
+					else if (cornerCount >= 2)
+					{
+						out[0] = first;
+						out[1] = previous;
+						out[2] = corner;
+						out += 3;
+					}
+					previous = corner;
+					cornerCount++;
+				}
+			}
+			if (!parsed)
+			{
+				chunk.failed = true;
+				return;
+			}
+		}
+	}
+
+	inline XMFLOAT3 ToLeftHanded(XMFLOAT3 v)
+	{
+		v.z = -v.z;
+		return v;
+	}
+}
+
+const char* ParseObjFloat(const char* p, const char* end, float& value)
+{
+	const char* start = p;
+	const bool negative = p < end && *p == '-';
+	if (p < end && (*p == '-' || *p == '+'))
+		p++;
+
+	//up to 19 significant digits fit in the mantissa, the rest only move the exponent
+	uint64_t mantissa = 0;
+	int significant = 0;
+	int exponent = 0;
+	bool truncated = false;
+	bool anyDigits = false;
+	for (; p < end && IsDigit(*p); p++)
+	{
+		anyDigits = true;
+		if (significant < 19)
+		{
+			mantissa = mantissa * 10 + (*p - '0');
+			significant += mantissa != 0;
+		}
+		else
+		{
+			exponent++;
+			truncated |= *p != '0';
+		}
+	}
+	if (p < end && *p == '.')
+	{
+		for (p++; p < end && IsDigit(*p); p++)
+		{
+			anyDigits = true;
+			if (significant < 19)
+			{
+				mantissa = mantissa * 10 + (*p - '0');
+				significant += mantissa != 0;
+				exponent--;
+			}
+			else
+			{
+				truncated |= *p != '0';
+			}
+		}
+	}
+	if (!anyDigits)
+		return nullptr;
+
+	if (p < end && (*p == 'e' || *p == 'E'))
+	{
+		const char* e = p + 1;
+		const bool negativeExponent = e < end && *e == '-';
+		if (e < end && (*e == '-' || *e == '+'))
+			e++;
+		if (e < end && IsDigit(*e))
+		{
+			int power = 0;
+			for (; e < end && IsDigit(*e); e++)
+			{
+				power = std::min(power * 10 + (*e - '0'), 100000);
+			}
+			exponent += negativeExponent ? -power : power;
+			p = e;
+		}
+	}
+
+	double result;
+	if (!truncated && mantissa <= MAX_EXACT_MANTISSA && exponent >= -MAX_EXACT_POW10 && exponent <= MAX_EXACT_POW10)
+	{
+		//both operands are exact, so the one rounding makes this the nearest double
+		const double m = static_cast<double>(mantissa);
+		result = exponent < 0 ? m / POW10[-exponent] : m * POW10[exponent];
+	}
+	else
+	{
+		char number[MAX_NUMBER_LENGTH];
+		const size_t length = std::min(static_cast<size_t>(p - start), MAX_NUMBER_LENGTH - 1);
+		memcpy(number, start, length);
+		number[length] = '\0';
+		result = fabs(strtod(number, nullptr));
+	}
+	value = static_cast<float>(negative ? -result : result);
+	return p;
+}
+
+bool ParseObj(const char* text, size_t size, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices,
+	ThreadPool* pool)
+{
+	vertices.clear();
+	indices.clear();
+	const char* end = text + size;
+
+	//split at line breaks, a few chunks per thread so stealing can even out the load
+	const size_t threads = pool ? pool->GetThreadCount() : 1;
+	const size_t chunkCount = std::max<size_t>(1, std::min(size / MIN_CHUNK_SIZE, 4 * threads));
+	std::vector<Chunk> chunks(chunkCount);
+	const char* begin = text;
+	for (size_t c = 0; c < chunkCount; c++)
+	{
+		Chunk& chunk = chunks[c];
+		memset(&chunk, 0, sizeof(chunk));
+		chunk.begin = begin;
+		chunk.end = c + 1 == chunkCount ? end : NextLine(std::max(begin, text + size / chunkCount * (c + 1)), end);
+		begin = chunk.end;
+	}
+	auto forEachChunk = [pool, &chunks](const ThreadPool::RangeJob& job) {
+		const uint32_t count = static_cast<uint32_t>(chunks.size());
+		if (pool && count > 1)
+			pool->ParallelFor(count, 1, job);
+		else
+			job(0, count);
+	};
+
+	forEachChunk([&chunks](uint32_t first, uint32_t last) {
+		for (uint32_t c = first; c < last; c++)
+		{
+			CountChunk(chunks[c]);
+		}
+	});
+
+	//prefix sums, checked against the 32 bit indices the arrays are addressed with
+	uint64_t positionCount = 0;
+	uint64_t uvCount = 0;
+	uint64_t normalCount = 0;
+	uint64_t triangleCount = 0;
+	for (size_t c = 0; c < chunkCount; c++)
+	{
+		Chunk& chunk = chunks[c];
+		chunk.positionBase = static_cast<uint32_t>(positionCount);
+		chunk.uvBase = static_cast<uint32_t>(uvCount);
+		chunk.normalBase = static_cast<uint32_t>(normalCount);
+		chunk.triangleBase = static_cast<uint32_t>(triangleCount);
+		positionCount += chunk.positions;
+		uvCount += chunk.uvs;
+		normalCount += chunk.normals;
+		triangleCount += chunk.triangles;
+	}
+	if (std::max(std::max(positionCount, uvCount), normalCount) > INT32_MAX || 3 * triangleCount > UINT32_MAX)
+		return false;
+
+	std::vector<XMFLOAT3> positions(static_cast<size_t>(positionCount));
+	std::vector<XMFLOAT2> uvs(static_cast<size_t>(uvCount));
+	std::vector<XMFLOAT3> normals(static_cast<size_t>(normalCount));
+	std::vector<Corner> corners(3 * static_cast<size_t>(triangleCount));
+	XMFLOAT3* positionData = positions.data();
+	XMFLOAT2* uvData = uvs.data();
+	XMFLOAT3* normalData = normals.data();
+	Corner* cornerData = corners.data();
+	forEachChunk([&chunks, positionData, uvData, normalData, cornerData](uint32_t first, uint32_t last) {
+		for (uint32_t c = first; c < last; c++)
+		{
+			ParseChunk(chunks[c], positionData, uvData, normalData, cornerData);
+		}
+	});
+	for (size_t c = 0; c < chunkCount; c++)
+	{
+		if (chunks[c].failed)
+			return false;
+	}
+
+	//one vertex per corner first, welded below
+	std::vector<Vertex> cornerVertices(corners.size());
+	Vertex* vertexData = cornerVertices.data();
+	std::atomic<bool> outOfRange(false);
+	const int32_t positionLimit = static_cast<int32_t>(positionCount);
+	const int32_t uvLimit = static_cast<int32_t>(uvCount);
+	const int32_t normalLimit = static_cast<int32_t>(normalCount);
+	ThreadPool::RangeJob buildTriangles = [=, &outOfRange](uint32_t first, uint32_t last) {
+		for (uint32_t t = first; t < last; t++)
+		{
+			const Corner* corner = cornerData + 3 * static_cast<size_t>(t);
+			Vertex* triangle = vertexData + 3 * static_cast<size_t>(t);
+			bool flat = false;
+			for (int k = 0; k < 3; k++)
+			{
+				const Corner& c = corner[k];
+				if (c.position < 0 || c.position >= positionLimit ||
+					(c.uv != NO_INDEX && (c.uv < 0 || c.uv >= uvLimit)) ||
+					(c.normal != NO_INDEX && (c.normal < 0 || c.normal >= normalLimit)))
+				{
+					outOfRange.store(true, std::memory_order_relaxed);
+					return;
+				}
+				Vertex& v = triangle[k];
+				v.Position = ToLeftHanded(positionData[c.position]);
+				v.UV = c.uv != NO_INDEX ? XMFLOAT2(uvData[c.uv].x, 1.0f - uvData[c.uv].y) : XMFLOAT2(0.0f, 0.0f);
+				if (c.normal != NO_INDEX)
+					v.Normal = ToLeftHanded(normalData[c.normal]);
+				else
+					flat = true;
+			}
+			if (!flat)
+				continue;
+
+			//negating z flips the handedness, so the outward normal of a counter
+			//clockwise face is now (p2 - p0) x (p1 - p0)
+			const XMFLOAT3& p0 = triangle[0].Position;
+			const XMFLOAT3& p1 = triangle[1].Position;
+			const XMFLOAT3& p2 = triangle[2].Position;
+			const XMFLOAT3 a(p2.x - p0.x, p2.y - p0.y, p2.z - p0.z);
+			const XMFLOAT3 b(p1.x - p0.x, p1.y - p0.y, p1.z - p0.z);
+			XMFLOAT3 n(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+			const float length = sqrtf(n.x * n.x + n.y * n.y + n.z * n.z);
+			const float inv = length > 0.0f ? 1.0f / length : 0.0f;
+			n = XMFLOAT3(n.x * inv, n.y * inv, n.z * inv);
+			for (int k = 0; k < 3; k++)
+			{
+				if (corner[k].normal == NO_INDEX)
+					triangle[k].Normal = n;
+			}
+		}
+	};
+	const uint32_t triangles = static_cast<uint32_t>(triangleCount);
+	if (pool)
+		pool->ParallelFor(triangles, TRIANGLE_GRAIN, buildTriangles);
+	else if (triangles > 0)
+		buildTriangles(0, triangles);
+	if (outOfRange.load())
+		return false;
+
+	//the parsed arrays aren't needed any more, which lowers the peak for big files
+	std::vector<Corner>().swap(corners);
+	std::vector<XMFLOAT3>().swap(positions);
+	std::vector<XMFLOAT2>().swap(uvs);
+	std::vector<XMFLOAT3>().swap(normals);
+	WeldVertices(cornerVertices.data(), cornerVertices.size(), vertices, indices, pool);
+	return true;
+}
+
+bool LoadObj(const char* path, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, ThreadPool* pool)
+{
+	vertices.clear();
+	indices.clear();
+	MappedFile file;
+	if (!file.Open(path))
+		return false;
+	return ParseObj(file.GetData(), file.GetSize(), vertices, indices, pool);
+}
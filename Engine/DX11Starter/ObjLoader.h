@@ -0,0 +1,43 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "ThreadPool.h"
+#include "Vertex.h"
+
+using namespace DirectX;
+
+// --------------------------------------------------------
+// Wavefront OBJ loading
+//
+// The file is memory mapped and cut into chunks at line breaks.
+// A first parallel pass counts the positions, uvs, normals and
+// triangles of every chunk; prefix sums over those counts give
+// each chunk its own ranges of the merged arrays, so the second
+// pass parses the chunks in parallel straight into place and
+// relative (negative) indices resolve against the global counts.
+// A last pass builds the vertices from the resolved corners.
+//
+// Faces may be v, v/vt, v//vn or v/vt/vn, with any number of
+// corners (fanned into triangles) and positive or negative
+// indices. Everything else (groups, materials, smoothing) is
+// skipped. Like the loader it replaces, the result is converted
+// to left handed: z and the normals' z are negated and v is
+// flipped. Faces without normals get their triangle's normal.
+// Corners that end up as the same vertex share it (see
+// WeldVertices), so the indices form a real index buffer.
+//
+// The result doesn't depend on the thread count.
+// --------------------------------------------------------
+
+//false on a malformed line or an index out of range, leaving the arrays empty
+bool ParseObj(const char* text, size_t size, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices,
+	ThreadPool* pool = nullptr);
+bool LoadObj(const char* path, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices,
+	ThreadPool* pool = nullptr);
+
+//parses one float at p (no leading white space); returns where it stopped, nullptr
+//if there is no number there. Up to 19 significant digits and powers of ten up to
+//22 are rounded to the nearest double with one multiply or divide, the rest go
+//through strtod.
+const char* ParseObjFloat(const char* p, const char* end, float& value);
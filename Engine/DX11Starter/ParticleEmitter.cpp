@@ -0,0 +1,344 @@
+#include "ParticleEmitter.h"
+#include <stddef.h>
+#include <string.h>
+#include <algorithm>
+#include <new>
+#include "RadixSort.h"
+#include "SimdMath.h"
+
+//WriteBillboards streams each vertex as one 16 byte store
+static_assert(sizeof(BillboardVertex) == 4 * sizeof(float), "BillboardVertex layout changed");
+
+const float ParticleEmitter::MIN_LIFETIME = 1e-3f;
+
+EmitterSettings::EmitterSettings()
+{
+	position = XMFLOAT3(0.0f, 0.0f, 0.0f);
+	velocity = XMFLOAT3(0.0f, 1.0f, 0.0f);
+	spread = 0.5f;
+	rate = 100.0f;
+	minLifetime = 1.0f;
+	maxLifetime = 2.0f;
+	gravity = XMFLOAT3(0.0f, -9.8f, 0.0f);
+	drag = 0.0f;
+	size = 0.02f;
+}
+
+ParticleEmitter::ParticleEmitter(uint32_t capacity, const EmitterSettings& settings, uint32_t seed)
+{
+	m_settings = settings;
+	m_capacity = capacity;
+	m_count = 0;
+	m_spawnDebt = 0.0f;
+	m_burst = 0;
+	//xorshift never leaves 0
+	m_rng = seed ? seed : 1;
+	m_useSimd = true;
+	m_threadPool = nullptr;
+
+	//every stream starts on a 32 byte boundary
+	const size_t stride = (static_cast<size_t>(capacity) + 7) & ~static_cast<size_t>(7);
+	m_storage = static_cast<float*>(Simd::AlignedAlloc(sizeof(float) * std::max<size_t>(stride * STREAM_COUNT, 1)));
+	if (!m_storage)
+		throw std::bad_alloc();
+	float* streams[STREAM_COUNT];
+	for (uint32_t s = 0; s < STREAM_COUNT; s++)
+	{
+		streams[s] = m_storage + s * stride;
+	}
+	m_posX = streams[0];
+	m_posY = streams[1];
+	m_posZ = streams[2];
+	m_velX = streams[3];
+	m_velY = streams[4];
+	m_velZ = streams[5];
+	m_age = streams[6];
+	m_lifetime = streams[7];
+}
+
+ParticleEmitter::~ParticleEmitter()
+{
+	Simd::AlignedFree(m_storage);
+}
+
+void ParticleEmitter::Update(float dt)
+{
+	if (m_count > 0)
+	{
+		Integrate(dt);
+		Compact();
+	}
+
+	m_spawnDebt += m_settings.rate * dt;
+	uint32_t spawn = static_cast<uint32_t>(m_spawnDebt);
+	m_spawnDebt -= static_cast<float>(spawn);
+	spawn += m_burst;
+	m_burst = 0;
+	Spawn(spawn);
+}
+
+// --------------------------------------------------------
+// Ages and moves every live particle, semi-implicit Euler with
+// drag. Each chunk notes whether anything in it died, so Compact
+// only has to look at those.
+// --------------------------------------------------------
+void ParticleEmitter::Integrate(float dt)
+{
+	m_chunkDied.assign((m_count + PARALLEL_GRAIN - 1) / PARALLEL_GRAIN, 0);
+
+	const float damp = std::max(0.0f, 1.0f - m_settings.drag * dt);
+	const float gx = m_settings.gravity.x * dt;
+	const float gy = m_settings.gravity.y * dt;
+	const float gz = m_settings.gravity.z * dt;
+	ParallelChunks(m_count, [this, dt, damp, gx, gy, gz](uint32_t begin, uint32_t end) {
+		for (uint32_t chunk = begin; chunk < end; chunk += PARALLEL_GRAIN)
+		{
+			const uint32_t chunkEnd = std::min(chunk + PARALLEL_GRAIN, end);
+			bool died = false;
+			uint32_t i = chunk;
+			if (m_useSimd)
+			{
+				const Simd::Float vDt = Simd::Set1(dt);
+				const Simd::Float vDamp = Simd::Set1(damp);
+				const Simd::Float vGx = Simd::Set1(gx);
+				const Simd::Float vGy = Simd::Set1(gy);
+				const Simd::Float vGz = Simd::Set1(gz);
+				const uint32_t simdEnd = chunk + Simd::AlignDown(chunkEnd - chunk);
+				for (; i < simdEnd; i += Simd::WIDTH)
+				{
+					const Simd::Float vx = Simd::Mul(Simd::Add(Simd::LoadU(m_velX + i), vGx), vDamp);
+					const Simd::Float vy = Simd::Mul(Simd::Add(Simd::LoadU(m_velY + i), vGy), vDamp);
+					const Simd::Float vz = Simd::Mul(Simd::Add(Simd::LoadU(m_velZ + i), vGz), vDamp);
+					Simd::StoreU(m_velX + i, vx);
+					Simd::StoreU(m_velY + i, vy);
+					Simd::StoreU(m_velZ + i, vz);
+					Simd::StoreU(m_posX + i, Simd::Add(Simd::LoadU(m_posX + i), Simd::Mul(vx, vDt)));
+					Simd::StoreU(m_posY + i, Simd::Add(Simd::LoadU(m_posY + i), Simd::Mul(vy, vDt)));
+					Simd::StoreU(m_posZ + i, Simd::Add(Simd::LoadU(m_posZ + i), Simd::Mul(vz, vDt)));
+					const Simd::Float age = Simd::Add(Simd::LoadU(m_age + i), vDt);
+					Simd::StoreU(m_age + i, age);
+					died |= Simd::Any(Simd::CmpLt(Simd::LoadU(m_lifetime + i), age));
+				}
+			}
+			for (; i < chunkEnd; i++)
+			{
+				const float vx = (m_velX[i] + gx) * damp;
+				const float vy = (m_velY[i] + gy) * damp;
+				const float vz = (m_velZ[i] + gz) * damp;
+				m_velX[i] = vx;
+				m_velY[i] = vy;
+				m_velZ[i] = vz;
+				m_posX[i] = m_posX[i] + vx * dt;
+				m_posY[i] = m_posY[i] + vy * dt;
+				m_posZ[i] = m_posZ[i] + vz * dt;
+				m_age[i] = m_age[i] + dt;
+				died |= m_lifetime[i] < m_age[i];
+			}
+			if (died)
+				m_chunkDied[chunk / PARALLEL_GRAIN] = 1;
+		}
+	});
+}
+
+// --------------------------------------------------------
+// Swap-removes the dead particles: the last live particle moves
+// into the hole, and is checked again since it may be dead too.
+// Chunks where nothing died can't gain a dead particle this way,
+// so they are skipped, and within a chunk whole vectors of live
+// particles are.
+// --------------------------------------------------------
+void ParticleEmitter::Compact()
+{
+	float* streams[STREAM_COUNT] = { m_posX, m_posY, m_posZ, m_velX, m_velY, m_velZ, m_age, m_lifetime };
+	uint32_t count = m_count;
+	for (uint32_t chunk = 0; chunk < m_chunkDied.size(); chunk++)
+	{
+		const uint32_t begin = chunk * PARALLEL_GRAIN;
+		if (begin >= count)
+			break;
+		if (!m_chunkDied[chunk])
+			continue;
+
+		uint32_t end = std::min(begin + PARALLEL_GRAIN, count);
+		uint32_t i = begin;
+		while (i < end)
+		{
+			if (m_useSimd && i + Simd::WIDTH <= end &&
+				!Simd::Any(Simd::CmpLt(Simd::LoadU(m_lifetime + i), Simd::LoadU(m_age + i))))
+			{
+				i += Simd::WIDTH;
+				continue;
+			}
+			if (m_lifetime[i] < m_age[i])
+			{
+				count--;
+				for (uint32_t s = 0; s < STREAM_COUNT; s++)
+				{
+					streams[s][i] = streams[s][count];
+				}
+				end = std::min(end, count);
+			}
+			else
+			{
+				i++;
+			}
+		}
+	}
+	m_count = count;
+}
+
+// --------------------------------------------------------
+// Appends up to count new particles at the emitter. The randoms
+// come from one sequential generator, so they don't depend on the
+// kernel, and the SIMD pass turns them into velocities and
+// lifetimes.
+// --------------------------------------------------------
+void ParticleEmitter::Spawn(uint32_t count)
+{
+	count = std::min(count, m_capacity - m_count);
+	if (count == 0)
+		return;
+
+	m_random.resize(4 * static_cast<size_t>(count));
+	for (size_t j = 0; j < m_random.size(); j++)
+	{
+		m_random[j] = NextRandom();
+	}
+	const float* rx = m_random.data();
+	const float* ry = rx + count;
+	const float* rz = ry + count;
+	const float* rt = rz + count;
+
+	const EmitterSettings& s = m_settings;
+	const float lifeRange = s.maxLifetime - s.minLifetime;
+	const uint32_t base = m_count;
+	uint32_t j = 0;
+	if (m_useSimd)
+	{
+		const Simd::Float vOne = Simd::Set1(1.0f);
+		const Simd::Float vTwo = Simd::Set1(2.0f);
+		const Simd::Float vSpread = Simd::Set1(s.spread);
+		const Simd::Float vVx = Simd::Set1(s.velocity.x);
+		const Simd::Float vVy = Simd::Set1(s.velocity.y);
+		const Simd::Float vVz = Simd::Set1(s.velocity.z);
+		const Simd::Float vPx = Simd::Set1(s.position.x);
+		const Simd::Float vPy = Simd::Set1(s.position.y);
+		const Simd::Float vPz = Simd::Set1(s.position.z);
+		const Simd::Float vMinLife = Simd::Set1(s.minLifetime);
+		const Simd::Float vLifeRange = Simd::Set1(lifeRange);
+		const Simd::Float vFloor = Simd::Set1(MIN_LIFETIME);
+		const uint32_t simdEnd = Simd::AlignDown(count);
+		for (; j < simdEnd; j += Simd::WIDTH)
+		{
+			const uint32_t i = base + j;
+			Simd::StoreU(m_posX + i, vPx);
+			Simd::StoreU(m_posY + i, vPy);
+			Simd::StoreU(m_posZ + i, vPz);
+			Simd::StoreU(m_velX + i, Simd::Add(vVx, Simd::Mul(Simd::Sub(Simd::Mul(Simd::LoadU(rx + j), vTwo), vOne), vSpread)));
+			Simd::StoreU(m_velY + i, Simd::Add(vVy, Simd::Mul(Simd::Sub(Simd::Mul(Simd::LoadU(ry + j), vTwo), vOne), vSpread)));
+			Simd::StoreU(m_velZ + i, Simd::Add(vVz, Simd::Mul(Simd::Sub(Simd::Mul(Simd::LoadU(rz + j), vTwo), vOne), vSpread)));
+			Simd::StoreU(m_age + i, Simd::Zero());
+			Simd::StoreU(m_lifetime + i, Simd::Max(Simd::Add(vMinLife, Simd::Mul(Simd::LoadU(rt + j), vLifeRange)), vFloor));
+		}
+	}
+	for (; j < count; j++)
+	{
+		const uint32_t i = base + j;
+		m_posX[i] = s.position.x;
+		m_posY[i] = s.position.y;
+		m_posZ[i] = s.position.z;
+		m_velX[i] = s.velocity.x + (rx[j] * 2.0f - 1.0f) * s.spread;
+		m_velY[i] = s.velocity.y + (ry[j] * 2.0f - 1.0f) * s.spread;
+		m_velZ[i] = s.velocity.z + (rz[j] * 2.0f - 1.0f) * s.spread;
+		m_age[i] = 0.0f;
+		m_lifetime[i] = std::max(s.minLifetime + rt[j] * lifeRange, MIN_LIFETIME);
+	}
+	m_count += count;
+}
+
+//xorshift32, 24 bits of it as a float in [0, 1)
+float ParticleEmitter::NextRandom()
+{
+	m_rng ^= m_rng << 13;
+	m_rng ^= m_rng >> 17;
+	m_rng ^= m_rng << 5;
+	return static_cast<float>(m_rng >> 8) * (1.0f / 16777216.0f);
+}
+
+void ParticleEmitter::WriteBillboards(BillboardVertex* vertices, const XMFLOAT3& right, const XMFLOAT3& up) const
+{
+	//corner c is -1/+1 along right for bit 0 and along up for bit 1
+	float offsetX[4];
+	float offsetY[4];
+	float offsetZ[4];
+	for (int c = 0; c < 4; c++)
+	{
+		const float sr = (c & 1) ? m_settings.size : -m_settings.size;
+		const float su = (c & 2) ? m_settings.size : -m_settings.size;
+		offsetX[c] = right.x * sr + up.x * su;
+		offsetY[c] = right.y * sr + up.y * su;
+		offsetZ[c] = right.z * sr + up.z * su;
+	}
+
+	const bool stream = m_useSimd && (reinterpret_cast<uintptr_t>(vertices) & 15) == 0;
+	ParallelChunks(m_count, [this, vertices, stream, &offsetX, &offsetY, &offsetZ](uint32_t begin, uint32_t end) {
+		uint32_t i = begin;
+#if !defined(SIMD_SCALAR)
+		if (stream)
+		{
+			//4 particles at a time, one transpose and 4 stores per corner
+			const __m128 vOne = _mm_set1_ps(1.0f);
+			for (; i + 4 <= end; i += 4)
+			{
+				const __m128 px = _mm_loadu_ps(m_posX + i);
+				const __m128 py = _mm_loadu_ps(m_posY + i);
+				const __m128 pz = _mm_loadu_ps(m_posZ + i);
+				const __m128 fade = _mm_sub_ps(vOne, _mm_div_ps(_mm_loadu_ps(m_age + i), _mm_loadu_ps(m_lifetime + i)));
+				float* out = reinterpret_cast<float*>(vertices + 4 * static_cast<size_t>(i));
+				for (int c = 0; c < 4; c++)
+				{
+					__m128 x = _mm_add_ps(px, _mm_set1_ps(offsetX[c]));
+					__m128 y = _mm_add_ps(py, _mm_set1_ps(offsetY[c]));
+					__m128 z = _mm_add_ps(pz, _mm_set1_ps(offsetZ[c]));
+					__m128 f = fade;
+					_MM_TRANSPOSE4_PS(x, y, z, f);
+					_mm_stream_ps(out + 4 * c, x);
+					_mm_stream_ps(out + 16 + 4 * c, y);
+					_mm_stream_ps(out + 32 + 4 * c, z);
+					_mm_stream_ps(out + 48 + 4 * c, f);
+				}
+			}
+		}
+#endif
+		for (; i < end; i++)
+		{
+			const float fade = 1.0f - m_age[i] / m_lifetime[i];
+			BillboardVertex* quad = vertices + 4 * static_cast<size_t>(i);
+			for (int c = 0; c < 4; c++)
+			{
+				quad[c].Position = XMFLOAT3(m_posX[i] + offsetX[c], m_posY[i] + offsetY[c], m_posZ[i] + offsetZ[c]);
+				quad[c].Fade = fade;
+			}
+		}
+		//the streamed lines have to land before the buffer is unmapped
+		if (stream)
+			Simd::StreamFence();
+	});
+}
+
+void ParticleEmitter::WriteDepthKeys(const XMFLOAT4X4& view, uint32_t firstValue, uint32_t* keys, uint32_t* values) const
+{
+	ParallelChunks(m_count, [this, &view, firstValue, keys, values](uint32_t begin, uint32_t end) {
+		::WriteDepthKeys(m_posX + begin, m_posY + begin, m_posZ + begin, end - begin, view,
+			firstValue + begin, keys + begin, values + begin, m_useSimd);
+	});
+}
+
+void ParticleEmitter::ParallelChunks(uint32_t count, const ThreadPool::RangeJob& job) const
+{
+	//chunks start on multiples of PARALLEL_GRAIN, which m_chunkDied is indexed by
+	if (m_threadPool && count > PARALLEL_GRAIN)
+		m_threadPool->ParallelFor(count, PARALLEL_GRAIN, job);
+	else if (count > 0)
+		job(0, count);
+}
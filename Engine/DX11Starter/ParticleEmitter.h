@@ -0,0 +1,118 @@
+#pragma once
+#include <DirectXMath.h>
+#include <stdint.h>
+#include <vector>
+#include "ThreadPool.h"
+#include "Vertex.h"
+
+using namespace DirectX;
+
+//how an emitter spawns and moves its particles
+struct EmitterSettings
+{
+	EmitterSettings();
+
+	//where particles spawn and the velocity they spawn with
+	XMFLOAT3 position;
+	XMFLOAT3 velocity;
+	//random velocity added on each axis, -spread..spread
+	float spread;
+	//particles per second
+	float rate;
+	//seconds a particle lives, picked uniformly in between
+	float minLifetime;
+	float maxLifetime;
+	XMFLOAT3 gravity;
+	//fraction of the velocity lost per second
+	float drag;
+	//half the edge of a billboard
+	float size;
+};
+
+// --------------------------------------------------------
+// Emitter-based particles (sparks, smoke) in a fixed-size pool
+//
+// Unlike ParticleSystem, which is a cloth solver, these particles
+// don't interact. Every stream (position, velocity, age, lifetime)
+// is a separate SoA array carved out of one aligned block sized for
+// the emitter's capacity, so nothing is allocated per particle.
+// Live particles are always [0, GetCount): Update ages and moves
+// them in parallel chunks, swap-removes the dead ones (the last live
+// particle takes the dead one's place) and appends the new ones,
+// which are dropped once the pool is full.
+// --------------------------------------------------------
+class ParticleEmitter
+{
+public:
+	//particles per task when an emitter spreads its own work
+	static const uint32_t PARALLEL_GRAIN = 16384;
+	static const float MIN_LIFETIME;
+
+	ParticleEmitter(uint32_t capacity, const EmitterSettings& settings, uint32_t seed = 1);
+	~ParticleEmitter();
+
+	//changes take effect with the next Update
+	EmitterSettings& GetSettings() { return m_settings; }
+	const EmitterSettings& GetSettings() const { return m_settings; }
+	//spawn count particles with the next Update, on top of the rate
+	void Burst(uint32_t count) { m_burst += count; }
+	void Update(float dt);
+	//kill every particle
+	void Clear() { m_count = 0; }
+
+	//write 4 BillboardVertex per live particle, facing the camera whose
+	//right and up axes are given; 16 byte aligned memory gets streaming stores
+	void WriteBillboards(BillboardVertex* vertices, const XMFLOAT3& right, const XMFLOAT3& up) const;
+	//back to front depth keys of the live particles (see ::WriteDepthKeys),
+	//with values firstValue + particle index
+	void WriteDepthKeys(const XMFLOAT4X4& view, uint32_t firstValue, uint32_t* keys, uint32_t* values) const;
+
+	uint32_t GetCount() const { return m_count; }
+	uint32_t GetCapacity() const { return m_capacity; }
+	const float* GetPositionX() const { return m_posX; }
+	const float* GetPositionY() const { return m_posY; }
+	const float* GetPositionZ() const { return m_posZ; }
+	const float* GetAge() const { return m_age; }
+	const float* GetLifetime() const { return m_lifetime; }
+
+	//switch between the SSE/AVX2 kernels and the scalar reference path
+	void SetSimdEnabled(bool enabled) { m_useSimd = enabled; }
+	bool IsSimdEnabled() const { return m_useSimd; }
+	//spread big emitters over a pool (nullptr = calling thread only)
+	void SetThreadPool(ThreadPool* pool) { m_threadPool = pool; }
+
+private:
+	//position, velocity x/y/z each, age and lifetime
+	static const uint32_t STREAM_COUNT = 8;
+
+	EmitterSettings m_settings;
+	uint32_t m_capacity;
+	uint32_t m_count;
+	float* m_storage;
+	float* m_posX;
+	float* m_posY;
+	float* m_posZ;
+	float* m_velX;
+	float* m_velY;
+	float* m_velZ;
+	float* m_age;
+	float* m_lifetime;
+	//per chunk of the last Integrate: did anything die
+	std::vector<uint8_t> m_chunkDied;
+	//uniform 0..1 randoms of the particles being spawned, 4 per particle
+	std::vector<float> m_random;
+	float m_spawnDebt;
+	uint32_t m_burst;
+	uint32_t m_rng;
+	bool m_useSimd;
+	ThreadPool* m_threadPool;
+
+	void Integrate(float dt);
+	void Compact();
+	void Spawn(uint32_t count);
+	float NextRandom();
+	void ParallelChunks(uint32_t count, const ThreadPool::RangeJob& job) const;
+
+	ParticleEmitter(const ParticleEmitter&);
+	ParticleEmitter& operator=(const ParticleEmitter&);
+};
@@ -0,0 +1,18 @@
+// Soft round spark, premultiplied alpha
+cbuffer externalData : register(b0)
+{
+	float4 color;
+};
+
+struct VertexToPixel
+{
+	float4 position		: SV_POSITION;
+	float2 uv			: TEXCOORD;
+	float fade			: FADE;
+};
+
+float4 main(VertexToPixel input) : SV_TARGET
+{
+	float falloff = saturate(1.0f - length(input.uv * 2.0f - 1.0f));
+	return color * (falloff * falloff * input.fade);
+}
@@ -1,181 +1,1060 @@
 #include "ParticleSystem.h"
+#include <float.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include "ClothSnapshot.h"
 
+const float ParticleSystem::DEFAULT_SLEEP_SPEED = 0.002f;
+const float ParticleSystem::DEFAULT_ITERATION_TOLERANCE = 0.05f;
+const float ParticleSystem::DEFAULT_JACOBI_RELAXATION = 2.4f;
+const float ParticleSystem::DEFAULT_SPECTRAL_RADIUS = 0.9f;
 
-
-ParticleSystem::ParticleSystem()
+ParticleSystem::ParticleSystem(uint32_t width, uint32_t height, uint32_t iterations, float* storage)
 {
+	m_width = width;
+	m_height = height;
+	m_numParticles = width * height;
+	m_numIterations = iterations;
+	m_adaptiveIterations = false;
+	m_iterationTolerance = DEFAULT_ITERATION_TOLERANCE;
+	m_minIterations = 1;
+	m_maxIterations = iterations;
+	m_lastIterations = 0;
+	m_lastMaxError = 0.0f;
+	m_lastRmsError = 0.0f;
+	m_useSimd = true;
+	m_deterministic = true;
+	m_threadPool = nullptr;
+	m_solver = ClothSolver::GaussSeidel;
+	m_jacobiRelaxation = DEFAULT_JACOBI_RELAXATION;
+	m_spectralRadius = DEFAULT_SPECTRAL_RADIUS;
+	m_chebyshevOmega = 1.0f;
+	m_chebyshevStep = 0;
+	m_previousSweepMax = 0.0f;
+	m_substeps = DEFAULT_SUBSTEPS;
+	m_substepIterations = 1;
+	m_selfCollisionEnabled = false;
+	m_colliders = nullptr;
+	m_recorder = nullptr;
+	m_damping = 0.0f;
+	m_sleepingEnabled = false;
+	m_sleepSpeed = DEFAULT_SLEEP_SPEED;
+	m_tilesX = (width + TILE_DIM - 1) / TILE_DIM;
+	m_tilesZ = (height + TILE_DIM - 1) / TILE_DIM;
+	m_awakeTileCount = m_tilesX * m_tilesZ;
+	m_sleepDirty = true;
+
+	m_ownsStorage = (storage == nullptr);
+	if (m_ownsStorage)
+	{
+		storage = static_cast<float*>(Simd::AlignedAlloc(sizeof(float) * GetStorageSize(width, height)));
+	}
+	BindStreams(storage);
+	m_EdgeConstraint.resize(width);
 }
 
 
 ParticleSystem::~ParticleSystem()
 {
-	for (int i = 0; i < m_StickConstraint.size(); i++)
-	{
-		if (m_StickConstraint[i]) delete m_StickConstraint[i];
-	}
+	if (m_ownsStorage)
+		Simd::AlignedFree(m_storage);
+}
+
+size_t ParticleSystem::GetStorageSize(uint32_t width, uint32_t height)
+{
+	//each stream is padded to a whole AVX vector so all of them stay 32 byte aligned
+	const size_t stride = (static_cast<size_t>(width) * height + 7) & ~static_cast<size_t>(7);
+	return stride * STREAM_COUNT;
+}
+
+void ParticleSystem::BindStreams(float* storage)
+{
+	const size_t stride = GetStorageSize(m_width, m_height) / STREAM_COUNT;
+	m_storage = storage;
+	m_streams.posX = m_storage + 0 * stride;
+	m_streams.posY = m_storage + 1 * stride;
+	m_streams.posZ = m_storage + 2 * stride;
+	m_streams.oldPosX = m_storage + 3 * stride;
+	m_streams.oldPosY = m_storage + 4 * stride;
+	m_streams.oldPosZ = m_storage + 5 * stride;
+	m_streams.accelerationX = m_storage + 6 * stride;
+	m_streams.accelerationY = m_storage + 7 * stride;
+	m_streams.accelerationZ = m_storage + 8 * stride;
+	m_stepStartX = m_storage + 9 * stride;
+	m_stepStartY = m_storage + 10 * stride;
+	m_stepStartZ = m_storage + 11 * stride;
+}
+
+void ParticleSystem::RelocateStorage(float* storage)
+{
+	if (storage == m_storage)
+		return;
+	//memmove, a pool compacting downwards may hand us an overlapping block
+	memmove(storage, m_storage, sizeof(float) * GetStorageSize(m_width, m_height));
+	if (m_ownsStorage)
+		Simd::AlignedFree(m_storage);
+	m_ownsStorage = false;
+	BindStreams(storage);
 }
 
 void ParticleSystem::Update(float dt)
 {
 	//printf("dt: %f\n", dt);
-	AccumulateForces();
-	Verlet(dt);
-	StatisfyConstraints();
+	if (m_recorder)
+		m_recorder->BeginStep(*this, dt);
+	if (m_sleepingEnabled)
+		WakeTiles();
+
+	if (m_solver == ClothSolver::XPBD)
+	{
+		UpdateXPBD(dt);
+	}
+	else
+	{
+		AccumulateForces();
+		Verlet(dt);
+		StatisfyConstraints();
+	}
+
+	if (m_sleepingEnabled)
+		UpdateSleep(dt);
+	if (m_recorder)
+		m_recorder->EndStep(*this);
+}
+
+// --------------------------------------------------------
+// XPBD step: the frame is split into m_substeps small steps, each
+// integrating, then relaxing every stick m_substepIterations times
+// with its compliance. Stiffness then depends on the compliance,
+// not on how many sweeps are run, and substeps buy more stiffness
+// per constraint evaluation than extra Gauss-Seidel sweeps do.
+// --------------------------------------------------------
+void ParticleSystem::UpdateXPBD(float dt)
+{
+	const float h = dt / static_cast<float>(m_substeps);
+	m_lastIterations = m_substeps * m_substepIterations;
+	for (uint32_t step = 0; step < m_substeps; step++)
+	{
+		AccumulateForces();
+		Verlet(h);
+		ApplyEdgeConstraint();
+
+		std::fill(m_stickLambda.begin(), m_stickLambda.end(), 0.0f);
+		std::fill(m_activeLambda.begin(), m_activeLambda.end(), 0.0f);
+		std::fill(m_borderLambda.begin(), m_borderLambda.end(), 0.0f);
+		for (uint32_t j = 0; j < m_substepIterations; j++)
+		{
+			SolveStickSweepXPBD(h);
+			SolveCollisions();
+		}
+		SolveSelfCollision();
+	}
+}
+
+void ParticleSystem::SetSubsteps(uint32_t substeps, uint32_t iterationsPerSubstep)
+{
+	m_substeps = substeps > 0 ? substeps : 1;
+	m_substepIterations = iterationsPerSubstep > 0 ? iterationsPerSubstep : 1;
+}
+
+void ParticleSystem::SetJacobiAcceleration(float relaxation, float spectralRadius)
+{
+	m_jacobiRelaxation = relaxation;
+	m_spectralRadius = spectralRadius > 0.0f && spectralRadius < 1.0f ? spectralRadius : 0.0f;
+}
+
+void ParticleSystem::SetAdaptiveIterations(bool enabled, float tolerance, uint32_t minIterations, uint32_t maxIterations)
+{
+	m_adaptiveIterations = enabled;
+	m_iterationTolerance = tolerance;
+	m_minIterations = minIterations > 0 ? minIterations : 1;
+	m_maxIterations = maxIterations > 0 ? maxIterations : 2 * m_numIterations;
+	if (m_maxIterations < m_minIterations)
+		m_maxIterations = m_minIterations;
+	m_lastMaxError = 0.0f;
+	m_lastRmsError = 0.0f;
+}
+
+void ParticleSystem::SetSelfCollision(bool enabled, float thickness, bool skipGridNeighbours)
+{
+	m_selfCollisionEnabled = enabled;
+	if (thickness > 0.0f)
+		m_selfCollision.SetThickness(thickness);
+	m_selfCollision.SetSkipGridNeighbours(skipGridNeighbours);
+}
+
+void ParticleSystem::SetCompliance(float compliance)
+{
+	std::fill(m_stickCompliance.begin(), m_stickCompliance.end(), compliance);
+	m_sleepDirty = true;
+}
+
+void ParticleSystem::SetSleeping(bool enabled, float speed)
+{
+	m_sleepingEnabled = enabled;
+	m_sleepSpeed = speed;
+	WakeAll();
+}
+
+void ParticleSystem::WakeAll()
+{
+	for (uint32_t t = 0; t < m_tileAsleep.size(); t++)
+	{
+		if (m_tileAsleep[t])
+			SetTileAsleep(t, false);
+	}
+	m_tileAsleep.assign(m_tilesX * m_tilesZ, 0);
+	m_tileStillSteps.assign(m_tilesX * m_tilesZ, 0);
+	m_tileMotion.assign(m_tilesX * m_tilesZ, 0.0f);
+	m_tileDrift.assign(m_tilesX * m_tilesZ, 0.0f);
+	m_tileBounds.resize(m_tilesX * m_tilesZ);
+	m_anchorX.assign(m_streams.posX, m_streams.posX + m_numParticles);
+	m_anchorY.assign(m_streams.posY, m_streams.posY + m_numParticles);
+	m_anchorZ.assign(m_streams.posZ, m_streams.posZ + m_numParticles);
+	m_sleepDirty = true;
 }
 
 void ParticleSystem::Init()
 {
 	m_vGravity = XMFLOAT3(0.f, -0.50f, 0.f);
 	const float length = 1.0f;
-	const float size = length / (static_cast<float>(PARTICLE_DIM - 1.0f));
+	const float size = length / (static_cast<float>(m_width - 1.0f));
 	float height = .50f;
 
-	//build vertices 
+	//build vertices
 	uint32_t ii = 0;
-	for (uint32_t zz = 0; zz < PARTICLE_DIM; ++zz) {
-		for (uint32_t xx = 0; xx < PARTICLE_DIM; ++xx) {
-			m_pos[ii] = XMFLOAT3(
-				static_cast<float>(xx) * size - (length / 2),
-				height,
-				static_cast<float>(zz) * size - (length / 2)
-			);
-			m_oldPos[ii] = m_pos[ii];
+	for (uint32_t zz = 0; zz < m_height; ++zz) {
+		for (uint32_t xx = 0; xx < m_width; ++xx) {
+			m_streams.posX[ii] = static_cast<float>(xx) * size - (length / 2);
+			m_streams.posY[ii] = height;
+			m_streams.posZ[ii] = static_cast<float>(zz) * size - (length / 2);
+			m_streams.oldPosX[ii] = m_streams.posX[ii];
+			m_streams.oldPosY[ii] = m_streams.posY[ii];
+			m_streams.oldPosZ[ii] = m_streams.posZ[ii];
+			m_streams.accelerationX[ii] = 0.0f;
+			m_streams.accelerationY[ii] = 0.0f;
+			m_streams.accelerationZ[ii] = 0.0f;
+			m_stepStartX[ii] = m_streams.posX[ii];
+			m_stepStartY[ii] = m_streams.posY[ii];
+			m_stepStartZ[ii] = m_streams.posZ[ii];
 			ii++;
 
 		}
 	}
 
-	//build stick constraint 
+	//build stick constraint
 	m_restLength = size;
-	//save edge constraint 
-	for (uint32_t xx = 0; xx < PARTICLE_DIM; xx++) {
-		m_EdgeConstraint[xx] = m_pos[xx];
+	if (m_selfCollision.GetThickness() <= 0.0f)
+		m_selfCollision.SetThickness(0.5f * m_restLength);
+	//save edge constraint
+	for (uint32_t xx = 0; xx < m_width; xx++) {
+		m_EdgeConstraint[xx] = GetParticlesPos(xx);
 	}
 
-	//build stick constraints (horizontal sticks)
-	for (uint32_t zz = 0; zz < PARTICLE_DIM; zz++)
+	//build stick constraints, coloured so no two sticks in a batch touch
+	//the same particle: even and odd columns of the horizontal sticks,
+	//then even and odd rows of the vertical sticks
+	m_stickA.clear();
+	m_stickB.clear();
+	m_stickBatches.clear();
+	const uint32_t stickCount = m_height * (m_width - 1) + m_width * (m_height - 1);
+	m_stickA.reserve(stickCount);
+	m_stickB.reserve(stickCount);
+	//horizontal sticks
+	AddStickBatch(0, 2, m_width / 2, m_width, m_height, 1);
+	AddStickBatch(1, 2, (m_width - 1) / 2, m_width, m_height, 1);
+	//vertical sticks
+	AddStickBatch(0, 1, m_width, 2 * m_width, m_height / 2, m_width);
+	AddStickBatch(m_width, 1, m_width, 2 * m_width, (m_height - 1) / 2, m_width);
+
+	//the pinned edge row never moves in the XPBD solve
+	m_invMass.assign(m_numParticles, 1.0f);
+	std::fill(m_invMass.begin(), m_invMass.begin() + m_width, 0.0f);
+	m_stickCompliance.assign(m_stickA.size(), 0.0f);
+	m_stickLambda.assign(m_stickA.size(), 0.0f);
+
+	WakeAll();
+}
+
+// --------------------------------------------------------
+// Appends one colour batch of sticks laid out on the grid
+//
+// firstA    - particle index of the first stick's A end
+// strideA   - step between sticks within a row
+// countA    - sticks per row
+// rowStride - step between rows of the batch
+// rows      - number of rows
+// offsetB   - B end = A end + offsetB
+// --------------------------------------------------------
+void ParticleSystem::AddStickBatch(uint32_t firstA, uint32_t strideA, uint32_t countA, uint32_t rowStride, uint32_t rows, uint32_t offsetB)
+{
+	uint32_t begin = static_cast<uint32_t>(m_stickA.size());
+	for (uint32_t row = 0; row < rows; row++)
 	{
-		for (uint32_t xx = 0; xx < PARTICLE_DIM - 1; xx++)
+		for (uint32_t ii = 0; ii < countA; ii++)
 		{
-			uint32_t particleA = xx + PARTICLE_DIM * zz;
-			uint32_t particleB = particleA + 1;
-
-			StickConstraint* pStick = new StickConstraint(particleA, particleB);
-			m_StickConstraint.push_back(pStick);
+			uint32_t particleA = firstA + row * rowStride + ii * strideA;
+			m_stickA.push_back(particleA);
+			m_stickB.push_back(particleA + offsetB);
 		}
 	}
-	//build stick constraints (vertical sticks)
-	for (uint32_t xx = 0; xx < PARTICLE_DIM; xx++)
+	uint32_t end = static_cast<uint32_t>(m_stickA.size());
+	if (end > begin)
+		m_stickBatches.push_back(StickBatch(begin, end));
+}
+
+XMFLOAT3 ParticleSystem::GetParticlesPos(uint32_t ii) const
+{
+	return XMFLOAT3(m_streams.posX[ii], m_streams.posY[ii], m_streams.posZ[ii]);
+}
+
+XMFLOAT3 ParticleSystem::GetInterpolatedPos(uint32_t ii, float alpha) const
+{
+	//weighted so alpha = 1 gives exactly the current position
+	const float beta = 1.0f - alpha;
+	return XMFLOAT3(
+		m_stepStartX[ii] * beta + m_streams.posX[ii] * alpha,
+		m_stepStartY[ii] * beta + m_streams.posY[ii] * alpha,
+		m_stepStartZ[ii] * beta + m_streams.posZ[ii] * alpha);
+}
+
+void ParticleSystem::GetInterpolatedPositions(uint32_t begin, uint32_t end, float alpha, float* x, float* y, float* z) const
+{
+	const float beta = 1.0f - alpha;
+	uint32_t i = begin;
+	if (m_useSimd)
 	{
-		for (uint32_t zz = 0; zz < PARTICLE_DIM - 1; zz++)
+		const Simd::Float vAlpha = Simd::Set1(alpha);
+		const Simd::Float vBeta = Simd::Set1(beta);
+		const uint32_t simdEnd = begin + Simd::AlignDown(end - begin);
+		for (; i < simdEnd; i += Simd::WIDTH)
 		{
-			uint32_t p0 = xx + PARTICLE_DIM * zz;
-			uint32_t p1 = p0 + PARTICLE_DIM;
-
-			StickConstraint* pStick = new StickConstraint(p0, p1);
-			m_StickConstraint.push_back(pStick);
+			Simd::StoreU(x + i - begin, Simd::Add(Simd::Mul(Simd::LoadU(m_stepStartX + i), vBeta), Simd::Mul(Simd::LoadU(m_streams.posX + i), vAlpha)));
+			Simd::StoreU(y + i - begin, Simd::Add(Simd::Mul(Simd::LoadU(m_stepStartY + i), vBeta), Simd::Mul(Simd::LoadU(m_streams.posY + i), vAlpha)));
+			Simd::StoreU(z + i - begin, Simd::Add(Simd::Mul(Simd::LoadU(m_stepStartZ + i), vBeta), Simd::Mul(Simd::LoadU(m_streams.posZ + i), vAlpha)));
 		}
 	}
+	for (; i < end; i++)
+	{
+		x[i - begin] = m_stepStartX[i] * beta + m_streams.posX[i] * alpha;
+		y[i - begin] = m_stepStartY[i] * beta + m_streams.posY[i] * alpha;
+		z[i - begin] = m_stepStartZ[i] * beta + m_streams.posZ[i] * alpha;
+	}
 }
 
-XMFLOAT3 & ParticleSystem::GetParticlesPos(uint32_t ii)
+void ParticleSystem::SaveStepStart()
 {
-	return m_pos[ii];
+	ParallelRange(m_numParticles, [this](uint32_t begin, uint32_t end) {
+		const size_t bytes = sizeof(float) * (end - begin);
+		memcpy(m_stepStartX + begin, m_streams.posX + begin, bytes);
+		memcpy(m_stepStartY + begin, m_streams.posY + begin, bytes);
+		memcpy(m_stepStartZ + begin, m_streams.posZ + begin, bytes);
+	});
 }
 
-void ParticleSystem::Verlet(float dt)
+namespace
 {
-	float f1 = 1.0f;
-	float f2 = 1.0f;
+	const uint32_t STATE_MAGIC = 0x54534c43; //"CLST"
+	const uint32_t STATE_VERSION = 2;
+	//the blob carries the sleeping tile section
+	const uint32_t STATE_SLEEP = 1;
 
-	for (int i = 0; i < NUM_PARTICLES; i++) 
+	struct StateHeader
 	{
-		XMFLOAT3& pos = m_pos[i];
-		XMFLOAT3 temp = pos;
-		XMFLOAT3& oldPos = m_oldPos[i];
-		XMFLOAT3& acceleration = m_acceleration[i];
-		//Integrate old pos and new pos with acceleration 
-		pos.x += f1 * pos.x - f2 * oldPos.x + acceleration.x * dt * dt;
-		pos.y += f1 * pos.y - f2 * oldPos.y + acceleration.y * dt * dt;
-		pos.z += f1 * pos.z - f2 * oldPos.z + acceleration.z * dt * dt;
+		uint32_t magic;
+		uint32_t version;
+		uint32_t width;
+		uint32_t height;
+		uint32_t stickCount;
+		uint32_t flags;
+	};
 
-		oldPos = temp;
-		m_acceleration[i] = XMFLOAT3(0.f, 0.0f, 0.f);
+	void Append(std::vector<uint8_t>& out, const void* data, size_t bytes)
+	{
+		const uint8_t* p = static_cast<const uint8_t*>(data);
+		out.insert(out.end(), p, p + bytes);
+	}
+
+	const uint8_t* Take(const uint8_t* p, void* data, size_t bytes)
+	{
+		memcpy(data, p, bytes);
+		return p + bytes;
 	}
 }
 
-void ParticleSystem::StatisfyConstraints()
+// --------------------------------------------------------
+// State layout, all in host byte order:
+//   StateHeader
+//   edge constraint              width x XMFLOAT3
+//   pos x/y/z, old pos x/y/z     6 x n floats
+//   stick compliance             stickCount floats
+// and with STATE_SLEEP
+//   tile asleep, still steps     tiles x uint8, tiles x uint32
+//   tile bounds                  tiles x Bounds
+//   previous edge                width x XMFLOAT3
+//   still window anchors x/y/z   3 x n floats
+// Accelerations are always zero between steps and aren't stored.
+// --------------------------------------------------------
+void ParticleSystem::SaveState(std::vector<uint8_t>& out) const
 {
-	//statisfy edge constraint c1
-	for (uint32_t xx = 0; xx < PARTICLE_DIM; xx++)
+	const uint32_t tileCount = m_tilesX * m_tilesZ;
+	StateHeader header;
+	header.magic = STATE_MAGIC;
+	header.version = STATE_VERSION;
+	header.width = m_width;
+	header.height = m_height;
+	header.stickCount = GetStickCount();
+	header.flags = m_sleepingEnabled ? STATE_SLEEP : 0;
+
+	const size_t floats = sizeof(float) * m_numParticles;
+	out.clear();
+	out.reserve(sizeof(header) + sizeof(XMFLOAT3) * m_width * 2 + floats * 6 + sizeof(float) * header.stickCount +
+		(sizeof(uint8_t) + sizeof(uint32_t) + sizeof(ColliderSet::Bounds)) * tileCount + floats * 3);
+	Append(out, &header, sizeof(header));
+	Append(out, m_EdgeConstraint.data(), sizeof(XMFLOAT3) * m_width);
+	Append(out, m_streams.posX, floats);
+	Append(out, m_streams.posY, floats);
+	Append(out, m_streams.posZ, floats);
+	Append(out, m_streams.oldPosX, floats);
+	Append(out, m_streams.oldPosY, floats);
+	Append(out, m_streams.oldPosZ, floats);
+	Append(out, m_stickCompliance.data(), sizeof(float) * header.stickCount);
+	if (m_sleepingEnabled)
 	{
-		m_pos[xx] = m_EdgeConstraint[xx];
+		Append(out, m_tileAsleep.data(), sizeof(uint8_t) * tileCount);
+		Append(out, m_tileStillSteps.data(), sizeof(uint32_t) * tileCount);
+		Append(out, m_tileBounds.data(), sizeof(ColliderSet::Bounds) * tileCount);
+		//no step has run yet, so there is nothing to compare the edge to
+		const std::vector<XMFLOAT3>& previousEdge = m_previousEdge.size() == m_width ? m_previousEdge : m_EdgeConstraint;
+		Append(out, previousEdge.data(), sizeof(XMFLOAT3) * m_width);
+		Append(out, m_anchorX.data(), floats);
+		Append(out, m_anchorY.data(), floats);
+		Append(out, m_anchorZ.data(), floats);
 	}
-	for (int j = 0; j < NUM_ITERATIONS; j++)
+}
+
+bool ParticleSystem::RestoreState(const uint8_t* data, size_t size)
+{
+	StateHeader header;
+	if (!data || size < sizeof(header))
+		return false;
+	data = Take(data, &header, sizeof(header));
+	if (header.magic != STATE_MAGIC || header.version != STATE_VERSION ||
+		header.width != m_width || header.height != m_height || header.stickCount != GetStickCount())
+		return false;
+
+	const uint32_t tileCount = m_tilesX * m_tilesZ;
+	const size_t floats = sizeof(float) * m_numParticles;
+	size_t expected = sizeof(header) + sizeof(XMFLOAT3) * m_width + floats * 6 + sizeof(float) * header.stickCount;
+	if (header.flags & STATE_SLEEP)
+		expected += (sizeof(uint8_t) + sizeof(uint32_t) + sizeof(ColliderSet::Bounds)) * tileCount + sizeof(XMFLOAT3) * m_width + floats * 3;
+	if (size != expected)
+		return false;
+
+	//wake first, waking rewrites the old positions about to be loaded
+	const bool restoreSleep = (header.flags & STATE_SLEEP) && m_sleepingEnabled;
+	if (!restoreSleep)
+		WakeAll();
+
+	data = Take(data, m_EdgeConstraint.data(), sizeof(XMFLOAT3) * m_width);
+	data = Take(data, m_streams.posX, floats);
+	data = Take(data, m_streams.posY, floats);
+	data = Take(data, m_streams.posZ, floats);
+	data = Take(data, m_streams.oldPosX, floats);
+	data = Take(data, m_streams.oldPosY, floats);
+	data = Take(data, m_streams.oldPosZ, floats);
+	data = Take(data, m_stickCompliance.data(), sizeof(float) * header.stickCount);
+	memset(m_streams.accelerationX, 0, floats);
+	memset(m_streams.accelerationY, 0, floats);
+	memset(m_streams.accelerationZ, 0, floats);
+	memcpy(m_stepStartX, m_streams.posX, floats);
+	memcpy(m_stepStartY, m_streams.posY, floats);
+	memcpy(m_stepStartZ, m_streams.posZ, floats);
+	//WakeAll anchored the positions that were just replaced
+	if (!restoreSleep)
 	{
-		//statisfy c2 (stick constraints)
-		for(auto it = m_StickConstraint.begin(); it != m_StickConstraint.end(); ++it)
+		m_anchorX.assign(m_streams.posX, m_streams.posX + m_numParticles);
+		m_anchorY.assign(m_streams.posY, m_streams.posY + m_numParticles);
+		m_anchorZ.assign(m_streams.posZ, m_streams.posZ + m_numParticles);
+	}
+
+	if (restoreSleep)
+	{
+		data = Take(data, m_tileAsleep.data(), sizeof(uint8_t) * tileCount);
+		data = Take(data, m_tileStillSteps.data(), sizeof(uint32_t) * tileCount);
+		data = Take(data, m_tileBounds.data(), sizeof(ColliderSet::Bounds) * tileCount);
+		m_previousEdge.resize(m_width);
+		data = Take(data, m_previousEdge.data(), sizeof(XMFLOAT3) * m_width);
+		data = Take(data, m_anchorX.data(), floats);
+		data = Take(data, m_anchorY.data(), floats);
+		data = Take(data, m_anchorZ.data(), floats);
+		for (uint32_t i = 0; i < m_numParticles; i++)
 		{
-			StickConstraint* pStick = *it;
-			XMFLOAT3& x1 = m_pos[pStick->particleA];
-			XMFLOAT3& x2 = m_pos[pStick->particleB];
+			m_invMass[i] = m_tileAsleep[GetTile(i)] || i < m_width ? 0.0f : 1.0f;
+		}
+	}
+	m_sleepDirty = true;
+	return true;
+}
 
-			XMFLOAT3 delta;
-			delta.x = x2.x - x1.x;
-			delta.y = x2.y - x1.y;
-			delta.z = x2.z - x1.z;
+// --------------------------------------------------------
+// Runs job over [0, count) on the thread pool, or inline when there
+// is no pool. Chunks are kept a multiple of 8 so every chunk starts
+// on a 32 byte boundary.
+// --------------------------------------------------------
+void ParticleSystem::ParallelRange(uint32_t count, const ThreadPool::RangeJob& job)
+{
+	if (!m_threadPool)
+	{
+		job(0, count);
+		return;
+	}
 
-			float deltalength = sqrt(delta.x * delta.x + delta.y * delta.y + delta.z * delta.z);
-			float diff = (deltalength - m_restLength) / deltalength;
-			//float diff = delta * (1 - m_restLength / deltalength);
+	uint32_t grain = PARALLEL_GRAIN;
+	if (!m_deterministic)
+	{
+		//aim for a few chunks per thread so stealing can balance the load
+		uint32_t chunks = m_threadPool->GetThreadCount() * 4;
+		grain = (count + chunks - 1) / chunks;
+		grain = (grain + 7) & ~7u;
+		if (grain < MIN_GRAIN) grain = MIN_GRAIN;
+	}
+	m_threadPool->ParallelFor(count, grain, job);
+}
 
-			x1.x += delta.x * 0.5f * diff;
-			x1.y += delta.y * 0.5f * diff;
-			x1.z += delta.z * 0.5f * diff;
+// --------------------------------------------------------
+// The awake particles are numbered through the awake runs and
+// chunked like the dense range; each chunk runs job once per run
+// it overlaps. Runs span whole grid rows wherever a row of tiles is
+// awake, so a mostly awake cloth gets ranges about as long as the
+// dense path's, and a fully awake one runs exactly the dense path.
+// The jobs are per particle, so the result doesn't depend on the
+// chunking.
+// --------------------------------------------------------
+void ParticleSystem::ParallelParticles(const ThreadPool::RangeJob& job)
+{
+	const uint32_t awakeCount = m_awakeRunOffsets.empty() ? 0 : m_awakeRunOffsets.back();
+	if (!m_sleepingEnabled || awakeCount == m_numParticles)
+	{
+		ParallelRange(m_numParticles, job);
+		return;
+	}
+	if (awakeCount == 0)
+		return;
 
-			x2.x -= delta.x * 0.5f * diff;
-			x2.y -= delta.y * 0.5f * diff;
-			x2.z -= delta.z * 0.5f * diff;
+	ParallelRange(awakeCount, [this, &job](uint32_t begin, uint32_t end) {
+		size_t r = std::upper_bound(m_awakeRunOffsets.begin(), m_awakeRunOffsets.end(), begin) - m_awakeRunOffsets.begin() - 1;
+		while (begin < end)
+		{
+			const uint32_t first = m_awakeRuns[r].begin + (begin - m_awakeRunOffsets[r]);
+			const uint32_t count = std::min(end, m_awakeRunOffsets[r + 1]) - begin;
+			job(first, first + count);
+			begin += count;
+			r++;
 		}
+	});
+}
 
-		//staisfy sphere constraint
-		for (uint32_t ii = 0; ii < NUM_PARTICLES; ii++)
+// --------------------------------------------------------
+// Sleeping particles get zero inverse mass, so XPBD treats them as
+// pinned, and no velocity: falling asleep freezes them in place and
+// whatever nudged them while asleep is not carried over on waking.
+// --------------------------------------------------------
+void ParticleSystem::SetTileAsleep(uint32_t tile, bool asleep)
+{
+	m_tileAsleep[tile] = asleep ? 1 : 0;
+	m_tileStillSteps[tile] = 0;
+	//only sleeping tiles are tested against moving colliders
+	ColliderSet::Bounds& bounds = m_tileBounds[tile];
+	bounds.min = XMFLOAT3(FLT_MAX, FLT_MAX, FLT_MAX);
+	bounds.max = XMFLOAT3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	ForEachTileRow(tile, [this, asleep, &bounds](uint32_t begin, uint32_t end) {
+		for (uint32_t i = begin; i < end; i++)
 		{
-			//Calc P' = Center + ContactNormal * Radius
-			float bias = 0.010f;
-			float sphereRadius = 0.20f + bias;
-			XMFLOAT3 sphereCenter = XMFLOAT3(0.f, 0.f, 0.f);
-			XMFLOAT3& p = m_pos[ii];
-			XMFLOAT3 contactNormal;
+			bounds.min.x = std::min(bounds.min.x, m_streams.posX[i]);
+			bounds.min.y = std::min(bounds.min.y, m_streams.posY[i]);
+			bounds.min.z = std::min(bounds.min.z, m_streams.posZ[i]);
+			bounds.max.x = std::max(bounds.max.x, m_streams.posX[i]);
+			bounds.max.y = std::max(bounds.max.y, m_streams.posY[i]);
+			bounds.max.z = std::max(bounds.max.z, m_streams.posZ[i]);
+			m_streams.oldPosX[i] = m_streams.posX[i];
+			m_streams.oldPosY[i] = m_streams.posY[i];
+			m_streams.oldPosZ[i] = m_streams.posZ[i];
+			//the edge row stays pinned either way
+			m_invMass[i] = asleep || i < m_width ? 0.0f : 1.0f;
+		}
+	});
+	if (!asleep)
+		AnchorTile(tile);
+	m_sleepDirty = true;
+}
+
+void ParticleSystem::AnchorTile(uint32_t tile)
+{
+	ForEachTileRow(tile, [this](uint32_t begin, uint32_t end) {
+		const size_t bytes = sizeof(float) * (end - begin);
+		memcpy(m_anchorX.data() + begin, m_streams.posX + begin, bytes);
+		memcpy(m_anchorY.data() + begin, m_streams.posY + begin, bytes);
+		memcpy(m_anchorZ.data() + begin, m_streams.posZ + begin, bytes);
+	});
+}
 
-			contactNormal.x = p.x - sphereCenter.x;
-			contactNormal.y = p.y - sphereCenter.y;
-			contactNormal.z = p.z - sphereCenter.z;
+void ParticleSystem::WakeTile(uint32_t tile)
+{
+	if (m_tileAsleep[tile])
+		SetTileAsleep(tile, false);
+}
 
-			float deltaLength = sqrtf(
-				contactNormal.x * contactNormal.x + 
-				contactNormal.y * contactNormal.y + 
-				contactNormal.z * contactNormal.z);
+// --------------------------------------------------------
+// Wakes sleeping tiles before a step: edge tiles whose pinned
+// position changed, and tiles overlapped by a collider that moved.
+// --------------------------------------------------------
+void ParticleSystem::WakeTiles()
+{
+	m_previousEdge.resize(m_width, XMFLOAT3(0.f, 0.f, 0.f));
+	for (uint32_t xx = 0; xx < m_width; xx++)
+	{
+		if (m_previousEdge[xx].x != m_EdgeConstraint[xx].x ||
+			m_previousEdge[xx].y != m_EdgeConstraint[xx].y ||
+			m_previousEdge[xx].z != m_EdgeConstraint[xx].z)
+			WakeTile(xx / TILE_DIM);
+		m_previousEdge[xx] = m_EdgeConstraint[xx];
+	}
 
-			if (deltaLength < sphereRadius)
+	if (m_colliders)
+	{
+		const std::vector<ColliderSet::Bounds>& moved = m_colliders->GetMovedBounds();
+		for (size_t k = 0; k < moved.size(); k++)
+		{
+			for (uint32_t t = 0; t < m_tileAsleep.size(); t++)
+			{
+				const ColliderSet::Bounds& tile = m_tileBounds[t];
+				if (m_tileAsleep[t] &&
+					moved[k].min.x <= tile.max.x && moved[k].max.x >= tile.min.x &&
+					moved[k].min.y <= tile.max.y && moved[k].max.y >= tile.min.y &&
+					moved[k].min.z <= tile.max.z && moved[k].max.z >= tile.min.z)
+					WakeTile(t);
+			}
+		}
+	}
+
+	if (m_sleepDirty)
+		RebuildActiveSet();
+}
+
+// --------------------------------------------------------
+// Measures how far every tracked tile moved in the last (sub)step
+// and since its still window started, and updates who sleeps. An
+// awake tile counts as still while none of its particles got
+// further from their anchor than SLEEP_STEPS frames at the sleep
+// speed would take them; leaving that reach starts the window
+// over. Jitter in place, like cloth resting on a collider, stays
+// within it even when single steps are fast. A tile falls asleep
+// after SLEEP_STEPS still frames; a sleeping tile wakes when
+// sticks dragged it far enough, or when a neighbour moves fast
+// and left its reach.
+// --------------------------------------------------------
+void ParticleSystem::UpdateSleep(float dt)
+{
+	const uint32_t trackedCount = static_cast<uint32_t>(m_trackedTiles.size());
+	ThreadPool::RangeJob measure = [this](uint32_t begin, uint32_t end) {
+		for (uint32_t t = begin; t < end; t++)
+		{
+			const uint32_t tile = m_trackedTiles[t];
+			float motion = 0.0f;
+			float drift = 0.0f;
+			ForEachTileRow(tile, [this, &motion, &drift](uint32_t rowBegin, uint32_t rowEnd) {
+				ClothKernels::MaxMotion(m_streams, m_anchorX.data(), m_anchorY.data(), m_anchorZ.data(),
+					rowBegin, rowEnd, m_useSimd, motion, drift);
+			});
+			m_tileMotion[tile] = motion;
+			m_tileDrift[tile] = drift;
+		}
+	};
+	const uint32_t tileGrain = PARALLEL_GRAIN / (TILE_DIM * TILE_DIM);
+	if (m_threadPool && trackedCount > tileGrain)
+		m_threadPool->ParallelFor(trackedCount, tileGrain, measure);
+	else
+		measure(0, trackedCount);
+
+	//XPBD's last move was one substep
+	const float h = m_solver == ClothSolver::XPBD ? dt / static_cast<float>(m_substeps) : dt;
+	const float sleepMotion = m_sleepSpeed * h * m_sleepSpeed * h;
+	const float wakeMotion = sleepMotion * WAKE_FACTOR * WAKE_FACTOR;
+	const float reach = m_sleepSpeed * dt * SLEEP_STEPS;
+	const float stillDrift = reach * reach;
+	for (uint32_t t = 0; t < trackedCount; t++)
+	{
+		const uint32_t tile = m_trackedTiles[t];
+		const float motion = m_tileMotion[tile];
+		if (m_tileAsleep[tile])
+		{
+			//x* stays frozen while asleep, so this is the drift since falling asleep
+			if (motion >= wakeMotion)
+				WakeTile(tile);
+			continue;
+		}
+
+		if (m_tileDrift[tile] <= stillDrift)
+		{
+			m_tileStillSteps[tile]++;
+			continue;
+		}
+		//any earlier position does as the anchor, so a tile that is clearly
+		//on the move keeps the old one instead of copying a new one every step
+		m_tileStillSteps[tile] = 0;
+		if (motion <= stillDrift)
+			AnchorTile(tile);
+		if (motion >= wakeMotion)
+		{
+			const uint32_t tx = tile % m_tilesX;
+			const uint32_t tz = tile / m_tilesX;
+			for (uint32_t nz = tz > 0 ? tz - 1 : 0; nz <= std::min(tz + 1, m_tilesZ - 1); nz++)
 			{
-				contactNormal.x /= deltaLength;
-				contactNormal.y /= deltaLength;
-				contactNormal.z /= deltaLength;
+				for (uint32_t nx = tx > 0 ? tx - 1 : 0; nx <= std::min(tx + 1, m_tilesX - 1); nx++)
+				{
+					WakeTile(nz * m_tilesX + nx);
+				}
+			}
+		}
+	}
 
-				m_pos[ii].x = sphereCenter.x + (sphereRadius * contactNormal.x);
-				m_pos[ii].y = sphereCenter.y + (sphereRadius * contactNormal.y);
-				m_pos[ii].z = sphereCenter.z + (sphereRadius * contactNormal.z);
+	//a tile only sleeps once its whole neighbourhood is still too, otherwise
+	//the sticks to a moving neighbour would drag it straight awake again
+	for (uint32_t t = 0; t < m_awakeTileCount; t++)
+	{
+		const uint32_t tile = m_trackedTiles[t];
+		if (m_tileAsleep[tile] || m_tileStillSteps[tile] < SLEEP_STEPS)
+			continue;
+		const uint32_t tx = tile % m_tilesX;
+		const uint32_t tz = tile / m_tilesX;
+		bool still = true;
+		for (uint32_t nz = tz > 0 ? tz - 1 : 0; nz <= std::min(tz + 1, m_tilesZ - 1); nz++)
+		{
+			for (uint32_t nx = tx > 0 ? tx - 1 : 0; nx <= std::min(tx + 1, m_tilesX - 1); nx++)
+			{
+				const uint32_t neighbour = nz * m_tilesX + nx;
+				still = still && (m_tileAsleep[neighbour] || m_tileStillSteps[neighbour] >= SLEEP_STEPS);
 			}
 		}
+		if (!still)
+			continue;
+
+		SetTileAsleep(tile, true);
 	}
 }
 
-void ParticleSystem::AccumulateForces()
+// --------------------------------------------------------
+// Collects the awake tiles (plus their sleeping neighbours for
+// motion tracking), the runs of awake particles and the sticks
+// with at least one awake end.
+// Only runs when a tile changed state, so steady sleeping costs
+// nothing here.
+// --------------------------------------------------------
+void ParticleSystem::RebuildActiveSet()
+{
+	const uint32_t tileCount = m_tilesX * m_tilesZ;
+	m_trackedTiles.clear();
+	for (uint32_t t = 0; t < tileCount; t++)
+	{
+		if (!m_tileAsleep[t])
+			m_trackedTiles.push_back(t);
+	}
+	m_awakeTileCount = static_cast<uint32_t>(m_trackedTiles.size());
+	m_awakeRuns.clear();
+	for (uint32_t zz = 0; zz < m_height; zz++)
+	{
+		for (uint32_t tx = 0; tx < m_tilesX; tx++)
+		{
+			if (m_tileAsleep[(zz / TILE_DIM) * m_tilesX + tx])
+				continue;
+			const uint32_t begin = zz * m_width + tx * TILE_DIM;
+			const uint32_t end = zz * m_width + std::min((tx + 1) * TILE_DIM, m_width);
+			if (!m_awakeRuns.empty() && m_awakeRuns.back().end == begin)
+				m_awakeRuns.back().end = end;
+			else
+				m_awakeRuns.push_back(ParticleRun(begin, end));
+		}
+	}
+	m_awakeRunOffsets.assign(1, 0);
+	for (size_t r = 0; r < m_awakeRuns.size(); r++)
+	{
+		m_awakeRunOffsets.push_back(m_awakeRunOffsets.back() + m_awakeRuns[r].end - m_awakeRuns[r].begin);
+	}
+	for (uint32_t t = 0; t < tileCount; t++)
+	{
+		if (!m_tileAsleep[t])
+			continue;
+		const uint32_t tx = t % m_tilesX;
+		const uint32_t tz = t / m_tilesX;
+		bool bordersAwake = false;
+		for (uint32_t nz = tz > 0 ? tz - 1 : 0; nz <= std::min(tz + 1, m_tilesZ - 1); nz++)
+		{
+			for (uint32_t nx = tx > 0 ? tx - 1 : 0; nx <= std::min(tx + 1, m_tilesX - 1); nx++)
+			{
+				bordersAwake = bordersAwake || !m_tileAsleep[nz * m_tilesX + nx];
+			}
+		}
+		if (bordersAwake)
+			m_trackedTiles.push_back(t);
+	}
+
+	m_activeStickA.clear();
+	m_activeStickB.clear();
+	m_activeCompliance.clear();
+	m_activeBatches.clear();
+	m_borderStickAwake.clear();
+	m_borderStickAsleep.clear();
+	m_borderCompliance.clear();
+	for (auto it = m_stickBatches.begin(); it != m_stickBatches.end(); ++it)
+	{
+		const uint32_t begin = static_cast<uint32_t>(m_activeStickA.size());
+		for (uint32_t k = it->begin; k < it->end; k++)
+		{
+			const bool asleepA = m_tileAsleep[GetTile(m_stickA[k])] != 0;
+			const bool asleepB = m_tileAsleep[GetTile(m_stickB[k])] != 0;
+			if (asleepA && asleepB)
+				continue;
+			if (asleepA || asleepB)
+			{
+				m_borderStickAwake.push_back(asleepA ? m_stickB[k] : m_stickA[k]);
+				m_borderStickAsleep.push_back(asleepA ? m_stickA[k] : m_stickB[k]);
+				m_borderCompliance.push_back(m_stickCompliance[k]);
+				continue;
+			}
+			m_activeStickA.push_back(m_stickA[k]);
+			m_activeStickB.push_back(m_stickB[k]);
+			m_activeCompliance.push_back(m_stickCompliance[k]);
+		}
+		const uint32_t end = static_cast<uint32_t>(m_activeStickA.size());
+		if (end > begin)
+			m_activeBatches.push_back(StickBatch(begin, end));
+	}
+	m_activeLambda.assign(m_activeStickA.size(), 0.0f);
+	m_borderLambda.assign(m_borderStickAwake.size(), 0.0f);
+	m_sleepDirty = false;
+}
+
+void ParticleSystem::Verlet(float dt)
+{
+	const float dt2 = dt * dt;
+	ParallelParticles([this, dt2](uint32_t begin, uint32_t end) {
+		ClothKernels::Verlet(m_streams, begin, end, dt2, m_damping, m_useSimd);
+	});
+}
+
+// --------------------------------------------------------
+// Gauss-Seidel or Jacobi relaxation. With adaptive iterations every
+// sweep also measures the stretch each stick had before it was
+// corrected, and the loop ends once the largest one is within
+// tolerance: a resting cloth gets away with a couple of sweeps, a
+// yanked one keeps going up to m_maxIterations. Only the maximum
+// decides when to stop, which doesn't depend on how the sweep was
+// chunked, so the iteration count is the same for any thread count.
+// --------------------------------------------------------
+void ParticleSystem::StatisfyConstraints()
+{
+	//statisfy edge constraint c1
+	ApplyEdgeConstraint();
+
+	const uint32_t maxIterations = m_adaptiveIterations ? m_maxIterations : m_numIterations;
+	const float tolerance = m_iterationTolerance * m_restLength;
+	uint32_t j = 0;
+	//every ParallelRange returns only once all of its chunks are done,
+	//which is the barrier between batches and between iterations
+	while (j < maxIterations)
+	{
+		m_sweepError = StickError();
+
+		//statisfy c2 (stick constraints)
+		if (m_solver == ClothSolver::Jacobi)
+			SolveStickSweepJacobi(j);
+		else
+			SolveStickSweep();
+
+		//staisfy collider constraints
+		SolveCollisions();
+
+		j++;
+		if (m_adaptiveIterations && j >= m_minIterations && m_sweepError.maxError <= tolerance)
+			break;
+	}
+	m_lastIterations = j;
+	if (m_adaptiveIterations)
+	{
+		m_lastMaxError = m_sweepError.maxError / m_restLength;
+		m_lastRmsError = m_sweepError.count > 0 ? sqrtf(m_sweepError.sumSquares / m_sweepError.count) / m_restLength : 0.0f;
+	}
+
+	SolveSelfCollision();
+}
+
+void ParticleSystem::MergeSweepError(const StickError& error)
+{
+	std::lock_guard<std::mutex> lock(m_sweepErrorLock);
+	m_sweepError.maxError = std::max(m_sweepError.maxError, error.maxError);
+	m_sweepError.sumSquares += error.sumSquares;
+	m_sweepError.count += error.count;
+}
+
+void ParticleSystem::ApplyEdgeConstraint()
+{
+	for (uint32_t xx = 0; xx < m_width; xx++)
+	{
+		m_streams.posX[xx] = m_EdgeConstraint[xx].x;
+		m_streams.posY[xx] = m_EdgeConstraint[xx].y;
+		m_streams.posZ[xx] = m_EdgeConstraint[xx].z;
+	}
+}
+
+void ParticleSystem::SolveCollisions()
+{
+	if (!m_colliders || m_colliders->GetColliderCount() == 0)
+		return;
+
+	ParallelParticles([this](uint32_t begin, uint32_t end) {
+		m_colliders->Collide(m_streams, begin, end, m_useSimd);
+	});
+}
+
+// --------------------------------------------------------
+// One Jacobi pass of particle-particle collision, once per step
+// after the stick iterations. The pinned edge and sleeping tiles
+// have zero inverse mass, so the pass leaves them where they are.
+// --------------------------------------------------------
+void ParticleSystem::SolveSelfCollision()
+{
+	if (!m_selfCollisionEnabled || (m_sleepingEnabled && m_awakeTileCount == 0))
+		return;
+	m_selfCollision.Build(m_streams, m_numParticles, m_threadPool);
+	m_selfCollision.Solve(m_streams, m_invMass.data(), m_numParticles, m_width, m_threadPool);
+}
+
+void ParticleSystem::SolveStickSweep()
+{
+	//sleeping cloths only relax the sticks that touch an awake tile
+	const std::vector<StickBatch>& batches = m_sleepingEnabled ? m_activeBatches : m_stickBatches;
+	const uint32_t* stickA = m_sleepingEnabled ? m_activeStickA.data() : m_stickA.data();
+	const uint32_t* stickB = m_sleepingEnabled ? m_activeStickB.data() : m_stickB.data();
+
+	//one independent batch at a time
+	for (auto it = batches.begin(); it != batches.end(); ++it)
+	{
+		const uint32_t batchBegin = it->begin;
+		ParallelRange(it->end - it->begin, [this, batchBegin, stickA, stickB](uint32_t begin, uint32_t end) {
+			if (!m_adaptiveIterations)
+			{
+				ClothKernels::SolveSticks(m_streams, stickA, stickB, batchBegin + begin, batchBegin + end, m_restLength, m_useSimd);
+				return;
+			}
+			StickError error;
+			ClothKernels::SolveSticks(m_streams, stickA, stickB, batchBegin + begin, batchBegin + end, m_restLength, m_useSimd, &error);
+			MergeSweepError(error);
+		});
+	}
+
+	//only the tile perimeter, cheap enough to run on this thread
+	if (!m_sleepingEnabled)
+		return;
+	StickError* error = m_adaptiveIterations ? &m_sweepError : nullptr;
+	for (size_t k = 0; k < m_borderStickAwake.size(); k++)
+	{
+		ClothKernels::AddStickError(error, ClothKernels::SolveStickFixedB(m_streams, m_borderStickAwake[k], m_borderStickAsleep[k], m_restLength));
+	}
+}
+
+// --------------------------------------------------------
+// One Jacobi sweep over the particles, then the move to its result.
+// With a spectral radius set, the moves follow the Chebyshev weights
+//   omega(0) = 1, omega(1) = 2 / (2 - rho^2),
+//   omega(k) = 4 / (4 - rho^2 * omega(k - 1))
+// which extrapolate along the direction the iterations are heading.
+// The sweeps then always measure the stretch, and once the largest
+// one grows the weights have overshot and start over at omega(0);
+// without that, 4 sweeps a frame blew up the larger cloths. Taking
+// rho from the measured error ratio, or starting the weights after
+// a few plain sweeps, left more stretch in the benchmark scenes
+// than the fixed default did. Even so, a sweep only moves a
+// correction one stick along the grid, and it takes ~40 sweeps to
+// reach the worst stretch 8 Gauss-Seidel sweeps leave. Both passes
+// are order independent, and the maximum doesn't depend on the
+// chunking, so the result is the same for any thread count.
+// --------------------------------------------------------
+void ParticleSystem::SolveStickSweepJacobi(uint32_t iteration)
+{
+	m_jacobiX.resize(m_numParticles);
+	m_jacobiY.resize(m_numParticles);
+	m_jacobiZ.resize(m_numParticles);
+
+	const bool chebyshev = m_spectralRadius > 0.0f;
+	ParallelParticles([this, chebyshev](uint32_t begin, uint32_t end) {
+		if (!m_adaptiveIterations && !chebyshev)
+		{
+			ClothKernels::JacobiSticks(m_streams, m_invMass.data(), m_jacobiX.data(), m_jacobiY.data(), m_jacobiZ.data(),
+				m_width, m_height, begin, end, m_restLength, m_jacobiRelaxation, m_useSimd);
+			return;
+		}
+		StickError error;
+		ClothKernels::JacobiSticks(m_streams, m_invMass.data(), m_jacobiX.data(), m_jacobiY.data(), m_jacobiZ.data(),
+			m_width, m_height, begin, end, m_restLength, m_jacobiRelaxation, m_useSimd, &error);
+		MergeSweepError(error);
+	});
+
+	if (chebyshev)
+	{
+		m_previousX.resize(m_numParticles);
+		m_previousY.resize(m_numParticles);
+		m_previousZ.resize(m_numParticles);
+		//the largest stretch growing means the weights overshoot, start them over
+		const float sweepMax = m_sweepError.maxError;
+		if (iteration == 0 || sweepMax > m_previousSweepMax)
+			m_chebyshevStep = 0;
+		m_previousSweepMax = sweepMax;
+		const float rho2 = m_spectralRadius * m_spectralRadius;
+		if (m_chebyshevStep == 0)
+			m_chebyshevOmega = 1.0f;
+		else if (m_chebyshevStep == 1)
+			m_chebyshevOmega = 2.0f / (2.0f - rho2);
+		else
+			m_chebyshevOmega = 4.0f / (4.0f - rho2 * m_chebyshevOmega);
+		m_chebyshevStep++;
+	}
+	ParallelParticles([this, chebyshev](uint32_t begin, uint32_t end) {
+		ClothKernels::ApplyJacobi(m_streams, m_jacobiX.data(), m_jacobiY.data(), m_jacobiZ.data(),
+			chebyshev ? m_previousX.data() : nullptr, chebyshev ? m_previousY.data() : nullptr, chebyshev ? m_previousZ.data() : nullptr,
+			begin, end, chebyshev ? m_chebyshevOmega : 1.0f, m_useSimd);
+	});
+}
+
+void ParticleSystem::SolveStickSweepXPBD(float h)
 {
-	for (int i = 0; i < NUM_PARTICLES; i++) 
+	const float invH2 = 1.0f / (h * h);
+	const std::vector<StickBatch>& batches = m_sleepingEnabled ? m_activeBatches : m_stickBatches;
+	const uint32_t* stickA = m_sleepingEnabled ? m_activeStickA.data() : m_stickA.data();
+	const uint32_t* stickB = m_sleepingEnabled ? m_activeStickB.data() : m_stickB.data();
+	const float* compliance = m_sleepingEnabled ? m_activeCompliance.data() : m_stickCompliance.data();
+	float* lambda = m_sleepingEnabled ? m_activeLambda.data() : m_stickLambda.data();
+	for (auto it = batches.begin(); it != batches.end(); ++it)
 	{
-		m_acceleration[i] = m_vGravity;
+		const uint32_t batchBegin = it->begin;
+		ParallelRange(it->end - it->begin, [this, batchBegin, invH2, stickA, stickB, compliance, lambda](uint32_t begin, uint32_t end) {
+			ClothKernels::SolveSticksXPBD(m_streams, m_invMass.data(), stickA, stickB,
+				compliance, lambda, batchBegin + begin, batchBegin + end, m_restLength, invH2, m_useSimd);
+		});
+	}
 
+	//sleeping ends have zero inverse mass
+	for (size_t k = 0; k < m_borderStickAwake.size() && m_sleepingEnabled; k++)
+	{
+		ClothKernels::SolveStickXPBD(m_streams, m_invMass.data(), m_borderStickAwake[k], m_borderStickAsleep[k],
+			m_restLength, m_borderCompliance[k], m_borderLambda[k], invH2);
 	}
 }
+
+void ParticleSystem::AccumulateForces()
+{
+	ParallelParticles([this](uint32_t begin, uint32_t end) {
+		ClothKernels::AccumulateForces(m_streams, begin, end, m_vGravity, m_useSimd);
+	});
+}
@@ -1,48 +1,407 @@
 #pragma once
 #include <DirectXMath.h>
-#include <DirectXHelpers.h>
 #include <stdio.h>
+#include <algorithm>
+#include <mutex>
 #include <vector>
+#include "ThreadPool.h"
+#include "ClothKernels.h"
+#include "ClothSelfCollision.h"
+#include "Colliders.h"
 
 using namespace DirectX;
 
-class ParticleSystem
+class ClothRecorder;
+
+//how the stick constraints are relaxed each Update
+enum class ClothSolver
 {
+	//NUM_ITERATIONS Gauss-Seidel sweeps with a fixed 0.5/0.5 correction
+	GaussSeidel,
+	//extended position based dynamics: per-stick compliance, small substeps
+	XPBD,
+	//NUM_ITERATIONS fully parallel Jacobi sweeps, over-relaxed and optionally
+	//Chebyshev accelerated. Slower than Gauss-Seidel and only kept to compare
+	//against: a sweep costs about as much as a Gauss-Seidel one, but matching
+	//the worst stretch of n Gauss-Seidel sweeps takes about 5n of them
+	//(cloth_benchmark --solver jacobi --versus-gs)
+	Jacobi
+};
 
-	struct StickConstraint
+class ParticleSystem
+{
+protected:
+	//range of m_stickA/m_stickB whose sticks share no particle, so a whole
+	//batch can be solved in any order (or in parallel) with the same result
+	struct StickBatch
 	{
-		StickConstraint(uint32_t pA, uint32_t pB)
+		StickBatch(uint32_t Begin, uint32_t End)
 		{
-			this->particleA = pA;
-			this->particleB = pB;
+			this->begin = Begin;
+			this->end = End;
 		}
-		uint32_t particleA;
-		uint32_t particleB;
+		uint32_t begin;
+		uint32_t end;
+	};
+
+	//particles [begin, end) of the grid that are all awake
+	struct ParticleRun
+	{
+		ParticleRun(uint32_t Begin, uint32_t End) : begin(Begin), end(End) {}
+		uint32_t begin;
+		uint32_t end;
 	};
 
+	//chunk size used in deterministic mode, and the smallest chunk otherwise
+	static const uint32_t PARALLEL_GRAIN = 2048;
+	static const uint32_t MIN_GRAIN = 256;
+	//position, previous position and acceleration, x/y/z each, plus the
+	//positions the last step started from for render interpolation
+	static const uint32_t STREAM_COUNT = 12;
 
-	static const uint32_t PARTICLE_DIM = 32;
-	static const uint32_t NUM_PARTICLES = PARTICLE_DIM * PARTICLE_DIM;
-	static const uint32_t NUM_ITERATIONS = 8;
-	XMFLOAT3 m_pos[NUM_PARTICLES];
-	XMFLOAT3 m_oldPos[NUM_PARTICLES];
-	XMFLOAT3 m_acceleration[NUM_PARTICLES];
+	uint32_t m_width;
+	uint32_t m_height;
+	uint32_t m_numParticles;
+	uint32_t m_numIterations;
+	//adaptive Gauss-Seidel/Jacobi: sweeps stop once no stick is stretched by more
+	//than m_iterationTolerance * rest length, after m_minIterations and at
+	//most m_maxIterations
+	bool m_adaptiveIterations;
+	float m_iterationTolerance;
+	uint32_t m_minIterations;
+	uint32_t m_maxIterations;
+	//stretch seen by the current sweep, chunks merge into it under the lock
+	StickError m_sweepError;
+	std::mutex m_sweepErrorLock;
+	uint32_t m_lastIterations;
+	float m_lastMaxError;
+	float m_lastRmsError;
+	//particle state is stored as separate x/y/z streams (SoA) in one
+	//aligned heap block so the kernels can work on 4 or 8 particles at once
+	float* m_storage;
+	bool m_ownsStorage;
+	ParticleStreams m_streams;
+	//fraction of the velocity lost per step
+	float m_damping;
+	float* m_stepStartX;
+	float* m_stepStartY;
+	float* m_stepStartZ;
 	XMFLOAT3 m_vGravity;
 
-	XMFLOAT3 m_EdgeConstraint[PARTICLE_DIM];
-	std::vector<StickConstraint*> m_StickConstraint;
+	std::vector<XMFLOAT3> m_EdgeConstraint;
+	//stick constraints stored by value as two flat particle index streams
+	std::vector<uint32_t> m_stickA;
+	std::vector<uint32_t> m_stickB;
+	std::vector<StickBatch> m_stickBatches;
 	float m_restLength;
+	//XPBD state: inverse mass per particle (0 = pinned), compliance and
+	//accumulated lambda per stick
+	std::vector<float> m_invMass;
+	std::vector<float> m_stickCompliance;
+	std::vector<float> m_stickLambda;
+	ClothSolver m_solver;
+	//Jacobi: SOR weight of the summed correction, and the spectral radius
+	//estimate driving the Chebyshev weights (0 = no acceleration)
+	float m_jacobiRelaxation;
+	float m_spectralRadius;
+	float m_chebyshevOmega;
+	//sweeps since the Chebyshev weights last (re)started, and the largest
+	//stretch the previous sweep measured
+	uint32_t m_chebyshevStep;
+	float m_previousSweepMax;
+	//Jacobi results, and the positions of the previous iteration for Chebyshev
+	std::vector<float> m_jacobiX;
+	std::vector<float> m_jacobiY;
+	std::vector<float> m_jacobiZ;
+	std::vector<float> m_previousX;
+	std::vector<float> m_previousY;
+	std::vector<float> m_previousZ;
+	uint32_t m_substeps;
+	uint32_t m_substepIterations;
+	bool m_useSimd;
+	bool m_deterministic;
+	ThreadPool* m_threadPool;
+	ClothSelfCollision m_selfCollision;
+	bool m_selfCollisionEnabled;
+	const ColliderSet* m_colliders;
+	ClothRecorder* m_recorder;
+
+	//sleeping: the grid is cut into TILE_DIM x TILE_DIM tiles, and a tile
+	//whose particles all stayed within SLEEP_STEPS steps at m_sleepSpeed of
+	//where they were SLEEP_STEPS steps ago is frozen until something disturbs
+	//it. Measuring the drift over the window rather than the speed of every
+	//step lets cloth resting on a collider settle, where each step pushes it
+	//in and out a little.
+	static const uint32_t TILE_DIM = 8;
+	static const uint32_t SLEEP_STEPS = 30;
+	//a neighbour this many times faster than the sleep speed wakes a tile
+	static const uint32_t WAKE_FACTOR = 4;
+	bool m_sleepingEnabled;
+	float m_sleepSpeed;
+	uint32_t m_tilesX;
+	uint32_t m_tilesZ;
+	std::vector<uint8_t> m_tileAsleep;
+	std::vector<uint32_t> m_tileStillSteps;
+	//largest squared displacement of the last step, and from the anchor, per tile
+	std::vector<float> m_tileMotion;
+	std::vector<float> m_tileDrift;
+	//where each particle was when its tile's still window started
+	std::vector<float> m_anchorX;
+	std::vector<float> m_anchorY;
+	std::vector<float> m_anchorZ;
+	//bounds of every sleeping tile, as it fell asleep
+	std::vector<ColliderSet::Bounds> m_tileBounds;
+	//edge constraint as of the previous step, to notice it moving
+	std::vector<XMFLOAT3> m_previousEdge;
+	//awake tiles, then the sleeping tiles next to them (which sticks can still pull)
+	std::vector<uint32_t> m_trackedTiles;
+	uint32_t m_awakeTileCount;
+	//the awake tiles as runs of consecutive particles, whole awake grid rows
+	//merged, and the awake particles before each run
+	std::vector<ParticleRun> m_awakeRuns;
+	std::vector<uint32_t> m_awakeRunOffsets;
+	bool m_sleepDirty;
+	//sticks with both ends awake, coloured like m_stickBatches
+	std::vector<uint32_t> m_activeStickA;
+	std::vector<uint32_t> m_activeStickB;
+	std::vector<float> m_activeCompliance;
+	std::vector<float> m_activeLambda;
+	std::vector<StickBatch> m_activeBatches;
+	//sticks from an awake particle to a sleeping one, which holds still like a pin
+	std::vector<uint32_t> m_borderStickAwake;
+	std::vector<uint32_t> m_borderStickAsleep;
+	std::vector<float> m_borderCompliance;
+	std::vector<float> m_borderLambda;
 
 public:
-	ParticleSystem();
-	~ParticleSystem();
+	static const uint32_t DEFAULT_DIM = 32;
+	static const uint32_t DEFAULT_ITERATIONS = 8;
+	static const uint32_t DEFAULT_SUBSTEPS = 4;
+	static const float DEFAULT_SLEEP_SPEED;
+	static const float DEFAULT_ITERATION_TOLERANCE;
+	static const float DEFAULT_JACOBI_RELAXATION;
+	static const float DEFAULT_SPECTRAL_RADIUS;
+
+	//storage = nullptr allocates the streams, otherwise they are placed in
+	//caller-owned memory of GetStorageSize floats, 32 byte aligned
+	ParticleSystem(uint32_t width = DEFAULT_DIM, uint32_t height = DEFAULT_DIM, uint32_t iterations = DEFAULT_ITERATIONS, float* storage = nullptr);
+	virtual ~ParticleSystem();
+	static size_t GetStorageSize(uint32_t width, uint32_t height);
+	//copy the particle state into new caller-owned memory and continue from there
+	void RelocateStorage(float* storage);
 	void Update(float dt);
 	void Init();
-	XMFLOAT3& GetParticlesPos(uint32_t ii);
-	XMFLOAT3* GetEdge() { return m_EdgeConstraint; }
+	XMFLOAT3 GetParticlesPos(uint32_t ii) const;
+	//position between the start (alpha = 0) and end (alpha = 1) of the last step
+	XMFLOAT3 GetInterpolatedPos(uint32_t ii, float alpha) const;
+	//GetInterpolatedPos for particles [begin, end) into SoA arrays, same results
+	void GetInterpolatedPositions(uint32_t begin, uint32_t end, float alpha, float* x, float* y, float* z) const;
+	//remember the current positions as the start of the next step
+	void SaveStepStart();
+	//compact binary copy of the positions, previous positions, edge,
+	//compliance and (when sleeping) tile state, to warm start from later
+	void SaveState(std::vector<uint8_t>& out) const;
+	//load a SaveState blob into this cloth, which must be initialized and of
+	//the same size; returns false and leaves the cloth as it was otherwise
+	bool RestoreState(const uint8_t* data, size_t size);
+	//every Update is appended to the recorder's replay stream (nullptr = none)
+	void SetRecorder(ClothRecorder* recorder) { m_recorder = recorder; }
+	XMFLOAT3* GetEdge() { return m_EdgeConstraint.data(); }
+	const XMFLOAT3* GetEdge() const { return m_EdgeConstraint.data(); }
+	uint32_t GetEdgeCount() const { return m_width; }
+	uint32_t GetWidth() const { return m_width; }
+	uint32_t GetHeight() const { return m_height; }
+	uint32_t GetParticleCount() const { return m_numParticles; }
+	uint32_t GetIterationCount() const { return m_numIterations; }
+	//Gauss-Seidel and Jacobi: stop sweeping once every stick is within tolerance of
+	//its rest length (as a fraction of it), running at least minIterations and
+	//at most maxIterations sweeps (0 = twice the fixed iteration count)
+	void SetAdaptiveIterations(bool enabled, float tolerance = DEFAULT_ITERATION_TOLERANCE, uint32_t minIterations = 2, uint32_t maxIterations = 0);
+	bool IsAdaptiveIterationsEnabled() const { return m_adaptiveIterations; }
+	//stick sweeps run by the last Update (XPBD: substeps * sweeps per substep)
+	uint32_t GetLastIterationCount() const { return m_lastIterations; }
+	//largest and RMS stretch, relative to the rest length, seen by the last
+	//sweep of the last Update; only measured with adaptive iterations
+	float GetLastMaxError() const { return m_lastMaxError; }
+	float GetLastRmsError() const { return m_lastRmsError; }
+	uint32_t GetStickCount() const { return static_cast<uint32_t>(m_stickA.size()); }
+	void SetSolver(ClothSolver solver) { m_solver = solver; }
+	ClothSolver GetSolver() const { return m_solver; }
+	//XPBD only: substeps per Update and stick sweeps per substep
+	void SetSubsteps(uint32_t substeps, uint32_t iterationsPerSubstep = 1);
+	//Jacobi only: weight of a quarter of the summed stick corrections (1 = plain
+	//Jacobi, up to ~2.4 over-relaxes), and the spectral radius of the relaxed
+	//Jacobi iteration for Chebyshev acceleration, in [0, 1) (0 = off)
+	void SetJacobiAcceleration(float relaxation = DEFAULT_JACOBI_RELAXATION, float spectralRadius = DEFAULT_SPECTRAL_RADIUS);
+	//XPBD compliance (inverse stiffness) of every stick, 0 = rigid
+	void SetCompliance(float compliance);
+	void SetStickCompliance(uint32_t stick, float compliance) { m_stickCompliance[stick] = compliance; m_sleepDirty = true; }
+	//switch between the SSE/AVX2 kernels and the scalar reference path
+	void SetSimdEnabled(bool enabled) { m_useSimd = enabled; }
+	bool IsSimdEnabled() const { return m_useSimd; }
+	//spread integration, stick batches and collision over a pool (nullptr = calling thread only)
+	void SetThreadPool(ThreadPool* pool) { m_threadPool = pool; }
+	//fixed-size chunks so results are identical for any thread count
+	void SetDeterministic(bool deterministic) { m_deterministic = deterministic; }
+	//keep particles at least thickness apart (0 = half the rest length);
+	//skipGridNeighbours leaves the 8 stick neighbours of each particle out
+	void SetSelfCollision(bool enabled, float thickness = 0.0f, bool skipGridNeighbours = true);
+	bool IsSelfCollisionEnabled() const { return m_selfCollisionEnabled; }
+	//fraction of the velocity removed every step (0 = none), lets the cloth settle
+	void SetDamping(float damping) { m_damping = damping; }
+	//shapes the cloth is kept out of (nullptr = none), shared and owned by the caller
+	void SetColliders(const ColliderSet* colliders) { m_colliders = colliders; }
+	//let still regions sleep; speed is the threshold in units per second
+	void SetSleeping(bool enabled, float speed = DEFAULT_SLEEP_SPEED);
+	bool IsSleepingEnabled() const { return m_sleepingEnabled; }
+	//wake every tile, e.g. after teleporting the cloth
+	void WakeAll();
+	uint32_t GetTileCount() const { return m_tilesX * m_tilesZ; }
+	uint32_t GetAwakeTileCount() const { return m_sleepingEnabled ? m_awakeTileCount : GetTileCount(); }
+protected:
+	//hooks FixedParticleSystem replaces with compile-time bounded versions
+	virtual void AccumulateForces();
+	virtual void Verlet(float dt);
+	virtual void SolveStickSweep();
+	virtual void StatisfyConstraints();
+	void SolveStickSweepJacobi(uint32_t iteration);
+	void UpdateXPBD(float dt);
+	void SolveStickSweepXPBD(float h);
+	void ApplyEdgeConstraint();
+	void SolveCollisions();
+	void SolveSelfCollision();
+	//adds a chunk's stick error to the current sweep's
+	void MergeSweepError(const StickError& error);
+	//true when the whole cloth would run as one chunk on the calling thread anyway
+	bool IsSingleChunk() const { return !m_threadPool || m_numParticles <= PARALLEL_GRAIN; }
+	void ParallelRange(uint32_t count, const ThreadPool::RangeJob& job);
+	//runs job over every particle, or only over the awake runs when sleeping
+	void ParallelParticles(const ThreadPool::RangeJob& job);
 private:
-	void Verlet(float dt);
-	void StatisfyConstraints();
-	void AccumulateForces();
+	void BindStreams(float* storage);
+	void AddStickBatch(uint32_t firstA, uint32_t strideA, uint32_t countA, uint32_t rowStride, uint32_t rows, uint32_t offsetB);
+	uint32_t GetTile(uint32_t particle) const { return (particle % m_width) / TILE_DIM + (particle / m_width / TILE_DIM) * m_tilesX; }
+	//job(begin, end) for every grid row of the tile; a template, this runs once per row
+	template<typename Job>
+	void ForEachTileRow(uint32_t tile, const Job& job) const
+	{
+		const uint32_t x0 = (tile % m_tilesX) * TILE_DIM;
+		const uint32_t z0 = (tile / m_tilesX) * TILE_DIM;
+		const uint32_t x1 = std::min(x0 + TILE_DIM, m_width);
+		const uint32_t z1 = std::min(z0 + TILE_DIM, m_height);
+		for (uint32_t zz = z0; zz < z1; zz++)
+		{
+			job(zz * m_width + x0, zz * m_width + x1);
+		}
+	}
+	void SetTileAsleep(uint32_t tile, bool asleep);
+	void WakeTile(uint32_t tile);
+	void WakeTiles();
+	void UpdateSleep(float dt);
+	//starts the still window of a tile over from its current positions
+	void AnchorTile(uint32_t tile);
+	void RebuildActiveSet();
+
+	//no copies, the streams point into m_storage
+	ParticleSystem(const ParticleSystem&);
+	ParticleSystem& operator=(const ParticleSystem&);
+};
+
+// --------------------------------------------------------
+// Cloth with its resolution fixed at compile time
+//
+// Behaves exactly like ParticleSystem(W, H, Iterations), but when it
+// runs on the calling thread the integration, the Iterations stick
+// sweeps and every row inside them use constant bounds, so the
+// compiler can unroll them. All sticks are solved with plain vector
+// loads: vertical ones row against row, horizontal ones along the
+// row with the other parity masked, instead of the gathers the
+// runtime-sized path needs. Cloths big enough to be split across a
+// thread pool, sleeping cloths and the other solvers fall back to
+// the runtime path; adaptive iterations keep the fixed sweeps but
+// the runtime loop.
+// --------------------------------------------------------
+template<uint32_t W, uint32_t H, uint32_t Iterations = ParticleSystem::DEFAULT_ITERATIONS>
+class FixedParticleSystem : public ParticleSystem
+{
+	static_assert(W >= 2 && H >= 2, "cloth needs at least 2x2 particles");
+	static_assert(Iterations >= 1, "cloth needs at least one sweep");
+public:
+	static const uint32_t NUM_PARTICLES = W * H;
+
+	FixedParticleSystem(float* storage = nullptr) : ParticleSystem(W, H, Iterations, storage) {}
+
+protected:
+	virtual void AccumulateForces() override
+	{
+		if (!IsSingleChunk() || m_sleepingEnabled)
+		{
+			ParticleSystem::AccumulateForces();
+			return;
+		}
+		ClothKernels::AccumulateForces(m_streams, 0, NUM_PARTICLES, m_vGravity, m_useSimd);
+	}
+
+	virtual void Verlet(float dt) override
+	{
+		if (!IsSingleChunk() || m_sleepingEnabled)
+		{
+			ParticleSystem::Verlet(dt);
+			return;
+		}
+		ClothKernels::Verlet(m_streams, 0, NUM_PARTICLES, dt * dt, m_damping, m_useSimd);
+	}
+
+	virtual void StatisfyConstraints() override
+	{
+		if (!IsSingleChunk() || m_sleepingEnabled || m_adaptiveIterations || m_solver != ClothSolver::GaussSeidel)
+		{
+			ParticleSystem::StatisfyConstraints();
+			return;
+		}
+		ApplyEdgeConstraint();
+		for (uint32_t j = 0; j < Iterations; j++)
+		{
+			SolveFixedSweep(nullptr);
+			SolveCollisions();
+		}
+		m_lastIterations = Iterations;
+		SolveSelfCollision();
+	}
+
+	virtual void SolveStickSweep() override
+	{
+		if (!IsSingleChunk() || m_sleepingEnabled)
+		{
+			ParticleSystem::SolveStickSweep();
+			return;
+		}
+		//single chunk, the error can be gathered straight into the sweep's
+		SolveFixedSweep(m_adaptiveIterations ? &m_sweepError : nullptr);
+	}
+
+private:
+	//corrections of one row of horizontal sticks, see SolveRowPairSticks
+	float m_rowScratch[3 * (W + 1)];
+
+	void SolveFixedSweep(StickError* error)
+	{
+		//same colour order as the runtime batches: even/odd columns of
+		//horizontal sticks, then even/odd rows of vertical sticks
+		for (uint32_t parity = 0; parity < 2; parity++)
+		{
+			for (uint32_t zz = 0; zz < H; zz++)
+			{
+				ClothKernels::SolveRowPairSticks(m_streams, zz * W, W, parity, m_restLength, m_useSimd, m_rowScratch, error);
+			}
+		}
+		for (uint32_t parity = 0; parity < 2; parity++)
+		{
+			for (uint32_t zz = parity; zz + 1 < H; zz += 2)
+			{
+				ClothKernels::SolveRowSticks(m_streams, zz * W, (zz + 1) * W, W, m_restLength, m_useSimd, error);
+			}
+		}
+	}
 };
 
@@ -0,0 +1,31 @@
+// Camera facing particle quads written by ParticleEmitter::WriteBillboards,
+// already expanded in world space
+cbuffer externalData : register(b0)
+{
+	matrix view;
+	matrix projection;
+};
+
+struct VertexShaderInput
+{
+	float3 position		: POSITION;
+	float fade			: FADE;
+	//4 vertices per particle, the low two bits are the corner
+	uint id				: SV_VertexID;
+};
+
+struct VertexToPixel
+{
+	float4 position		: SV_POSITION;
+	float2 uv			: TEXCOORD;
+	float fade			: FADE;
+};
+
+VertexToPixel main(VertexShaderInput input)
+{
+	VertexToPixel output;
+	output.position = mul(mul(float4(input.position, 1.0f), view), projection);
+	output.uv = float2(input.id & 1, (input.id >> 1) & 1);
+	output.fade = input.fade;
+	return output;
+}
@@ -0,0 +1,51 @@
+// Same as VertexShader.hlsl, for deforming meshes uploaded as
+// QuantizedVertex (see Vertex.h)
+cbuffer externalData : register(b0)
+{
+	matrix world;
+	matrix view;
+	matrix projection;
+	//position = positionMin + quantized * positionStep
+	float3 positionMin;
+	float3 positionStep;
+};
+
+struct VertexShaderInput
+{
+	uint4 packed		: POSITION;     // 16 bit xyz, octahedral normal in w
+	float2 uv			: TEXCOORD;
+};
+
+struct VertexToPixel
+{
+	float4 position		: SV_POSITION;
+	float2 uv			: TEXCOORD;
+	float3 normal		: NORMAL;
+};
+
+//two snorm8 octahedral coordinates back to a unit vector
+float3 DecodeOctahedral(uint packed)
+{
+	int2 bytes = int2(packed << 24, packed << 16) >> 24;
+	float2 f = max(float2(bytes) / 127.0f, -1.0f);
+	float3 n = float3(f, 1.0f - abs(f.x) - abs(f.y));
+	//the lower half was folded over the diagonals
+	if (n.z < 0.0f)
+		n.xy = (1.0f - abs(n.yx)) * float2(n.x >= 0.0f ? 1.0f : -1.0f, n.y >= 0.0f ? 1.0f : -1.0f);
+	return normalize(n);
+}
+
+VertexToPixel main(VertexShaderInput input)
+{
+	VertexToPixel output;
+
+	float3 position = positionMin + float3(input.packed.xyz) * positionStep;
+	matrix worldViewProj = mul(mul(world, view), projection);
+	output.position = mul(float4(position, 1.0f), worldViewProj);
+
+	output.normal = mul(DecodeOctahedral(input.packed.w), (float3x3)world);
+	output.normal = normalize(output.normal);
+
+	output.uv = input.uv;
+	return output;
+}
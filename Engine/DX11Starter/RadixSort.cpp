@@ -0,0 +1,198 @@
+#include "RadixSort.h"
+#include <string.h>
+#include <algorithm>
+#include "SimdMath.h"
+
+namespace
+{
+	//scalar twin of Simd::StoreOrderedU
+	inline uint32_t OrderedBits(float f)
+	{
+		uint32_t bits;
+		memcpy(&bits, &f, sizeof(bits));
+		return bits ^ (static_cast<uint32_t>(static_cast<int32_t>(bits) >> 31) | 0x80000000u);
+	}
+}
+
+RadixSorter::RadixSorter(ThreadPool* threadPool)
+{
+	m_threadPool = threadPool;
+}
+
+void RadixSorter::Sort(uint32_t* keys, uint32_t* values, uint32_t count)
+{
+	if (count < 2)
+		return;
+
+	const uint32_t threads = m_threadPool ? m_threadPool->GetThreadCount() : 1;
+	const uint32_t blocks = std::max(1u, std::min(threads, count / PARALLEL_GRAIN));
+	const uint32_t blockSize = (count + blocks - 1) / blocks;
+	m_scratchKeys.resize(count);
+	m_scratchValues.resize(count);
+	m_counts.assign(static_cast<size_t>(blocks) * PASSES * BUCKETS, 0);
+	uint32_t* counts = m_counts.data();
+
+	//one read of the keys counts the digits of every pass
+	ParallelBlocks(blocks, [keys, count, blockSize, counts](uint32_t begin, uint32_t end) {
+		for (uint32_t b = begin; b < end; b++)
+		{
+			uint32_t* counts0 = counts + static_cast<size_t>(b) * PASSES * BUCKETS;
+			uint32_t* counts1 = counts0 + BUCKETS;
+			uint32_t* counts2 = counts1 + BUCKETS;
+			uint32_t* counts3 = counts2 + BUCKETS;
+			static_assert(PASSES == 4, "the digit counting below is unrolled for 4 passes");
+			const uint32_t last = std::min(count, (b + 1) * blockSize);
+			for (uint32_t i = b * blockSize; i < last; i++)
+			{
+				const uint32_t key = keys[i];
+				counts0[key & (BUCKETS - 1)]++;
+				counts1[(key >> RADIX_BITS) & (BUCKETS - 1)]++;
+				counts2[(key >> (2 * RADIX_BITS)) & (BUCKETS - 1)]++;
+				counts3[key >> (3 * RADIX_BITS)]++;
+			}
+		}
+	});
+
+	uint32_t* srcKeys = keys;
+	uint32_t* srcValues = values;
+	uint32_t* dstKeys = m_scratchKeys.data();
+	uint32_t* dstValues = m_scratchValues.data();
+	bool reordered = false;
+	for (uint32_t pass = 0; pass < PASSES; pass++)
+	{
+		const uint32_t shift = pass * RADIX_BITS;
+
+		//the totals don't depend on the order, so the first counts still tell
+		//whether every key has the same digit
+		bool trivial = false;
+		for (uint32_t d = 0; d < BUCKETS && !trivial; d++)
+		{
+			uint32_t total = 0;
+			for (uint32_t b = 0; b < blocks; b++)
+			{
+				total += counts[(static_cast<size_t>(b) * PASSES + pass) * BUCKETS + d];
+			}
+			trivial = total == count;
+		}
+		if (trivial)
+			continue;
+
+		//the per block counts do, so recount once an earlier pass moved the keys
+		if (reordered)
+		{
+			ParallelBlocks(blocks, [srcKeys, count, blockSize, counts, pass, shift](uint32_t begin, uint32_t end) {
+				for (uint32_t b = begin; b < end; b++)
+				{
+					uint32_t* blockCounts = counts + (static_cast<size_t>(b) * PASSES + pass) * BUCKETS;
+					memset(blockCounts, 0, sizeof(uint32_t) * BUCKETS);
+					const uint32_t last = std::min(count, (b + 1) * blockSize);
+					for (uint32_t i = b * blockSize; i < last; i++)
+					{
+						blockCounts[(srcKeys[i] >> shift) & (BUCKETS - 1)]++;
+					}
+				}
+			});
+		}
+
+		//digit major, block minor: lower blocks write first within a digit, which keeps the pass stable
+		uint32_t offset = 0;
+		for (uint32_t d = 0; d < BUCKETS; d++)
+		{
+			for (uint32_t b = 0; b < blocks; b++)
+			{
+				uint32_t& c = counts[(static_cast<size_t>(b) * PASSES + pass) * BUCKETS + d];
+				const uint32_t n = c;
+				c = offset;
+				offset += n;
+			}
+		}
+
+		ParallelBlocks(blocks, [srcKeys, srcValues, dstKeys, dstValues, count, blockSize, counts, pass, shift](uint32_t begin, uint32_t end) {
+			for (uint32_t b = begin; b < end; b++)
+			{
+				//locals, so the stores below can't be taken to alias the captures
+				uint32_t offsets[BUCKETS];
+				memcpy(offsets, counts + (static_cast<size_t>(b) * PASSES + pass) * BUCKETS, sizeof(offsets));
+				const uint32_t* inKeys = srcKeys;
+				const uint32_t* inValues = srcValues;
+				uint32_t* outKeys = dstKeys;
+				uint32_t* outValues = dstValues;
+				const uint32_t digitShift = shift;
+				const uint32_t last = std::min(count, (b + 1) * blockSize);
+				for (uint32_t i = b * blockSize; i < last; i++)
+				{
+					const uint32_t key = inKeys[i];
+					const uint32_t o = offsets[(key >> digitShift) & (BUCKETS - 1)]++;
+					outKeys[o] = key;
+					outValues[o] = inValues[i];
+				}
+			}
+		});
+		std::swap(srcKeys, dstKeys);
+		std::swap(srcValues, dstValues);
+		reordered = true;
+	}
+
+	//an odd number of passes ran, the result is in the scratch buffers
+	if (srcKeys != keys)
+	{
+		ParallelBlocks(blocks, [srcKeys, srcValues, keys, values, count, blockSize](uint32_t begin, uint32_t end) {
+			for (uint32_t b = begin; b < end; b++)
+			{
+				const uint32_t first = b * blockSize;
+				const uint32_t last = std::min(count, first + blockSize);
+				if (first >= last)
+					continue;
+				memcpy(keys + first, srcKeys + first, sizeof(uint32_t) * (last - first));
+				memcpy(values + first, srcValues + first, sizeof(uint32_t) * (last - first));
+			}
+		});
+	}
+}
+
+void RadixSorter::ParallelBlocks(uint32_t blocks, const ThreadPool::RangeJob& job) const
+{
+	if (m_threadPool && blocks > 1)
+		m_threadPool->ParallelFor(blocks, 1, job);
+	else
+		job(0, blocks);
+}
+
+void WriteDepthKeys(const float* x, const float* y, const float* z, uint32_t count, const XMFLOAT4X4& view,
+	uint32_t firstValue, uint32_t* keys, uint32_t* values, bool useSimd)
+{
+	//the third row of the transposed view matrix gives view space z; negated,
+	//the farthest point gets the smallest key
+	const float ax = -view._31;
+	const float ay = -view._32;
+	const float az = -view._33;
+	const float aw = -view._34;
+
+	uint32_t i = 0;
+	if (useSimd)
+	{
+		const Simd::Float vAx = Simd::Set1(ax);
+		const Simd::Float vAy = Simd::Set1(ay);
+		const Simd::Float vAz = Simd::Set1(az);
+		const Simd::Float vAw = Simd::Set1(aw);
+		const Simd::Float vZero = Simd::Zero();
+		const uint32_t simdEnd = Simd::AlignDown(count);
+		for (; i < simdEnd; i += Simd::WIDTH)
+		{
+			const Simd::Float depth = Simd::Add(Simd::Add(Simd::Add(Simd::Mul(Simd::LoadU(x + i), vAx),
+				Simd::Mul(Simd::LoadU(y + i), vAy)), Simd::Mul(Simd::LoadU(z + i), vAz)), vAw);
+			//adding zero turns -0 into +0, so both sort as one depth
+			Simd::StoreOrderedU(keys + i, Simd::Add(depth, vZero));
+		}
+	}
+	for (; i < count; i++)
+	{
+		const float depth = x[i] * ax + y[i] * ay + z[i] * az + aw;
+		keys[i] = OrderedBits(depth + 0.0f);
+	}
+
+	for (uint32_t j = 0; j < count; j++)
+	{
+		values[j] = firstValue + j;
+	}
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include <DirectXMath.h>
+#include <stdint.h>
+#include <vector>
+#include "ThreadPool.h"
+
+using namespace DirectX;
+
+// --------------------------------------------------------
+// Parallel LSD radix sort of 32 bit keys carrying 32 bit values
+//
+// Four stable passes of 8 bits. Each pass splits the keys into
+// blocks, one task each: the blocks count their digits, a prefix
+// sum over (digit, block) hands every block its own output ranges
+// and the blocks scatter into them. Every pass is stable, so the
+// result doesn't depend on the number of blocks or threads. Passes
+// where all keys share the digit (the top byte of depths that span
+// a small range, say) are skipped. The scratch buffers are kept
+// between calls, so sorting every frame doesn't allocate.
+// --------------------------------------------------------
+class RadixSorter
+{
+public:
+	//fewest keys worth a task of their own
+	static const uint32_t PARALLEL_GRAIN = 65536;
+
+	RadixSorter(ThreadPool* threadPool = nullptr);
+
+	//sorts keys ascending in place and moves values along with them
+	void Sort(uint32_t* keys, uint32_t* values, uint32_t count);
+
+	//spread big sorts over a pool (nullptr = calling thread only)
+	void SetThreadPool(ThreadPool* pool) { m_threadPool = pool; }
+	ThreadPool* GetThreadPool() const { return m_threadPool; }
+
+private:
+	static const uint32_t RADIX_BITS = 8;
+	static const uint32_t BUCKETS = 1 << RADIX_BITS;
+	static const uint32_t PASSES = 32 / RADIX_BITS;
+
+	ThreadPool* m_threadPool;
+	std::vector<uint32_t> m_scratchKeys;
+	std::vector<uint32_t> m_scratchValues;
+	//BUCKETS counts per pass per block, turned into output offsets before scattering
+	std::vector<uint32_t> m_counts;
+
+	void ParallelBlocks(uint32_t blocks, const ThreadPool::RangeJob& job) const;
+
+	RadixSorter(const RadixSorter&);
+	RadixSorter& operator=(const RadixSorter&);
+};
+
+// --------------------------------------------------------
+// Writes keys that sort the points back to front, farthest from
+// the camera first, and values firstValue, firstValue + 1, ...
+//
+// view is the matrix Camera::GetViewMatrix returns (transposed for
+// HLSL). The key is the view space depth with its bits remapped so
+// unsigned order is float order, so the SIMD and scalar paths give
+// the same keys.
+// --------------------------------------------------------
+void WriteDepthKeys(const float* x, const float* y, const float* z, uint32_t count, const XMFLOAT4X4& view,
+	uint32_t firstValue, uint32_t* keys, uint32_t* values, bool useSimd = true);
@@ -0,0 +1,204 @@
+#pragma once
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#if defined(_WIN32)
+#include <malloc.h>
+#endif
+
+// --------------------------------------------------------
+// Thin wrapper over the widest float vector the build targets
+//
+// AVX2 builds (/arch:AVX2) get 8 lanes, x86/x64 builds get SSE
+// with 4 lanes and everything else falls back to plain floats,
+// so kernels can be written once against Simd::Float.
+// --------------------------------------------------------
+#if defined(__AVX2__)
+#define SIMD_AVX2 1
+#include <immintrin.h>
+#elif defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define SIMD_SSE 1
+#include <emmintrin.h>
+#else
+#define SIMD_SCALAR 1
+#endif
+
+namespace Simd
+{
+#if defined(SIMD_AVX2)
+	typedef __m256 Float;
+	typedef __m256 Mask;
+	static const uint32_t WIDTH = 8;
+
+	inline Float Load(const float* p) { return _mm256_load_ps(p); }
+	inline Float LoadU(const float* p) { return _mm256_loadu_ps(p); }
+	inline void Store(float* p, Float v) { _mm256_store_ps(p, v); }
+	inline void StoreU(float* p, Float v) { _mm256_storeu_ps(p, v); }
+	inline void Stream(float* p, Float v) { _mm256_stream_ps(p, v); }
+	inline void StreamFence() { _mm_sfence(); }
+	inline Float Set1(float f) { return _mm256_set1_ps(f); }
+	inline Float Zero() { return _mm256_setzero_ps(); }
+	inline Float Add(Float a, Float b) { return _mm256_add_ps(a, b); }
+	inline Float Sub(Float a, Float b) { return _mm256_sub_ps(a, b); }
+	inline Float Mul(Float a, Float b) { return _mm256_mul_ps(a, b); }
+	inline Float Div(Float a, Float b) { return _mm256_div_ps(a, b); }
+	inline Float Sqrt(Float a) { return _mm256_sqrt_ps(a); }
+	inline Float Min(Float a, Float b) { return _mm256_min_ps(a, b); }
+	inline Float Max(Float a, Float b) { return _mm256_max_ps(a, b); }
+	inline Mask CmpLt(Float a, Float b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+	inline Float Select(Mask m, Float a, Float b) { return _mm256_blendv_ps(b, a, m); }
+	inline bool Any(Mask m) { return _mm256_movemask_ps(m) != 0; }
+	inline Float Gather(const float* base, const uint32_t* idx)
+	{
+		return _mm256_i32gather_ps(base, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(idx)), 4);
+	}
+	inline float ReduceMin(Float v)
+	{
+		__m128 m = _mm_min_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+		m = _mm_min_ps(m, _mm_movehl_ps(m, m));
+		m = _mm_min_ss(m, _mm_shuffle_ps(m, m, 1));
+		return _mm_cvtss_f32(m);
+	}
+	inline float ReduceMax(Float v)
+	{
+		__m128 m = _mm_max_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+		m = _mm_max_ps(m, _mm_movehl_ps(m, m));
+		m = _mm_max_ss(m, _mm_shuffle_ps(m, m, 1));
+		return _mm_cvtss_f32(m);
+	}
+	inline float ReduceAdd(Float v)
+	{
+		__m128 m = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+		m = _mm_add_ps(m, _mm_movehl_ps(m, m));
+		m = _mm_add_ss(m, _mm_shuffle_ps(m, m, 1));
+		return _mm_cvtss_f32(m);
+	}
+#elif defined(SIMD_SSE)
+	typedef __m128 Float;
+	typedef __m128 Mask;
+	static const uint32_t WIDTH = 4;
+
+	inline Float Load(const float* p) { return _mm_load_ps(p); }
+	inline Float LoadU(const float* p) { return _mm_loadu_ps(p); }
+	inline void Store(float* p, Float v) { _mm_store_ps(p, v); }
+	inline void StoreU(float* p, Float v) { _mm_storeu_ps(p, v); }
+	inline void Stream(float* p, Float v) { _mm_stream_ps(p, v); }
+	inline void StreamFence() { _mm_sfence(); }
+	inline Float Set1(float f) { return _mm_set1_ps(f); }
+	inline Float Zero() { return _mm_setzero_ps(); }
+	inline Float Add(Float a, Float b) { return _mm_add_ps(a, b); }
+	inline Float Sub(Float a, Float b) { return _mm_sub_ps(a, b); }
+	inline Float Mul(Float a, Float b) { return _mm_mul_ps(a, b); }
+	inline Float Div(Float a, Float b) { return _mm_div_ps(a, b); }
+	inline Float Sqrt(Float a) { return _mm_sqrt_ps(a); }
+	inline Float Min(Float a, Float b) { return _mm_min_ps(a, b); }
+	inline Float Max(Float a, Float b) { return _mm_max_ps(a, b); }
+	inline Mask CmpLt(Float a, Float b) { return _mm_cmplt_ps(a, b); }
+	//no blendv before SSE4.1, so mask by hand
+	inline Float Select(Mask m, Float a, Float b) { return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b)); }
+	inline bool Any(Mask m) { return _mm_movemask_ps(m) != 0; }
+	inline Float Gather(const float* base, const uint32_t* idx)
+	{
+		return _mm_set_ps(base[idx[3]], base[idx[2]], base[idx[1]], base[idx[0]]);
+	}
+	inline float ReduceMin(Float v)
+	{
+		__m128 m = _mm_min_ps(v, _mm_movehl_ps(v, v));
+		m = _mm_min_ss(m, _mm_shuffle_ps(m, m, 1));
+		return _mm_cvtss_f32(m);
+	}
+	inline float ReduceMax(Float v)
+	{
+		__m128 m = _mm_max_ps(v, _mm_movehl_ps(v, v));
+		m = _mm_max_ss(m, _mm_shuffle_ps(m, m, 1));
+		return _mm_cvtss_f32(m);
+	}
+	inline float ReduceAdd(Float v)
+	{
+		__m128 m = _mm_add_ps(v, _mm_movehl_ps(v, v));
+		m = _mm_add_ss(m, _mm_shuffle_ps(m, m, 1));
+		return _mm_cvtss_f32(m);
+	}
+#else
+	typedef float Float;
+	typedef bool Mask;
+	static const uint32_t WIDTH = 1;
+
+	inline Float Load(const float* p) { return *p; }
+	inline Float LoadU(const float* p) { return *p; }
+	inline void Store(float* p, Float v) { *p = v; }
+	inline void StoreU(float* p, Float v) { *p = v; }
+	inline void Stream(float* p, Float v) { *p = v; }
+	inline void StreamFence() {}
+	inline Float Set1(float f) { return f; }
+	inline Float Zero() { return 0.0f; }
+	inline Float Add(Float a, Float b) { return a + b; }
+	inline Float Sub(Float a, Float b) { return a - b; }
+	inline Float Mul(Float a, Float b) { return a * b; }
+	inline Float Div(Float a, Float b) { return a / b; }
+	inline Float Sqrt(Float a) { return sqrtf(a); }
+	inline Float Min(Float a, Float b) { return a < b ? a : b; }
+	inline Float Max(Float a, Float b) { return a > b ? a : b; }
+	inline Mask CmpLt(Float a, Float b) { return a < b; }
+	inline Float Select(Mask m, Float a, Float b) { return m ? a : b; }
+	inline bool Any(Mask m) { return m; }
+	inline Float Gather(const float* base, const uint32_t* idx) { return base[*idx]; }
+	inline float ReduceMin(Float v) { return v; }
+	inline float ReduceMax(Float v) { return v; }
+	inline float ReduceAdd(Float v) { return v; }
+#endif
+
+	//there is no scatter below AVX-512, so spill the lanes and write them one by one
+	inline void Scatter(float* base, const uint32_t* idx, Float v)
+	{
+		alignas(32) float lanes[WIDTH];
+		Store(lanes, v);
+		for (uint32_t i = 0; i < WIDTH; i++)
+			base[idx[i]] = lanes[i];
+	}
+
+	//the bits of v remapped so that unsigned integer order matches float order:
+	//negatives get every bit flipped, everything else only the sign bit
+	inline void StoreOrderedU(uint32_t* p, Float v)
+	{
+#if defined(SIMD_AVX2)
+		const __m256i bits = _mm256_castps_si256(v);
+		const __m256i flip = _mm256_or_si256(_mm256_srai_epi32(bits, 31), _mm256_set1_epi32(INT32_MIN));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(p), _mm256_xor_si256(bits, flip));
+#elif defined(SIMD_SSE)
+		const __m128i bits = _mm_castps_si128(v);
+		const __m128i flip = _mm_or_si128(_mm_srai_epi32(bits, 31), _mm_set1_epi32(INT32_MIN));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(p), _mm_xor_si128(bits, flip));
+#else
+		uint32_t bits;
+		memcpy(&bits, &v, sizeof(bits));
+		*p = bits ^ (static_cast<uint32_t>(static_cast<int32_t>(bits) >> 31) | 0x80000000u);
+#endif
+	}
+
+	//round count down to a whole number of vectors
+	inline uint32_t AlignDown(uint32_t count) { return count - (count % WIDTH); }
+
+	//heap memory aligned for the widest vector load (32 bytes covers AVX)
+	static const size_t ALIGNMENT = 32;
+	inline void* AlignedAlloc(size_t size)
+	{
+#if defined(_WIN32)
+		return _aligned_malloc(size, ALIGNMENT);
+#else
+		void* p = 0;
+		if (posix_memalign(&p, ALIGNMENT, size) != 0)
+			return 0;
+		return p;
+#endif
+	}
+	inline void AlignedFree(void* p)
+	{
+#if defined(_WIN32)
+		_aligned_free(p);
+#else
+		free(p);
+#endif
+	}
+}
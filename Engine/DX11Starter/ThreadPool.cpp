@@ -0,0 +1,175 @@
+#include "ThreadPool.h"
+#include <algorithm>
+
+namespace
+{
+	//queue owned by the current thread; 0 is shared by every non-worker thread
+	thread_local uint32_t tl_queueIndex = 0;
+}
+
+ThreadPool::ThreadPool(uint32_t workerCount)
+{
+	if (workerCount == 0)
+	{
+		uint32_t hardwareThreads = std::thread::hardware_concurrency();
+		workerCount = hardwareThreads > 1 ? hardwareThreads - 1 : 0;
+	}
+
+	m_pending = 0;
+	m_quit = false;
+
+	//queue 0 belongs to the caller(s), 1..N to the workers
+	for (uint32_t i = 0; i <= workerCount; i++)
+	{
+		m_queues.push_back(new WorkQueue);
+	}
+	for (uint32_t i = 0; i < workerCount; i++)
+	{
+		m_threads.push_back(std::thread(&ThreadPool::WorkerMain, this, i + 1));
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_wakeLock);
+		m_quit = true;
+	}
+	m_wake.notify_all();
+	for (size_t i = 0; i < m_threads.size(); i++)
+	{
+		m_threads[i].join();
+	}
+	for (size_t i = 0; i < m_queues.size(); i++)
+	{
+		delete m_queues[i];
+	}
+}
+
+void ThreadPool::ParallelFor(uint32_t count, uint32_t grain, const RangeJob& job)
+{
+	if (count == 0)
+		return;
+	if (grain == 0)
+		grain = 1;
+
+	const uint32_t chunks = (count + grain - 1) / grain;
+	if (chunks == 1 || m_threads.empty())
+	{
+		job(0, count);
+		return;
+	}
+
+	//deal the chunks out round robin, starting with our own queue
+	std::atomic<uint32_t> remaining(chunks);
+	const uint32_t self = tl_queueIndex;
+	const uint32_t queueCount = static_cast<uint32_t>(m_queues.size());
+	m_pending.fetch_add(chunks);
+	for (uint32_t c = 0; c < chunks; c++)
+	{
+		Task task;
+		task.job = &job;
+		task.begin = c * grain;
+		task.end = task.begin + grain < count ? task.begin + grain : count;
+		task.remaining = &remaining;
+
+		WorkQueue* queue = m_queues[(self + c) % queueCount];
+		std::lock_guard<std::mutex> lock(queue->lock);
+		queue->tasks.push_back(task);
+	}
+	{
+		std::lock_guard<std::mutex> lock(m_wakeLock);
+	}
+	m_wake.notify_all();
+
+	//help out until every chunk of this call has run; workers take anything,
+	//other threads share queue 0 and stick to their own chunks
+	const bool worker = self != 0;
+	while (remaining.load(std::memory_order_acquire) > 0)
+	{
+		Task task;
+		if (worker ? PopTask(self, task) || StealTask(self, task) : TakeOwnTask(&remaining, task))
+		{
+			RunTask(task);
+		}
+		else
+		{
+			std::this_thread::yield();
+		}
+	}
+}
+
+void ThreadPool::WorkerMain(uint32_t queueIndex)
+{
+	tl_queueIndex = queueIndex;
+	while (true)
+	{
+		Task task;
+		if (PopTask(queueIndex, task) || StealTask(queueIndex, task))
+		{
+			RunTask(task);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(m_wakeLock);
+		m_wake.wait(lock, [this] { return m_quit.load() || m_pending.load() > 0; });
+		if (m_quit)
+			return;
+	}
+}
+
+bool ThreadPool::PopTask(uint32_t queueIndex, Task& task)
+{
+	//newest first from our own queue, it is most likely still in cache
+	WorkQueue* queue = m_queues[queueIndex];
+	std::lock_guard<std::mutex> lock(queue->lock);
+	if (queue->tasks.empty())
+		return false;
+	task = queue->tasks.back();
+	queue->tasks.pop_back();
+	m_pending.fetch_sub(1);
+	return true;
+}
+
+bool ThreadPool::StealTask(uint32_t queueIndex, Task& task)
+{
+	//oldest first from everyone else
+	const uint32_t queueCount = static_cast<uint32_t>(m_queues.size());
+	for (uint32_t i = 1; i < queueCount; i++)
+	{
+		WorkQueue* queue = m_queues[(queueIndex + i) % queueCount];
+		std::lock_guard<std::mutex> lock(queue->lock);
+		if (queue->tasks.empty())
+			continue;
+		task = queue->tasks.front();
+		queue->tasks.pop_front();
+		m_pending.fetch_sub(1);
+		return true;
+	}
+	return false;
+}
+
+bool ThreadPool::TakeOwnTask(const std::atomic<uint32_t>* remaining, Task& task)
+{
+	//our own chunks start in queue 0, the rest are dealt to the workers in order
+	for (size_t i = 0; i < m_queues.size(); i++)
+	{
+		WorkQueue* queue = m_queues[i];
+		std::lock_guard<std::mutex> lock(queue->lock);
+		std::deque<Task>::iterator it = std::find_if(queue->tasks.begin(), queue->tasks.end(),
+			[remaining](const Task& queued) { return queued.remaining == remaining; });
+		if (it == queue->tasks.end())
+			continue;
+		task = *it;
+		queue->tasks.erase(it);
+		m_pending.fetch_sub(1);
+		return true;
+	}
+	return false;
+}
+
+void ThreadPool::RunTask(const Task& task)
+{
+	(*task.job)(task.begin, task.end);
+	task.remaining->fetch_sub(1, std::memory_order_release);
+}
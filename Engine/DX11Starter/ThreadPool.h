@@ -0,0 +1,67 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// --------------------------------------------------------
+// Small work-stealing thread pool
+//
+// Every worker owns a deque of tasks. Workers pop from the back of
+// their own deque and steal from the front of the others' when they
+// run dry. ParallelFor splits a range into chunks, hands them out and
+// helps execute until every chunk is done, so each call is also a
+// barrier for the work it issued. Threads outside the pool only help
+// with the chunks of their own call, so two of them calling at once
+// (say the cloth stepper and the render thread) never end up running
+// each other's work.
+// --------------------------------------------------------
+class ThreadPool
+{
+public:
+	typedef std::function<void(uint32_t begin, uint32_t end)> RangeJob;
+
+	//workerCount = 0 picks one worker per hardware thread minus the caller
+	ThreadPool(uint32_t workerCount = 0);
+	~ThreadPool();
+
+	//number of threads that execute work, including the calling thread
+	uint32_t GetThreadCount() const { return static_cast<uint32_t>(m_threads.size()) + 1; }
+
+	//runs job over [0, count) in chunks of at most grain, returns when all chunks finished
+	void ParallelFor(uint32_t count, uint32_t grain, const RangeJob& job);
+
+private:
+	struct Task
+	{
+		const RangeJob* job;
+		uint32_t begin;
+		uint32_t end;
+		std::atomic<uint32_t>* remaining;
+	};
+
+	struct WorkQueue
+	{
+		std::mutex lock;
+		std::deque<Task> tasks;
+	};
+
+	std::vector<WorkQueue*> m_queues;
+	std::vector<std::thread> m_threads;
+	std::mutex m_wakeLock;
+	std::condition_variable m_wake;
+	std::atomic<uint32_t> m_pending;
+	std::atomic<bool> m_quit;
+
+	void WorkerMain(uint32_t queueIndex);
+	bool PopTask(uint32_t queueIndex, Task& task);
+	bool StealTask(uint32_t queueIndex, Task& task);
+	//any queued chunk of the call waiting on remaining
+	bool TakeOwnTask(const std::atomic<uint32_t>* remaining, Task& task);
+	void RunTask(const Task& task);
+};
+
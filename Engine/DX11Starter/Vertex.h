@@ -1,5 +1,6 @@
 #pragma once
 
+#include <stdint.h>
 #include <DirectXMath.h>
 
 // --------------------------------------------------------
@@ -15,8 +16,58 @@ struct Vertex
 
 };
 
-//cloth struct 
-struct VertexPosColor {
-	DirectX::XMFLOAT3 pos;
-	DirectX::XMFLOAT3 color;
-};
\ No newline at end of file
+//vertices addressable with 16 bit indices, shared by Mesh and the mesh cache
+const uint32_t MAX_SHORT_INDEX_VERTICES = 65536;
+
+// --------------------------------------------------------
+// Vertex streams of a deforming mesh
+//
+// Only what moves is uploaded every frame (slot 0), the rest sits
+// in an immutable buffer (slot 1). The normal is 8 bit snorm xyz
+// with w unused, the input assembler unpacks it to a float3.
+// --------------------------------------------------------
+struct DynamicVertex
+{
+	DirectX::XMFLOAT3 Position;
+	uint32_t Normal;
+};
+
+struct StaticVertex
+{
+	DirectX::XMFLOAT2 UV;
+};
+
+// --------------------------------------------------------
+// Compressed dynamic stream of a deforming mesh, half of a
+// DynamicVertex
+//
+// Position is 16 bit unsigned xyz relative to the mesh's bounds
+// for this frame, decoded in the vertex shader with the matching
+// QuantizationBounds. The fourth value is the normal folded onto
+// an octahedron, two 8 bit snorm coordinates.
+// --------------------------------------------------------
+struct QuantizedVertex
+{
+	uint16_t Position[3];
+	uint16_t Normal;
+};
+
+//position = Min + quantized * Step, per component
+struct QuantizationBounds
+{
+	DirectX::XMFLOAT3 Min;
+	DirectX::XMFLOAT3 Step;
+};
+
+// --------------------------------------------------------
+// Corner of a camera facing particle quad
+//
+// Four per particle, in the order (-right, -up), (+right, -up),
+// (-right, +up), (+right, +up); the vertex shader takes the uv from
+// SV_VertexID. Fade runs from 1 at birth to 0 at death.
+// --------------------------------------------------------
+struct BillboardVertex
+{
+	DirectX::XMFLOAT3 Position;
+	float Fade;
+};